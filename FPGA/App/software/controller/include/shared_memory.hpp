@@ -67,6 +67,77 @@ struct SharedMemory {
          */
         float speed_gain_p[4], speed_gain_i[4];
 
+        /**
+         * 加速度リミッタの目的関数の重み (X, Y, ω, C)
+         * NaNや無限大を含むときと、1e-3～1e3の範囲外の値を含むときはファームウェアの既定値を使う
+         */
+        float acceleration_weight[4];
+
+        /**
+         * 軌道の経由点の最大数
+         */
+        static constexpr int TRAJECTORY_SIZE = 8;
+
+        /**
+         * 軌道の経由点
+         * 経由点の間は速度と加速度を端点とする3次エルミート補間で目標車体速度を求める
+         * NaNや無限大を含む経由点があるときは軌道全体を不正として扱う
+         */
+        struct TrajectoryPoint {
+            /**
+             * Nios IIがこのフレームを受け取ってからの時刻 [s]
+             * 経由点の順に狭義単調増加でなければならない
+             */
+            float time;
+
+            /**
+             * 目標車体速度 X [m/s], Y [m/s], ω [rad/s]
+             */
+            float speed[3];
+
+            /**
+             * 目標車体加速度 X [m/s^2], Y [m/s^2], ω [rad/s^2]
+             */
+            float accel[3];
+        };
+
+        /**
+         * 有効な経由点の数 (0 ～ TRAJECTORY_SIZE)
+         * 0のときは経由点を使わずspeed_x, speed_y, speed_omegaを目標車体速度とする
+         * 最初の経由点より前は最初の経由点の、最後の経由点より後は最後の経由点の速度を保持する
+         */
+        uint32_t trajectory_count;
+
+        /**
+         * 軌道の経由点
+         */
+        TrajectoryPoint trajectory[TRAJECTORY_SIZE];
+
+        /**
+         * 制御周波数 [Hz] (0, 1000, 2000, 4000)
+         * 0のときは1000Hzとする。対応していない値のときは変更しない
+         * 変更するとIMUの出力データレートを切り替えて車輪の制御をやり直す
+         */
+        uint32_t control_rate;
+
+        /**
+         * 自己位置をリセットする番号
+         * 前回受け取った値から変わったときに自己位置をpose_offsetに設定する
+         * 起動直後の自己位置は原点で、この番号は0を受け取ったものとして扱う
+         */
+        uint32_t pose_reset_number;
+
+        /**
+         * 自己位置をリセットするときの値 X [m], Y [m], θ [rad] (θは-8π～8πの範囲)
+         */
+        float pose_offset[3];
+
+        /**
+         * サイクル数のプロファイルを要求する番号
+         * 前回受け取った値から変わったときに区間ごとのサイクル数の統計値を送信してクリアする
+         */
+        uint32_t profile_request_number;
+
         /**
          * チェックサムを計算する
          * この関数はparametersが4の倍数バイトの大きさであることを前提にしている
@@ -88,6 +159,148 @@ struct SharedMemory {
      * head_checksumとtail_checksumが等しいときにのみparametersは有効として扱われる
      */
     uint32_t tail_checksum;
+
+    /**
+     * Nios IIからJetsonへ異常が起きる直前の制御ループの入出力を伝達するフライトレコーダー
+     * 共有メモリーの空き領域に収まるように、値は換算前のレジスタの値をそのまま記録する
+     * 最初にエラーかフォルトが発生した制御周期まで記録して凍結し、エラーフラグのクリアで全ての異常が解除されると記録を再開する
+     */
+    struct FlightRecorder {
+        /**
+         * 記録の数 (制御周期ごとに1つ)
+         */
+        static constexpr int SIZE = 10;
+
+        /**
+         * 1制御周期の記録
+         */
+        struct Record {
+            /**
+             * 記録した制御周期の番号 (EventLogのtickと同じ単位)
+             */
+            uint32_t tick;
+
+            /**
+             * IMUの加速度と角速度のレジスタ値 X, Y, Z
+             */
+            int16_t accelerometer[3], gyroscope[3];
+
+            /**
+             * 車輪1～4のエンコーダのレジスタ値 (制御周期あたりのパルス数)
+             */
+            int16_t encoder[4];
+
+            /**
+             * 車輪1～4の電流の測定値のレジスタ値 d軸, q軸
+             */
+            int16_t current_d[4], current_q[4];
+
+            /**
+             * 車輪1～4のq軸電流の指令値のレジスタ値
+             */
+            int16_t current_ref[4];
+
+            /**
+             * vector_controller_master_0のSTATUSレジスタとFAULTレジスタ (ブレーキの状態を含む)
+             */
+            uint16_t status, fault;
+        };
+
+        /**
+         * 凍結したときに1、記録中は0
+         */
+        uint32_t frozen;
+
+        /**
+         * 次に書き込む記録の番号 (凍結したときは最も古い記録の番号)
+         */
+        uint32_t write_index;
+
+        /**
+         * 凍結したときのエラーフラグとフォルトフラグ
+         */
+        uint32_t error_flags, fault_flags;
+
+        /**
+         * 記録のリングバッファ
+         */
+        Record records[SIZE];
+    } flight_recorder;
+
+    /**
+     * Nios IIからJetsonへエラーとフォルトの発生と解除を発生順に伝達するイベントログ
+     * Nios IIはイベントを追記してからwrite_countを1増やし、古いイベントから上書きする
+     * Jetsonは読み終えたwrite_countの値を読み出し位置として保持し、write_countが進んだ分だけを読み出す
+     * 読み出しの前後でwrite_countを読み、後で読んだwrite_countからSIZE以上古いイベントは上書きされたものとして扱う
+     */
+    struct EventLog {
+        /**
+         * イベントの数
+         */
+        static constexpr int SIZE = 9;
+
+        /**
+         * エラーフラグが新たにセットされた
+         */
+        static constexpr uint16_t KIND_ERROR = 0;
+
+        /**
+         * フォルトフラグが新たにセットされた
+         */
+        static constexpr uint16_t KIND_FAULT = 1;
+
+        /**
+         * エラーフラグのクリアでエラーフラグが解除された
+         */
+        static constexpr uint16_t KIND_CLEAR = 2;
+
+        /**
+         * 1つのイベント
+         */
+        struct Event {
+            /**
+             * イベントが発生した制御周期の番号 (tickと同じ単位)
+             */
+            uint32_t tick;
+
+            /**
+             * 新たにセットされたか解除されたエラーフラグかフォルトフラグのビット
+             */
+            uint32_t cause;
+
+            /**
+             * pio_1のDATAレジスタの値
+             */
+            uint32_t pio_1;
+
+            /**
+             * vector_controller_master_0のSTATUSレジスタの値
+             */
+            uint16_t status;
+
+            /**
+             * イベントの種類 (KIND_ERROR, KIND_FAULT, KIND_CLEAR)
+             */
+            uint16_t kind;
+        };
+
+        /**
+         * 起動してからの制御周期の数
+         */
+        uint32_t tick;
+
+        /**
+         * 起動してから追記したイベントの数 (events[write_count % SIZE]に次のイベントを書き込む)
+         */
+        uint32_t write_count;
+
+        /**
+         * イベントのリングバッファ
+         */
+        Event events[SIZE];
+    } event_log;
 };
 
+static_assert(sizeof(SharedMemory) <= 1024, "SharedMemory must fit in 1024 bytes");
+
 #pragma pack(pop)
@@ -12,7 +12,12 @@
 enum StreamId {
     StreamIdStatus = 1,
     StreamIdAdc2 = 2,
-    StreamIdMotion = 3
+    StreamIdMotion = 3,
+    StreamIdEstimator = 4,
+    StreamIdTraction = 5,
+    StreamIdPose = 6,
+    StreamIdProfile = 7,
+    StreamIdLoopTiming = 8
 };
 
 struct StreamDataStatus {
@@ -38,4 +43,47 @@ struct StreamDataMotion {
     __fp16 wheel_current_ref[4];
     __fp16 body_ref_accel[4];
     uint16_t performance_counter;
+    uint16_t performance_counter_velocity_filter;
+    uint16_t performance_counter_velocity_filter_covariance;
+    uint16_t velocity_filter_decimation;
+};
+
+struct StreamDataEstimator {
+    __fp16 nis_mean[7];
+    __fp16 covariance_trace;
+    __fp16 min_pivot;
+    uint16_t update_count;
+    uint16_t kf_clamp_min_count;
+    uint16_t kf_clamp_max_count;
+};
+
+struct StreamDataTraction {
+    __fp16 friction_coefficient[4];
+    __fp16 max_slip_velocity[4];
+    __fp16 min_current_limit[4];
+    uint16_t slip_state;
+};
+
+struct StreamDataPose {
+    float pose[3];
+    uint32_t reset_number;
+};
+
+struct StreamDataProfile {
+    uint32_t count[7];
+    uint32_t min_cycles[7];
+    uint32_t mean_cycles[7];
+    uint32_t max_cycles[7];
+    uint16_t histogram[7][12];
+};
+
+struct StreamDataLoopTiming {
+    uint32_t count;
+    uint32_t min_period;
+    uint32_t mean_period;
+    uint32_t max_period;
+    uint32_t latency_jitter;
+    uint32_t min_slack;
+    uint32_t max_busy;
+    uint32_t overrun_count;
 };
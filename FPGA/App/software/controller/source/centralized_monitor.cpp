@@ -12,6 +12,7 @@
 #include <driver/led.hpp>
 #include <peripheral/motor_controller.hpp>
 #include <peripheral/vector_controller.hpp>
+#include <peripheral/performance_counter.hpp>
 #include <sys/unistd.h>
 #include <system.h>
 #include <altera_avalon_pio_regs.h>
@@ -24,6 +25,12 @@
 #include "shared_memory_manager.hpp"
 #include "stream_transmitter.hpp"
 #include "data_holder.hpp"
+#include "cycle_profiler.hpp"
+#include "loop_timing_monitor.hpp"
+#include "flight_recorder.hpp"
+#include "event_log.hpp"
+#include "board.hpp"
+#include <driver/imu.hpp>
 
 #define DEBUG_PRINTF 0
 #if DEBUG_PRINTF
@@ -34,7 +41,7 @@
 /// ADC2のタイムアウトカウンタの初期値
 static constexpr int ADC2_TIMEOUT_THRESHOLD = 50;
 
-/// 指令値が更新されなくなってから自動停止するまでの時間
+/// 指令値が更新されなくなってから自動停止するまでの時間 [IMU_OUTPUT_RATEの周期]
 static constexpr int PARAMETER_TIMEOUT = 500;
 
 /// DC48Vの下限電圧[mV]
@@ -43,6 +50,68 @@ static constexpr float DC48V_UNDER_VOLTAGE_THRESHOLD = 40.0f;
 /// DC48Vの上限電圧[mV]
 static constexpr float DC48V_OVER_VOLTAGE_THRESHOLD = 52.5f;
 
+/// 速度フィルタの統計値を送信する間隔 [回]
+static constexpr int ESTIMATOR_STATISTICS_PERIOD = 100;
+
+/// トラクションリミッタの統計値を送信する間隔 [回]
+static constexpr int TRACTION_STATISTICS_PERIOD = 10;
+
+/// 制御ループの周期の揺らぎの統計値を送信する間隔 [回]
+static constexpr int LOOP_TIMING_STATISTICS_PERIOD = 1000;
+
+/// 制御ループの周期の揺らぎを測る
+static LoopTimingMonitor LoopTiming;
+
+/// 割り込みハンドラからバックグラウンドの処理に渡すデータ
+struct BackgroundWork_t {
+    MotionData_t motion_data;
+    ControlData_t control_data;
+    int performance_counter;
+    int performance_counter_velocity_filter;
+    int performance_counter_velocity_filter_covariance;
+    int velocity_filter_decimation;
+    Eigen::Vector3f pose;
+    uint32_t pose_reset_number;
+
+    /// 前回公開してから経過したIMU_OUTPUT_RATEの周期の数
+    int elapsed_periods;
+
+    /// trueのときestimator_statisticsとcovariance_traceを送信する
+    bool estimator_ready;
+    VelocityFilter::Statistics_t estimator_statistics;
+    float covariance_trace;
+
+    /// trueのときtraction_statisticsとfriction_coefficientsを送信する
+    bool traction_ready;
+    TractionLimitter::Statistics_t traction_statistics;
+    Eigen::Vector4f friction_coefficients;
+
+    /// trueのときloop_timing_statisticsを送信する
+    bool loop_timing_ready;
+    LoopTimingMonitor::Statistics_t loop_timing_statistics;
+};
+
+/// バックグラウンドの処理に渡すデータ
+static BackgroundWork_t BackgroundWork;
+
+/// BackgroundWorkに未処理のデータがあるときtrue
+static volatile bool BackgroundPending = false;
+
+/// バックグラウンドでBackgroundWorkを処理している間true (割り込みハンドラは書き換えない)
+static volatile bool BackgroundBusy = false;
+
+/// 前回BackgroundWorkを公開してから経過したIMU_OUTPUT_RATEの周期の数
+static int BackgroundElapsedPeriods = 0;
+
+/// 最後に受け取ったサイクル数のプロファイルを要求する番号
+static uint32_t ProfileRequestNumber = 0;
+
+/// サイクル数のプロファイルが要求されて未送信のときtrue
+static volatile bool ProfileRequested = false;
+
+/// 送信するサイクル数の統計値のコピー
+static CycleProfiler::Statistics_t ProfileSnapshot[CycleProfiler::SECTIONS];
+
 void CentralizedMonitor::initialize(void) {
     // 割り込みハンドラを設定する
     alt_ic_isr_register(TIMER_0_IRQ_INTERRUPT_CONTROLLER_ID, TIMER_0_IRQ, timerHandler, nullptr, nullptr);
@@ -57,9 +126,18 @@ void CentralizedMonitor::initialize(void) {
 
     // モーター関連の割り込みフラグをリセットする
     resetMotorInterruptFlags();
+
+    // イベントログとフライトレコーダーの記録を開始する
+    EventLog::initialize();
+    FlightRecorder::initialize();
 }
 
 void CentralizedMonitor::start(void) {
+    // パフォーマンスカウンタのグローバルカウンタを動かし続け、処理の区間のサイクル数はその差で測る
+    PERF_RESET(reinterpret_cast<void *>(PERFORMANCE_COUNTER_0_BASE));
+    PERF_START_MEASURING(reinterpret_cast<void *>(PERFORMANCE_COUNTER_0_BASE));
+    LoopTiming.reset(static_cast<uint32_t>(ALT_CPU_FREQ / IMU_OUTPUT_RATE));
+
     // pio_0の割り込みを有効にする
     IOWR_ALTERA_AVALON_PIO_IRQ_MASK(PIO_0_BASE, Pio0Pulse1kHz);
     IOWR_ALTERA_AVALON_PIO_EDGE_CAP(PIO_0_BASE, 0);
@@ -128,6 +206,12 @@ void CentralizedMonitor::clearErrorFlags(void) {
     // 軽度の過電流エラーを解除する
     new_error_flags &= ~(ErrorCauseMotor5OverCurrent | ErrorCauseMotor4OverCurrent | ErrorCauseMotor3OverCurrent | ErrorCauseMotor2OverCurrent | ErrorCauseMotor1OverCurrent);
 
+    // 解除したエラーフラグをイベントログに追記する
+    uint32_t cleared_error_flags = _error_flags & ~new_error_flags;
+    if (cleared_error_flags != 0) {
+        EventLog::append(SharedMemory::EventLog::KIND_CLEAR, cleared_error_flags);
+    }
+
     // 新しいエラーフラグを格納する
     _error_flags = new_error_flags;
     SharedMemoryManager::writeErrorFlags(new_error_flags);
@@ -141,6 +225,9 @@ void CentralizedMonitor::setErrorFlags(uint32_t error_flags) {
     {
         CriticalSection cs;
         new_error_flags = _error_flags | error_flags;
+        if (new_error_flags != _error_flags) {
+            EventLog::append(SharedMemory::EventLog::KIND_ERROR, new_error_flags & ~_error_flags);
+        }
         _error_flags = new_error_flags;
         SharedMemoryManager::writeErrorFlags(new_error_flags);
     }
@@ -150,6 +237,7 @@ void CentralizedMonitor::setErrorFlags(uint32_t error_flags) {
     }
 #endif
     if (new_error_flags != 0) {
+        FlightRecorder::freeze(new_error_flags, _fault_flags);
         WheelController::stopControl();
         DribbleController::stopControl();
     }
@@ -163,6 +251,9 @@ void CentralizedMonitor::setFaultFlags(uint32_t fault_flags) {
     {
         CriticalSection cs;
         new_fault_flags = _fault_flags | fault_flags;
+        if (new_fault_flags != _fault_flags) {
+            EventLog::append(SharedMemory::EventLog::KIND_FAULT, new_fault_flags & ~_fault_flags);
+        }
         _fault_flags = new_fault_flags;
         SharedMemoryManager::writeFaultFlags(new_fault_flags);
     }
@@ -172,6 +263,7 @@ void CentralizedMonitor::setFaultFlags(uint32_t fault_flags) {
     }
 #endif
     if (new_fault_flags != 0) {
+        FlightRecorder::freeze(_error_flags, new_fault_flags);
         WheelController::stopControl();
         DribbleController::stopControl();
     }
@@ -180,20 +272,30 @@ void CentralizedMonitor::setFaultFlags(uint32_t fault_flags) {
 void CentralizedMonitor::doPeriodicCommonWork(void) {
     // パフォーマンスカウンタの測定を開始する
     static int performance_counter = 0;
-    PERF_RESET(reinterpret_cast<void *>(PERFORMANCE_COUNTER_0_BASE));
-    PERF_START_MEASURING(reinterpret_cast<void *>(PERFORMANCE_COUNTER_0_BASE));
-    PERF_BEGIN(reinterpret_cast<void *>(PERFORMANCE_COUNTER_0_BASE), 1);
+    uint32_t control_loop_start = PerformanceCounter::getGlobalCycles();
+
+    // イベントログの制御周期の番号を進める
+    EventLog::advanceTick();
 
     // センサーデータを読み出す
     DataHolder::fetchOnPreControlLoop();
+    CycleProfiler::record(CycleProfiler::SectionFetch, PerformanceCounter::getGlobalCycles() - control_loop_start);
 
-    // ADC2のタイムアウトカウンタを減算しすでに0だったらフォルトを発生する
-    int adc2_timeout = _adc2_timeout;
-    if (0 <= --adc2_timeout) {
-        _adc2_timeout = adc2_timeout;
+    // 制御周波数がIMU_OUTPUT_RATEより高いときも、タイムアウトや送信などの時間で決まる処理はIMU_OUTPUT_RATEの周期で行う
+    bool base_period = (_control_rate_multiplier <= ++_base_period_count);
+    if (base_period) {
+        _base_period_count = 0;
     }
-    else {
-        setFaultFlags(FaultCauseAdc2Timeout);
+
+    // ADC2のタイムアウトカウンタを減算しすでに0だったらフォルトを発生する
+    if (base_period) {
+        int adc2_timeout = _adc2_timeout;
+        if (0 <= --adc2_timeout) {
+            _adc2_timeout = adc2_timeout;
+        }
+        else {
+            setFaultFlags(FaultCauseAdc2Timeout);
+        }
     }
 
     if (isAnyProblemOccured() == false) {
@@ -201,8 +303,21 @@ void CentralizedMonitor::doPeriodicCommonWork(void) {
         bool new_parameters = SharedMemoryManager::updateParameters();
         if (new_parameters) {
             _parameter_timeout = PARAMETER_TIMEOUT;
+
+            // 制御周波数が変わったときは車輪の制御をやり直す
+            // 停止した状態で新しいParametersを受け取るので、直後のWheelController::update()で制御が再開される
+            if (changeControlRate(SharedMemoryManager::getParameters().control_rate)) {
+                WheelController::stopControl();
+            }
+
+            // サイクル数のプロファイルが要求されたらdoBackgroundWork()で送信する
+            uint32_t profile_request_number = SharedMemoryManager::getParameters().profile_request_number;
+            if (profile_request_number != ProfileRequestNumber) {
+                ProfileRequestNumber = profile_request_number;
+                ProfileRequested = true;
+            }
         }
-        else if (0 < _parameter_timeout) {
+        else if (base_period && (0 < _parameter_timeout)) {
             _parameter_timeout--;
         }
         bool stop_motors = _parameter_timeout <= 0;
@@ -224,22 +339,145 @@ void CentralizedMonitor::doPeriodicCommonWork(void) {
         SharedMemoryManager::clearParameters();
 
         // 車輪モーターのセンサーデータ等を更新する
+        // エラーフラグのクリアはdoBackgroundWork()で行う
         WheelController::update(false, true);
 
-        // Jetsonからエラーフラグのクリアが指示されていればクリアを試みる
-        if (SharedMemoryManager::isRequestedClearingErrorFlags() == true) {
+        _parameter_timeout = 0;
+    }
+
+    // 制御データを読み出す
+    DataHolder::fetchOnPostControlLoop();
+
+    // レジスタに書き込んだ指令値とセンサーの値をフライトレコーダーに記録する
+    FlightRecorder::record();
+    if (base_period) {
+        publishBackgroundWork(performance_counter);
+    }
+
+    // 処理全体のサイクル数を記録する
+    // 測定値は次のpublishBackgroundWork()で公開する
+    uint32_t control_loop_cycles = PerformanceCounter::getGlobalCycles() - control_loop_start;
+    CycleProfiler::record(CycleProfiler::SectionControlLoop, control_loop_cycles);
+    performance_counter = (control_loop_cycles & 0xFFFF0000UL) ? 65535 : static_cast<int>(control_loop_cycles);
+}
+
+void CentralizedMonitor::publishBackgroundWork(int performance_counter) {
+    // 統計値を送る間隔を数える
+    // バックグラウンドの処理が遅れて公開できなかった周期の分も数え、次に公開できたときに送る
+    static int estimator_statistics_count = 0;
+    static int traction_statistics_count = 0;
+    static int loop_timing_statistics_count = 0;
+    if (estimator_statistics_count < ESTIMATOR_STATISTICS_PERIOD) {
+        estimator_statistics_count++;
+    }
+    if (traction_statistics_count < TRACTION_STATISTICS_PERIOD) {
+        traction_statistics_count++;
+    }
+    if (loop_timing_statistics_count < LOOP_TIMING_STATISTICS_PERIOD) {
+        loop_timing_statistics_count++;
+    }
+    BackgroundElapsedPeriods++;
+
+    // 前回の内容をバックグラウンドで処理している最中は書き換えない
+    if (BackgroundBusy) {
+        return;
+    }
+
+    // 前回公開したデータが未処理のまま上書きするときは、経過した周期の数と送っていない統計値を引き継ぐ
+    BackgroundWork_t &work = BackgroundWork;
+    if (!BackgroundPending) {
+        work.elapsed_periods = 0;
+        work.estimator_ready = false;
+        work.traction_ready = false;
+        work.loop_timing_ready = false;
+    }
+
+    // 送信するデータを複製する
+    // 速度フィルタのサイクル数は更新の方法ごとの負荷を比較するために送る
+    // 共分散を間引いて更新するときは、共分散を更新した回のサイクル数と間引きの間隔も送る
+    auto saturate = [](uint32_t cycles) {
+        return (cycles & 0xFFFF0000UL) ? 65535 : static_cast<int>(cycles);
+    };
+    work.motion_data = DataHolder::motionData();
+    work.control_data = DataHolder::controlData();
+    work.performance_counter = performance_counter;
+    work.performance_counter_velocity_filter = saturate(WheelController::velocityFilterCycles());
+    work.performance_counter_velocity_filter_covariance = saturate(WheelController::velocityFilterCovarianceCycles());
+    work.velocity_filter_decimation = WheelController::velocityFilter().covarianceDecimation();
+    work.pose = WheelController::pose();
+    work.pose_reset_number = WheelController::poseResetNumber();
+    work.elapsed_periods += BackgroundElapsedPeriods;
+    BackgroundElapsedPeriods = 0;
+
+    // 速度フィルタの統計値は間引いて送信する
+    if (ESTIMATOR_STATISTICS_PERIOD <= estimator_statistics_count) {
+        estimator_statistics_count = 0;
+        work.estimator_statistics = WheelController::velocityFilter().statistics();
+        work.covariance_trace = WheelController::velocityFilter().covarianceTrace();
+        work.estimator_ready = true;
+        WheelController::clearVelocityFilterStatistics();
+    }
+
+    // スリップの状態は統計値として間引いて送信する
+    if (TRACTION_STATISTICS_PERIOD <= traction_statistics_count) {
+        traction_statistics_count = 0;
+        work.traction_statistics = WheelController::tractionLimitter().statistics();
+        work.friction_coefficients = WheelController::velocityFilter().frictionCoefficients();
+        work.traction_ready = true;
+        WheelController::clearTractionStatistics();
+    }
+
+    // 制御ループの周期の揺らぎは統計値として間引いて送信する
+    if (LOOP_TIMING_STATISTICS_PERIOD <= loop_timing_statistics_count) {
+        loop_timing_statistics_count = 0;
+        work.loop_timing_statistics = LoopTiming.statistics();
+        work.loop_timing_ready = true;
+        LoopTiming.clearStatistics();
+    }
+    BackgroundPending = true;
+}
+
+void CentralizedMonitor::doBackgroundWork(void) {
+    // Jetsonからエラーフラグのクリアが指示されていればクリアを試みる
+    if (isAnyProblemOccured() && SharedMemoryManager::isRequestedClearingErrorFlags()) {
 #if DEBUG_PRINTF
-            alt_putstr("Flag cleared\n");
+        alt_putstr("Flag cleared\n");
 #endif
-            clearErrorFlags();
-        }
+        clearErrorFlags();
 
-        _parameter_timeout = 0;
+        // 全ての問題が解消されていればフライトレコーダーの記録を再開する
+        if (!isAnyProblemOccured()) {
+            FlightRecorder::rearm();
+        }
     }
 
-    // 制御データを読み出してJetsonへデータを送信する
-    DataHolder::fetchOnPostControlLoop();
-    StreamTransmitter::transmitMotion(DataHolder::motionData(), DataHolder::controlData(), performance_counter);
+    // 割り込みハンドラが公開したデータを受け取る
+    // 処理している間は割り込みハンドラが書き換えないようにBackgroundBusyを立てる
+    {
+        CriticalSection cs;
+        if (!BackgroundPending) {
+            return;
+        }
+        BackgroundPending = false;
+        BackgroundBusy = true;
+    }
+    uint32_t telemetry_start = PerformanceCounter::getGlobalCycles();
+    const BackgroundWork_t &work = BackgroundWork;
+    int elapsed_periods = work.elapsed_periods;
+
+    // Jetsonへデータを送信する
+    StreamTransmitter::transmitMotion(work.motion_data, work.control_data, work.performance_counter, work.performance_counter_velocity_filter,
+                                      work.performance_counter_velocity_filter_covariance, work.velocity_filter_decimation);
+    StreamTransmitter::transmitPose(work.pose, work.pose_reset_number);
+    if (work.estimator_ready) {
+        StreamTransmitter::transmitEstimator(work.estimator_statistics, work.covariance_trace);
+    }
+    if (work.traction_ready) {
+        StreamTransmitter::transmitTraction(work.traction_statistics, work.friction_coefficients);
+    }
+    if (work.loop_timing_ready) {
+        StreamTransmitter::transmitLoopTiming(work.loop_timing_statistics);
+    }
 
     // Lチカ
     // 全般的な異常がある -> 全てのLEDを点滅
@@ -247,11 +485,13 @@ void CentralizedMonitor::doPeriodicCommonWork(void) {
     // モーター制御をしていない -> 異常が無ければ全てのLEDを消灯
     // モーター制御をしている -> LEDを点灯
     static int cnt = 0;
+    int previous_cnt = cnt;
+    cnt += elapsed_periods;
     uint32_t error_flags = _error_flags;
     uint32_t fault_flags = _fault_flags;
     bool general_fault =
         (error_flags & (ErrorCauseDc48vUnderVoltage | ErrorCauseDc48vOverVoltage)) || (fault_flags & (FaultCauseAdc2Timeout | FaultCauseImuTimeout));
-    if (++cnt == 50) {
+    if ((previous_cnt < 50) && (50 <= cnt)) {
         if (general_fault) {
             Led::setAllOff();
         }
@@ -283,15 +523,56 @@ void CentralizedMonitor::doPeriodicCommonWork(void) {
         }
     }
 
-    // パフォーマンスカウンタのセクション1の測定を終了する
-    // 測定値は次の処理の始めに送信される
-    PERF_END(reinterpret_cast<void *>(PERFORMANCE_COUNTER_0_BASE), 1);
-    PERF_STOP_MEASURING(reinterpret_cast<void *>(PERFORMANCE_COUNTER_0_BASE));
-    uint64_t counter_64 = perf_get_section_time(reinterpret_cast<void *>(PERFORMANCE_COUNTER_0_BASE), 1);
-    performance_counter = (counter_64 & 0xFFFFFFFFFFFF0000ULL) ? 65535 : static_cast<int>(counter_64);
-
     // ステータスフラグを送信する
     StreamTransmitter::transmitStatus();
+    CycleProfiler::record(CycleProfiler::SectionTelemetry, PerformanceCounter::getGlobalCycles() - telemetry_start);
+
+    // 要求されたときは区間ごとのサイクル数の統計値を送信してクリアする
+    // 割り込みを禁止するのはコピーとクリアの間だけにして、送信データへの格納と送信は割り込みを許可してから行う
+    if (ProfileRequested) {
+        {
+            CriticalSection cs;
+            CycleProfiler::snapshotAndClear(ProfileSnapshot);
+            ProfileRequested = false;
+        }
+        StreamTransmitter::transmitProfile(ProfileSnapshot);
+    }
+
+    {
+        CriticalSection cs;
+        BackgroundBusy = false;
+    }
+}
+
+bool CentralizedMonitor::changeControlRate(uint32_t control_rate) {
+    int multiplier;
+    Imu::OutputDataRate_t odr;
+    switch (control_rate) {
+    case 0:
+    case 1000:
+        multiplier = 1;
+        odr = Imu::OutputDataRate1kHz;
+        break;
+    case 2000:
+        multiplier = 2;
+        odr = Imu::OutputDataRate2kHz;
+        break;
+    case 4000:
+        multiplier = 4;
+        odr = Imu::OutputDataRate4kHz;
+        break;
+    default:
+        return false;
+    }
+    if (multiplier == _control_rate_multiplier) {
+        return false;
+    }
+    Imu::setOutputDataRate(odr);
+    _control_rate_multiplier = multiplier;
+    _control_period = 1.0f / (IMU_OUTPUT_RATE * multiplier);
+    LoopTiming.reset(static_cast<uint32_t>(ALT_CPU_FREQ / (IMU_OUTPUT_RATE * multiplier)));
+    _base_period_count = 0;
+    return true;
 }
 
 void CentralizedMonitor::timerHandler(void *context) {
@@ -310,6 +591,9 @@ void CentralizedMonitor::timerHandler(void *context) {
 }
 
 void CentralizedMonitor::pio0Handler(void *context) {
+    // 入口の時刻を記録する
+    LoopTiming.enter(PerformanceCounter::getGlobalCycles());
+
     // pio_0のエッジ検知フラグをクリア
     IOWR_ALTERA_AVALON_PIO_EDGE_CAP(PIO_0_BASE, 0);
 
@@ -321,6 +605,9 @@ void CentralizedMonitor::pio0Handler(void *context) {
 
     // 定期的な処理を行う
     doPeriodicCommonWork();
+
+    // 出口の時刻を記録する
+    LoopTiming.exit(PerformanceCounter::getGlobalCycles());
 }
 
 void CentralizedMonitor::pio1Handler(void *context) {
@@ -402,3 +689,6 @@ volatile uint32_t CentralizedMonitor::_error_flags = 0;
 volatile uint32_t CentralizedMonitor::_fault_flags = 0;
 int CentralizedMonitor::_adc2_timeout = ADC2_TIMEOUT_THRESHOLD;
 int CentralizedMonitor::_parameter_timeout = 0;
+int CentralizedMonitor::_control_rate_multiplier = 1;
+float CentralizedMonitor::_control_period = 1.0f / IMU_OUTPUT_RATE;
+int CentralizedMonitor::_base_period_count = 0;
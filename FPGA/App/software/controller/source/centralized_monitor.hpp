@@ -48,6 +48,28 @@ public:
         return (_error_flags != 0) || (_fault_flags != 0);
     }
 
+    /**
+     * 制御周期を取得する
+     * @return 制御周期 [s]
+     */
+    static float controlPeriod(void) {
+        return _control_period;
+    }
+
+    /**
+     * IMU_OUTPUT_RATEに対する制御周波数の倍率を取得する
+     * @return 倍率 (1, 2, 4)
+     */
+    static int controlRateMultiplier(void) {
+        return _control_rate_multiplier;
+    }
+
+    /**
+     * 割り込みハンドラの外で行う処理を行う
+     * main()のループから繰り返し呼び、publishBackgroundWork()が公開したデータの送信、Lチカ、エラーフラグのクリアを行う
+     */
+    static void doBackgroundWork(void);
+
     /**
      * ADC2の測定完了時にAdc2::handler()から呼ばれるコールバック
      */
@@ -76,6 +98,13 @@ private:
      */
     static void doPeriodicCommonWork(void);
 
+    /**
+     * IMU_OUTPUT_RATEの周期でdoBackgroundWork()が送信するデータを複製して公開する
+     * doBackgroundWork()が前回のデータを処理している最中は公開せず、次の周期に回す
+     * @param performance_counter 前回のdoPeriodicCommonWork()の処理に要したサイクル数
+     */
+    static void publishBackgroundWork(int performance_counter);
+
     /**
      * timer_0の割り込みハンドラ
      * IMUからの割り込み信号が2ms以内に来なかったときに停止処理を行う
@@ -115,6 +144,14 @@ private:
      */
     static void resetMotorInterruptFlags(void);
 
+    /**
+     * 制御周波数を変更する
+     * IMUの出力データレートを切り替えるので、IMUのデータを読み出した直後に呼ぶこと
+     * @param control_rate 制御周波数 [Hz] (0のときはIMU_OUTPUT_RATE)
+     * @return 制御周波数が変わったときはtrue
+     */
+    static bool changeControlRate(uint32_t control_rate);
+
     /// エラーフラグのビットマップ
     static volatile uint32_t _error_flags;
 
@@ -126,4 +163,13 @@ private:
 
     /// 指令値のタイムアウトカウンタ
     static int _parameter_timeout;
+
+    /// IMU_OUTPUT_RATEに対する制御周波数の倍率
+    static int _control_rate_multiplier;
+
+    /// 制御周期 [s]
+    static float _control_period;
+
+    /// IMU_OUTPUT_RATEの周期で行う処理のための制御周期のカウンタ
+    static int _base_period_count;
 };
@@ -0,0 +1,55 @@
+/**
+ * @file cycle_profiler.cpp
+ * @author Fujii Naomichi
+ * @copyright (c) 2021 Fujii Naomichi
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "cycle_profiler.hpp"
+
+void CycleProfiler::record(Section_t section, uint32_t cycles) {
+    Statistics_t &statistics = _statistics[section];
+    if (statistics.count == 0xFFFFFFFFUL) {
+        return;
+    }
+    if ((statistics.count == 0) || (cycles < statistics.min_cycles)) {
+        statistics.min_cycles = cycles;
+    }
+    if (statistics.max_cycles < cycles) {
+        statistics.max_cycles = cycles;
+    }
+    statistics.count++;
+    statistics.sum_cycles += cycles;
+
+    // cyclesの最上位ビットの位置からヒストグラムの区間を求める
+    int index = 0;
+    if (cycles != 0) {
+        index = (32 - __builtin_clz(cycles)) - HISTOGRAM_MIN_LOG2;
+        index = (index < 0) ? 0 : ((HISTOGRAM_SIZE <= index) ? (HISTOGRAM_SIZE - 1) : index);
+    }
+    if (statistics.histogram[index] != 0xFFFF) {
+        statistics.histogram[index]++;
+    }
+}
+
+void CycleProfiler::clear(void) {
+    for (int section = 0; section < SECTIONS; section++) {
+        Statistics_t &statistics = _statistics[section];
+        statistics.count = 0;
+        statistics.min_cycles = 0;
+        statistics.max_cycles = 0;
+        statistics.sum_cycles = 0;
+        for (int index = 0; index < HISTOGRAM_SIZE; index++) {
+            statistics.histogram[index] = 0;
+        }
+    }
+}
+
+void CycleProfiler::snapshotAndClear(Statistics_t (&snapshot)[SECTIONS]) {
+    for (int section = 0; section < SECTIONS; section++) {
+        snapshot[section] = _statistics[section];
+    }
+    clear();
+}
+
+CycleProfiler::Statistics_t CycleProfiler::_statistics[SECTIONS];
@@ -0,0 +1,100 @@
+/**
+ * @file cycle_profiler.hpp
+ * @author Fujii Naomichi
+ * @copyright (c) 2021 Fujii Naomichi
+ * SPDX-License-Identifier: MIT
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * @brief 処理の区間ごとのサイクル数の最小値、平均値、最大値とヒストグラムを記録する
+ * サイクル数はPerformanceCounter::getGlobalCycles()の差で測り、ヒストグラムは2のべき乗ごとの区間で数える
+ */
+class CycleProfiler {
+public:
+    /// 測定する区間
+    enum Section_t {
+        /// 割り込みハンドラの処理全体
+        SectionControlLoop = 0,
+
+        /// DataHolder::fetchOnPreControlLoop()
+        SectionFetch,
+
+        /// GravityFilter::update()
+        SectionGravityFilter,
+
+        /// VelocityFilter::update()
+        SectionVelocityFilter,
+
+        /// AccelerationLimitter::compute()
+        SectionAccelerationLimitter,
+
+        /// 電流指令値とブレーキのレジスタへの書き込み
+        SectionRegisterWrite,
+
+        /// CentralizedMonitor::doBackgroundWork()での送信データの格納 (割り込みに中断された時間を含む)
+        SectionTelemetry,
+
+        /// 区間の数
+        SECTIONS
+    };
+
+    /// ヒストグラムの区間の数
+    static constexpr int HISTOGRAM_SIZE = 12;
+
+    /// ヒストグラムの最初の区間の上限のサイクル数の2を底とする対数 (最初の区間は256サイクル未満、最後の区間は2^18サイクル以上)
+    static constexpr int HISTOGRAM_MIN_LOG2 = 8;
+
+    /// 区間ごとの統計値
+    struct Statistics_t {
+        /// 記録した回数
+        uint32_t count;
+
+        /// サイクル数の最小値
+        uint32_t min_cycles;
+
+        /// サイクル数の最大値
+        uint32_t max_cycles;
+
+        /// サイクル数の合計
+        uint64_t sum_cycles;
+
+        /// サイクル数のヒストグラム
+        uint16_t histogram[HISTOGRAM_SIZE];
+    };
+
+    /**
+     * @brief 区間のサイクル数を記録する
+     * @param section 区間
+     * @param cycles サイクル数
+     */
+    static void record(Section_t section, uint32_t cycles);
+
+    /**
+     * @brief 区間の統計値を取得する
+     * @param section 区間
+     * @return 統計値
+     */
+    static const Statistics_t& statistics(Section_t section) {
+        return _statistics[section];
+    }
+
+    /**
+     * @brief 全ての区間の統計値をクリアする
+     */
+    static void clear(void);
+
+    /**
+     * @brief 全ての区間の統計値をコピーしてからクリアする
+     * 割り込みハンドラが記録している途中の値をコピーしないように、割り込みを禁止して呼び出す
+     * @param snapshot コピー先
+     */
+    static void snapshotAndClear(Statistics_t (&snapshot)[SECTIONS]);
+
+private:
+    /// 区間ごとの統計値
+    static Statistics_t _statistics[SECTIONS];
+};
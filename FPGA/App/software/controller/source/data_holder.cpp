@@ -12,19 +12,22 @@
 #include <peripheral/vector_controller.hpp>
 #include <peripheral/motor_controller.hpp>
 #include "wheel_controller.hpp"
+#include "centralized_monitor.hpp"
 
 void DataHolder::fetchOnPreControlLoop(void) {
+    // エンコーダの値は制御周期あたりのパルス数なので制御周波数の倍率も掛けて速度に換算する
     static constexpr float ENCODER_SCALE = IMU_OUTPUT_RATE / ENCODER_PPR * 2 * PI * WHEEL_RADIUS;
+    float encoder_scale = ENCODER_SCALE * CentralizedMonitor::controlRateMultiplier();
     _motion_data.accelerometer.x() = IMU_SPIM_GetAccelDataX(IMU_SPIM_BASE) * IMU_ACCELEROMETER_SCALE;
     _motion_data.accelerometer.y() = IMU_SPIM_GetAccelDataY(IMU_SPIM_BASE) * IMU_ACCELEROMETER_SCALE;
     _motion_data.accelerometer.z() = IMU_SPIM_GetAccelDataZ(IMU_SPIM_BASE) * IMU_ACCELEROMETER_SCALE;
     _motion_data.gyroscope.x() = IMU_SPIM_GetGyroDataX(IMU_SPIM_BASE) * IMU_GYROSCOPE_SCALE;
     _motion_data.gyroscope.y() = IMU_SPIM_GetGyroDataY(IMU_SPIM_BASE) * IMU_GYROSCOPE_SCALE;
     _motion_data.gyroscope.z() = IMU_SPIM_GetGyroDataZ(IMU_SPIM_BASE) * IMU_GYROSCOPE_SCALE;
-    _motion_data.wheel_velocity(0) = VectorController::getEncoderValue(1) * ENCODER_SCALE;
-    _motion_data.wheel_velocity(1) = VectorController::getEncoderValue(2) * ENCODER_SCALE;
-    _motion_data.wheel_velocity(2) = VectorController::getEncoderValue(3) * ENCODER_SCALE;
-    _motion_data.wheel_velocity(3) = VectorController::getEncoderValue(4) * ENCODER_SCALE;
+    _motion_data.wheel_velocity(0) = VectorController::getEncoderValue(1) * encoder_scale;
+    _motion_data.wheel_velocity(1) = VectorController::getEncoderValue(2) * encoder_scale;
+    _motion_data.wheel_velocity(2) = VectorController::getEncoderValue(3) * encoder_scale;
+    _motion_data.wheel_velocity(3) = VectorController::getEncoderValue(4) * encoder_scale;
     _motion_data.wheel_current_d(0) = VectorController::getCurrentMeasurementD(1) * ADC1_CURRENT_SCALE;
     _motion_data.wheel_current_d(1) = VectorController::getCurrentMeasurementD(2) * ADC1_CURRENT_SCALE;
     _motion_data.wheel_current_d(2) = VectorController::getCurrentMeasurementD(3) * ADC1_CURRENT_SCALE;
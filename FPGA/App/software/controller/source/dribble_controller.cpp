@@ -60,17 +60,18 @@ void DribbleController::update(bool new_parameters, bool brake_enabled) {
 
         // 回転速度が急激に変化しないように変化率を制限する
         float prev_power = MotorController::getPower() * (1.0f / MotorController::FULL_SCALE_OF_POWER);
-        static constexpr float ACCELERATION_RAMP_RATE_LIMIT_PER_PERIOD = ACCELERATION_RAMP_RATE_LIMIT / IMU_OUTPUT_RATE / 48.0f;
-        static constexpr float DECELERATION_RAMP_RATE_LIMIT_PER_PERIOD = DECELERATION_RAMP_RATE_LIMIT / IMU_OUTPUT_RATE / 48.0f;
+        float period = CentralizedMonitor::controlPeriod();
+        float acceleration_ramp_rate_limit_per_period = (ACCELERATION_RAMP_RATE_LIMIT / 48.0f) * period;
+        float deceleration_ramp_rate_limit_per_period = (DECELERATION_RAMP_RATE_LIMIT / 48.0f) * period;
         static constexpr float MAX_POWER = static_cast<float>(MotorController::MAXIMUM_POWER) / MotorController::FULL_SCALE_OF_POWER;
         float upper_limit, lower_limit;
         if (0.0f <= prev_power) {
-            upper_limit = fpu::min(prev_power + ACCELERATION_RAMP_RATE_LIMIT_PER_PERIOD, MAX_POWER);
-            lower_limit = fpu::max(prev_power - DECELERATION_RAMP_RATE_LIMIT_PER_PERIOD, -MAX_POWER);
+            upper_limit = fpu::min(prev_power + acceleration_ramp_rate_limit_per_period, MAX_POWER);
+            lower_limit = fpu::max(prev_power - deceleration_ramp_rate_limit_per_period, -MAX_POWER);
         }
         else {
-            upper_limit = fpu::min(prev_power + DECELERATION_RAMP_RATE_LIMIT_PER_PERIOD, MAX_POWER);
-            lower_limit = fpu::max(prev_power - ACCELERATION_RAMP_RATE_LIMIT_PER_PERIOD, -MAX_POWER);
+            upper_limit = fpu::min(prev_power + deceleration_ramp_rate_limit_per_period, MAX_POWER);
+            lower_limit = fpu::max(prev_power - acceleration_ramp_rate_limit_per_period, -MAX_POWER);
         }
         ref_power = fpu::clamp(ref_power, lower_limit, upper_limit);
         float power = ref_power * MotorController::FULL_SCALE_OF_POWER;
@@ -146,6 +146,8 @@ bool Imu::initialize(void) {
     writeRegister(ICM42688_BANK0_INTF_CONFIG1, 0x95);  // RTC_MODE <= RTC clock input is required
     writeRegister(ICM42688_BANK0_PWR_MGMT0, 0x0F);     // GYRO_MODE <= LN Mode, ACCEL_MODE <= LN Mode
     usleep(200);
+    writeRegister(ICM42688_BANK0_GYRO_CONFIG0, OutputDataRate1kHz); // GYRO_FS_SEL <= ±2000dps, GYRO_ODR <= 1kHz
+    writeRegister(ICM42688_BANK0_ACCEL_CONFIG0, OutputDataRate1kHz); // ACCEL_FS_SEL <= ±16g, ACCEL_ODR <= 1kHz
     writeRegister(ICM42688_BANK0_GYRO_CONFIG1, 0xF6);  // TEMP_FILT_BW <= (DLPF BW = 5Hz; DLPF Latency = 32ms), GYRO_UI_FILT_ORD = 1 (2nd Order)
     writeRegister(ICM42688_BANK0_GYRO_ACCEL_CONFIG0, 0x77); // ACCEL_UI_FILT_BW <= 7 (Fc = 21.3Hz), GYRO_UI_FILT_BW <= 7 (Fc = 21.3Hz)
     writeRegister(ICM42688_BANK0_INT_CONFIG, 0x02);   // INT1_MODE <= Pulsed mode, INT1_DRIVE_CIRCUIT <= Push pull, INT1_POLARITY <= Active low
@@ -160,6 +162,16 @@ bool Imu::initialize(void) {
     return true;
 }
 
+void Imu::setOutputDataRate(OutputDataRate_t odr) {
+    // フルスケールは初期化時と同じ値のままODRだけを変更する
+    // INT1のデータレディ割り込みからFPGAが制御周期のパルスを生成するので、制御周期もこのODRに従う
+    // UIフィルタの帯域はODRに比例するので、ODRを上げると帯域も広がることに注意する
+    IMU_SPIM_SetPassthrough(IMU_SPIM_BASE, true);
+    writeRegister(ICM42688_BANK0_GYRO_CONFIG0, odr);
+    writeRegister(ICM42688_BANK0_ACCEL_CONFIG0, odr);
+    IMU_SPIM_SetPassthrough(IMU_SPIM_BASE, false);
+}
+
 void Imu::readData(ImuResult *data) {
     data->temp_data = IMU_SPIM_GetTempData(IMU_SPIM_BASE);
     data->accel_data_x = IMU_SPIM_GetAccelDataX(IMU_SPIM_BASE);
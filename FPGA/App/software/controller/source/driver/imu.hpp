@@ -21,6 +21,14 @@ struct ImuResult {
 };
 
 class Imu {
+public:
+    // 出力データレート (GYRO_CONFIG0, ACCEL_CONFIG0のODRの値)
+    enum OutputDataRate_t : uint8_t {
+        OutputDataRate4kHz = 0x04,
+        OutputDataRate2kHz = 0x05,
+        OutputDataRate1kHz = 0x06,
+    };
+
 private:
 	static constexpr uint32_t SPI_BASE = SPIM_0_BASE;
 	static constexpr uint32_t SPI_SLAVE = 0;
@@ -32,6 +40,10 @@ public:
     
     // 測定データを読み出す
 	static void readData(ImuResult *data);
+
+    // 出力データレートを変更する
+    // IMU_SPIMによる自動アクセスを一時的に止めるので、データを読み出した直後に呼ぶこと
+    static void setOutputDataRate(OutputDataRate_t odr);
     
     // 測定データが有効な値か取得する
     static bool isValid(void){
@@ -0,0 +1,46 @@
+/**
+ * @file event_log.cpp
+ * @author Fujii Naomichi
+ * @copyright (c) 2021 Fujii Naomichi
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "event_log.hpp"
+#include "shared_memory_manager.hpp"
+#include <peripheral/vector_controller.hpp>
+#include <system.h>
+#include <altera_avalon_pio_regs.h>
+
+void EventLog::initialize(void) {
+    SharedMemory::EventLog &event_log = SharedMemoryManager::getEventLog();
+    _tick = 0;
+    _write_count = 0;
+    __builtin_stwio(&event_log.tick, 0);
+    __builtin_stwio(&event_log.write_count, 0);
+}
+
+void EventLog::advanceTick(void) {
+    uint32_t tick = _tick + 1;
+    _tick = tick;
+    __builtin_stwio(&SharedMemoryManager::getEventLog().tick, tick);
+}
+
+void EventLog::append(uint16_t kind, uint32_t cause) {
+    SharedMemory::EventLog &event_log = SharedMemoryManager::getEventLog();
+
+    // イベントを書き込んでからwrite_countを進め、Jetsonが書き込み途中のイベントを読まないようにする
+    // I/O命令で書き込み、write_countをイベントより先に書き込むようにコンパイラに入れ替えさせない
+    uint32_t write_count = _write_count;
+    SharedMemory::EventLog::Event &event = event_log.events[write_count % SharedMemory::EventLog::SIZE];
+    __builtin_stwio(&event.tick, _tick);
+    __builtin_stwio(&event.cause, cause);
+    __builtin_stwio(&event.pio_1, IORD_ALTERA_AVALON_PIO_DATA(PIO_1_BASE));
+    __builtin_sthio(&event.status, VectorController::getStatusRegister());
+    __builtin_sthio(&event.kind, kind);
+    write_count++;
+    _write_count = write_count;
+    __builtin_stwio(&event_log.write_count, write_count);
+}
+
+uint32_t EventLog::_tick;
+uint32_t EventLog::_write_count;
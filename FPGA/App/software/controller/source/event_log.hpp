@@ -0,0 +1,51 @@
+/**
+ * @file event_log.hpp
+ * @author Fujii Naomichi
+ * @copyright (c) 2021 Fujii Naomichi
+ * SPDX-License-Identifier: MIT
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <shared_memory.hpp>
+
+/**
+ * @brief エラーとフォルトの発生と解除を制御周期の番号とレジスタの値とともに共有メモリーのイベントログに追記する
+ */
+class EventLog {
+public:
+    /**
+     * @brief イベントログと制御周期の番号をクリアする
+     */
+    static void initialize(void);
+
+    /**
+     * @brief 制御周期の番号を進める
+     * 制御ループの先頭で呼ぶ
+     */
+    static void advanceTick(void);
+
+    /**
+     * @brief 制御周期の番号を取得する
+     * @return 制御周期の番号
+     */
+    static uint32_t tick(void) {
+        return _tick;
+    }
+
+    /**
+     * @brief イベントを追記する
+     * 割り込みハンドラから呼ばれるのでCriticalSectionの中で呼ぶ
+     * @param kind イベントの種類 (SharedMemory::EventLog::KIND_ERROR等)
+     * @param cause 新たにセットされたか解除されたエラーフラグかフォルトフラグのビット
+     */
+    static void append(uint16_t kind, uint32_t cause);
+
+private:
+    /// 制御周期の番号
+    static uint32_t _tick;
+
+    /// 追記したイベントの数
+    static uint32_t _write_count;
+};
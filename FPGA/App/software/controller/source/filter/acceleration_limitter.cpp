@@ -7,9 +7,11 @@
 
 #include "acceleration_limitter.hpp"
 #include "const_matrix.hpp"
+#include "matrix_kernel.hpp"
 #include "fpu.hpp"
 #include "board.hpp"
 #include <math.h>
+#include <string.h>
 
 #if 0
 #include <stdio.h>
@@ -18,258 +20,393 @@
 #define DEBUG_PRINTF(...)
 #endif
 
-// 目的関数の重み
-static constexpr float WEIGHT_X = 1.0f;
-static constexpr float WEIGHT_Y = 1.0f;
-static constexpr float WEIGHT_W = 1.0f;
-static constexpr float WEIGHT_C = 4.0f;
+/**
+ * @brief 目的関数の既定の重み
+ * X, Y, ωは1、機体に加速度を生じない組み合わせC1, ...は4とする
+ */
+template<int VARIABLES>
+struct DefaultWeights {
+    constexpr DefaultWeights(void) : elem() {
+        for (int j = 0; j < VARIABLES; j++) {
+            elem[j] = (j < 3) ? 1.0f : 4.0f;
+        }
+    }
+
+    float elem[VARIABLES];
+};
+
+template<int VARIABLES>
+static constexpr DefaultWeights<VARIABLES> DEFAULT_WEIGHTS;
+
+// 目的関数の重みとして受け付ける範囲
+static constexpr float MIN_WEIGHT = 1e-3f;
+static constexpr float MAX_WEIGHT = 1e3f;
 
 // ほぼ0だと見なす閾値
 static constexpr float EPS = 1e-5f;
 static constexpr float OC_EPS = 1e-3f;
 
+// 電力の制約で実行可能と見なす超過量 [W]
+static constexpr float POWER_EPS = 1e-2f;
+
+// 電力の制約がアクティブな車輪の制約に従属していると見なすシューア補元の相対的な大きさ
+static constexpr float SINGULAR_EPS = 1e-4f;
+
 using namespace Eigen;
-using namespace ctmath;
-
-#define SOLVE4()                                                              \
-    constexpr auto T = Q.inv().round(ROUND_BIT);                              \
-    y[0] = T(0, 0) * p[0] + T(0, 1) * p[1] + T(0, 2) * p[2] + T(0, 3) * p[3]; \
-    y[1] = T(1, 0) * p[0] + T(1, 1) * p[1] + T(1, 2) * p[2] + T(1, 3) * p[3]; \
-    y[2] = T(2, 0) * p[0] + T(2, 1) * p[1] + T(2, 2) * p[2] + T(2, 3) * p[3]; \
-    y[3] = T(3, 0) * p[0] + T(3, 1) * p[1] + T(3, 2) * p[2] + T(3, 3) * p[3]
-
-#define SOLVE5(i0)                                                                              \
-    constexpr auto A = D.extractRow(i0);                                                        \
-    constexpr auto T = mergeBlocks(Q, A.t(), A).inv().round(ROUND_BIT);                         \
-    float b[1];                                                                                 \
-    b[0] = (active_set_signs & (1 << i0)) ? -current_limit(i0) : current_limit(i0);             \
-    y[0] = T(0, 0) * p[0] + T(0, 1) * p[1] + T(0, 2) * p[2] + T(0, 3) * p[3] + T(0, 4) * b[0];  \
-    y[1] = T(1, 0) * p[0] + T(1, 1) * p[1] + T(1, 2) * p[2] + T(1, 3) * p[3] + T(1, 4) * b[0];  \
-    y[2] = T(2, 0) * p[0] + T(2, 1) * p[1] + T(2, 2) * p[2] + T(2, 3) * p[3] + T(2, 4) * b[0];  \
-    y[3] = T(3, 0) * p[0] + T(3, 1) * p[1] + T(3, 2) * p[2] + T(3, 3) * p[3] + T(3, 4) * b[0];  \
-    l[i0] = T(4, 0) * p[0] + T(4, 1) * p[1] + T(4, 2) * p[2] + T(4, 3) * p[3] + T(4, 4) * b[0]; \
-    l[i0] = (active_set_signs & (1 << i0)) ? -l[i0] : l[i0]
-
-#define SOLVE6(i0, i1)                                                                                           \
-    constexpr auto A = D.extractRow(i0, i1);                                                                     \
-    constexpr auto T = mergeBlocks(Q, A.t(), A).inv().round(ROUND_BIT);                                          \
-    float b[2];                                                                                                  \
-    b[0] = (active_set_signs & (1 << i0)) ? -current_limit(i0) : current_limit(i0);                              \
-    b[1] = (active_set_signs & (1 << i1)) ? -current_limit(i1) : current_limit(i1);                              \
-    y[0] = T(0, 0) * p[0] + T(0, 1) * p[1] + T(0, 2) * p[2] + T(0, 3) * p[3] + T(0, 4) * b[0] + T(0, 5) * b[1];  \
-    y[1] = T(1, 0) * p[0] + T(1, 1) * p[1] + T(1, 2) * p[2] + T(1, 3) * p[3] + T(1, 4) * b[0] + T(1, 5) * b[1];  \
-    y[2] = T(2, 0) * p[0] + T(2, 1) * p[1] + T(2, 2) * p[2] + T(2, 3) * p[3] + T(2, 4) * b[0] + T(2, 5) * b[1];  \
-    y[3] = T(3, 0) * p[0] + T(3, 1) * p[1] + T(3, 2) * p[2] + T(3, 3) * p[3] + T(3, 4) * b[0] + T(3, 5) * b[1];  \
-    l[i0] = T(4, 0) * p[0] + T(4, 1) * p[1] + T(4, 2) * p[2] + T(4, 3) * p[3] + T(4, 4) * b[0] + T(4, 5) * b[1]; \
-    l[i1] = T(5, 0) * p[0] + T(5, 1) * p[1] + T(5, 2) * p[2] + T(5, 3) * p[3] + T(5, 4) * b[0] + T(5, 5) * b[1]; \
-    l[i0] = (active_set_signs & (1 << i0)) ? -l[i0] : l[i0];                                                     \
-    l[i1] = (active_set_signs & (1 << i1)) ? -l[i1] : l[i1]
-
-#define SOLVE7(i0, i1, i2)                                                                                                        \
-    constexpr auto A = D.extractRow(i0, i1, i2);                                                                                  \
-    constexpr auto T = mergeBlocks(Q, A.t(), A).inv().round(ROUND_BIT);                                                           \
-    float b[3];                                                                                                                   \
-    b[0] = (active_set_signs & (1 << i0)) ? -current_limit(i0) : current_limit(i0);                                               \
-    b[1] = (active_set_signs & (1 << i1)) ? -current_limit(i1) : current_limit(i1);                                               \
-    b[2] = (active_set_signs & (1 << i2)) ? -current_limit(i2) : current_limit(i2);                                               \
-    y[0] = T(0, 0) * p[0] + T(0, 1) * p[1] + T(0, 2) * p[2] + T(0, 3) * p[3] + T(0, 4) * b[0] + T(0, 5) * b[1] + T(0, 6) * b[2];  \
-    y[1] = T(1, 0) * p[0] + T(1, 1) * p[1] + T(1, 2) * p[2] + T(1, 3) * p[3] + T(1, 4) * b[0] + T(1, 5) * b[1] + T(1, 6) * b[2];  \
-    y[2] = T(2, 0) * p[0] + T(2, 1) * p[1] + T(2, 2) * p[2] + T(2, 3) * p[3] + T(2, 4) * b[0] + T(2, 5) * b[1] + T(2, 6) * b[2];  \
-    y[3] = T(3, 0) * p[0] + T(3, 1) * p[1] + T(3, 2) * p[2] + T(3, 3) * p[3] + T(3, 4) * b[0] + T(3, 5) * b[1] + T(3, 6) * b[2];  \
-    l[i0] = T(4, 0) * p[0] + T(4, 1) * p[1] + T(4, 2) * p[2] + T(4, 3) * p[3] + T(4, 4) * b[0] + T(4, 5) * b[1] + T(4, 6) * b[2]; \
-    l[i1] = T(5, 0) * p[0] + T(5, 1) * p[1] + T(5, 2) * p[2] + T(5, 3) * p[3] + T(5, 4) * b[0] + T(5, 5) * b[1] + T(5, 6) * b[2]; \
-    l[i2] = T(6, 0) * p[0] + T(6, 1) * p[1] + T(6, 2) * p[2] + T(6, 3) * p[3] + T(6, 4) * b[0] + T(6, 5) * b[1] + T(6, 6) * b[2]; \
-    l[i0] = (active_set_signs & (1 << i0)) ? -l[i0] : l[i0];                                                                      \
-    l[i1] = (active_set_signs & (1 << i1)) ? -l[i1] : l[i1];                                                                      \
-    l[i2] = (active_set_signs & (1 << i2)) ? -l[i2] : l[i2]
-
-#define SOLVE8()                                                                                                                                  \
-    constexpr auto T = mergeBlocks(Q, D.t(), D).inv().round(ROUND_BIT);                                                                           \
-    float b[4];                                                                                                                                   \
-    b[0] = (active_set_signs & 0x1) ? -current_limit(0) : current_limit(0);                                                                       \
-    b[1] = (active_set_signs & 0x2) ? -current_limit(1) : current_limit(1);                                                                       \
-    b[2] = (active_set_signs & 0x4) ? -current_limit(2) : current_limit(2);                                                                       \
-    b[3] = (active_set_signs & 0x8) ? -current_limit(3) : current_limit(3);                                                                       \
-    y[0] = T(0, 0) * p[0] + T(0, 1) * p[1] + T(0, 2) * p[2] + T(0, 3) * p[3] + T(0, 4) * b[0] + T(0, 5) * b[1] + T(0, 6) * b[2] + T(0, 7) * b[3]; \
-    y[1] = T(1, 0) * p[0] + T(1, 1) * p[1] + T(1, 2) * p[2] + T(1, 3) * p[3] + T(1, 4) * b[0] + T(1, 5) * b[1] + T(1, 6) * b[2] + T(1, 7) * b[3]; \
-    y[2] = T(2, 0) * p[0] + T(2, 1) * p[1] + T(2, 2) * p[2] + T(2, 3) * p[3] + T(2, 4) * b[0] + T(2, 5) * b[1] + T(2, 6) * b[2] + T(2, 7) * b[3]; \
-    y[3] = T(3, 0) * p[0] + T(3, 1) * p[1] + T(3, 2) * p[2] + T(3, 3) * p[3] + T(3, 4) * b[0] + T(3, 5) * b[1] + T(3, 6) * b[2] + T(3, 7) * b[3]; \
-    l[0] = T(4, 0) * p[0] + T(4, 1) * p[1] + T(4, 2) * p[2] + T(4, 3) * p[3] + T(4, 4) * b[0] + T(4, 5) * b[1] + T(4, 6) * b[2] + T(4, 7) * b[3]; \
-    l[1] = T(5, 0) * p[0] + T(5, 1) * p[1] + T(5, 2) * p[2] + T(5, 3) * p[3] + T(5, 4) * b[0] + T(5, 5) * b[1] + T(5, 6) * b[2] + T(5, 7) * b[3]; \
-    l[2] = T(6, 0) * p[0] + T(6, 1) * p[1] + T(6, 2) * p[2] + T(6, 3) * p[3] + T(6, 4) * b[0] + T(6, 5) * b[1] + T(6, 6) * b[2] + T(6, 7) * b[3]; \
-    l[3] = T(7, 0) * p[0] + T(7, 1) * p[1] + T(7, 2) * p[2] + T(7, 3) * p[3] + T(7, 4) * b[0] + T(7, 5) * b[1] + T(7, 6) * b[2] + T(7, 7) * b[3]; \
-    l[0] = (active_set_signs & 0x1) ? -l[0] : l[0];                                                                                               \
-    l[1] = (active_set_signs & 0x2) ? -l[1] : l[1];                                                                                               \
-    l[2] = (active_set_signs & 0x4) ? -l[2] : l[2];                                                                                               \
-    l[3] = (active_set_signs & 0x8) ? -l[3] : l[3]
+
+/**
+ * @brief 車輪の配置
+ * 車輪の数ごとに特殊化して各車輪の位置 (x, y) [m] を与える
+ */
+template<int WHEELS>
+struct WheelLayout;
+
+/**
+ * @brief 3輪の機体の車輪の配置
+ * 4輪の機体の車輪と同じ半径の円周上に120度おきに車輪を置き、60度の位置から時計回りに並べる
+ */
+template<>
+struct WheelLayout<3> {
+    static constexpr ctmath::ConstMatrix<3, 2> position(void) {
+        constexpr double R = ctmath::squareRoot(WHEEL_POS_R_2);
+        return {R * 0.5, R * 0.86602540378443865, R * 0.5, R * -0.86602540378443865, -R, 0.0};
+    }
+};
+
+/**
+ * @brief 4輪の機体の車輪の配置
+ * 長方形の頂点に車輪を置き、第1象限から時計回りに並べる
+ */
+template<>
+struct WheelLayout<4> {
+    static constexpr ctmath::ConstMatrix<4, 2> position(void) {
+        return {WHEEL_POS_X, WHEEL_POS_Y, WHEEL_POS_X, -WHEEL_POS_Y, -WHEEL_POS_X, -WHEEL_POS_Y, -WHEEL_POS_X, WHEEL_POS_Y};
+    }
+};
+
+/**
+ * @brief 5輪の機体の車輪の配置
+ * 4輪の機体の車輪と同じ半径の円周上に72度おきに車輪を置き、54度の位置から時計回りに並べる
+ */
+template<>
+struct WheelLayout<5> {
+    static constexpr ctmath::ConstMatrix<5, 2> position(void) {
+        constexpr double R = ctmath::squareRoot(WHEEL_POS_R_2);
+        return {R * 0.58778525229247314,  R * 0.80901699437494742,  R * 0.95105651629515357, R * -0.30901699437494742, 0.0, -R,
+                R * -0.95105651629515357, R * -0.30901699437494742, R * -0.58778525229247314, R * 0.80901699437494742};
+    }
+};
+
+/// 各車輪の電流を表す制約の係数と加速度の換算係数
+template<int WHEELS>
+static constexpr ctmath::WheelCurrentModel<WHEELS> MODEL(WheelLayout<WHEELS>::position(), MACHINE_WEIGHT, MACHINE_INERTIA, WHEEL_RADIUS / MOTOR_TORQUE_CONSTANT);
+
+/**
+ * @brief アクティブセットごとのシューア補行列の逆行列の配置
+ */
+template<int WHEELS>
+struct SchurLayout {
+    static constexpr int ACTIVE_SETS = 1 << WHEELS;
+
+    constexpr SchurLayout(void) : count(), offset(), size() {
+        for (int bits = 0; bits < ACTIVE_SETS; bits++) {
+            int n = 0;
+            for (int index = 0; index < WHEELS; index++) {
+                n += (bits >> index) & 1;
+            }
+            count[bits] = n;
+            offset[bits] = size;
+            size += n * n;
+        }
+    }
+
+    /// アクティブな制約の数
+    int count[ACTIVE_SETS];
+
+    /// 先頭の要素の位置
+    int offset[ACTIVE_SETS];
+
+    /// 全体の要素数
+    int size;
+};
+
+template<int WHEELS>
+static constexpr SchurLayout<WHEELS> SCHUR_LAYOUT;
 
 static constexpr inline float sqr(float x) {
     return x * x;
 }
 
-bool AccelerationLimitter::compute(const Vector4f& accel_in, const Vector4f& current_limit, Vector4f& accel_out, Vector4f& current_out) {
-    const float WHEEL_POS_R = sqrt(WHEEL_POS_R_2);
-    const float KX = WHEEL_RADIUS / MOTOR_TORQUE_CONSTANT * MACHINE_WEIGHT * WHEEL_POS_R / WHEEL_POS_Y / 4;
-    const float KY = WHEEL_RADIUS / MOTOR_TORQUE_CONSTANT * MACHINE_WEIGHT * WHEEL_POS_R / WHEEL_POS_X / 4;
-    const float KW = WHEEL_RADIUS / MOTOR_TORQUE_CONSTANT * MACHINE_INERTIA / 4 / WHEEL_POS_R;
-    const float KC = WHEEL_RADIUS / MOTOR_TORQUE_CONSTANT * MACHINE_WEIGHT / 4;
-
-    const float p[4] = {
-        KX * WEIGHT_X * accel_in(0),
-        KY * WEIGHT_Y * accel_in(1),
-        KW * WEIGHT_W * accel_in(2),
-        KC * WEIGHT_C * accel_in(3),
-    };
-    constexpr ConstMatrix4 Q = {WEIGHT_X, 0, 0, 0, 0, WEIGHT_Y, 0, 0, 0, 0, WEIGHT_W, 0, 0, 0, 0, WEIGHT_C};
-    constexpr ConstMatrix4 D = {-1, 1, 1, 1, 1, 1, 1, -1, 1, -1, 1, 1, -1, -1, 1, -1};
-    constexpr int ROUND_BIT = 16;
-
-    float x[4] = {0, 0, 0, 0};
-    int active_set_bits = 0;
-    int active_set_signs = 0;
-
-    // 反復は最大5回で終了する
-    bool result = false;
-    for (int iteration = 0; iteration < 5; iteration++) {
-        // 現在の制約下でラグランジュの未定乗数法を解く
-        float y[4], l[4];
-        l[0] = std::numeric_limits<float>::infinity();
-        l[1] = std::numeric_limits<float>::infinity();
-        l[2] = std::numeric_limits<float>::infinity();
-        l[3] = std::numeric_limits<float>::infinity();
-        switch (active_set_bits) {
-        case 0x0:
-            {
-                SOLVE4();
-                break;
-            }
+/// 表の1行を参照する
+struct TableRow {
+    const float* elem;
 
-        case 0x1:
-            {
-                SOLVE5(0);
-                break;
-            }
+    float operator()(size_t col) const {
+        return elem[col];
+    }
+};
+
+template<int WHEELS_>
+BasicAccelerationLimitter<WHEELS_>::BasicAccelerationLimitter(void) {
+    static_assert(ctmath::WheelCurrentModel<WHEELS>::VARIABLES == VARIABLES, "VARIABLES does not match the wheel model");
+    static_assert(SCHUR_LAYOUT<WHEELS>.size == SCHUR_INVERSE_SIZE, "SCHUR_INVERSE_SIZE does not match the layout");
+    memcpy(_weights, DEFAULT_WEIGHTS<VARIABLES>.elem, sizeof(_weights));
+    factorize();
+    reset();
+}
 
-        case 0x2:
-            {
-                SOLVE5(1);
-                break;
-            }
+template<int WHEELS_>
+void BasicAccelerationLimitter<WHEELS_>::reset(void) {
+    _active_set_bits = 0;
+    _active_set_signs = 0;
+    _last_iterations = 0;
+    memset(_iteration_histogram, 0, sizeof(_iteration_histogram));
+}
 
-        case 0x3:
-            {
-                SOLVE6(0, 1);
-                break;
-            }
+template<int WHEELS_>
+void BasicAccelerationLimitter<WHEELS_>::setWeights(const float (&weights)[VARIABLES]) {
+    // MIN_WEIGHT～MAX_WEIGHTの範囲外の重みを含むときは既定の重みを使う
+    // NaNと無限大はビットで除いてから範囲を比べる (-ffast-mathではNaNとの比較の結果は当てにならない)
+    const float(*source)[VARIABLES] = &weights;
+    for (int j = 0; j < VARIABLES; j++) {
+        if (!fpu::isFinite(weights[j]) || (weights[j] < MIN_WEIGHT) || (MAX_WEIGHT < weights[j])) {
+            source = &DEFAULT_WEIGHTS<VARIABLES>.elem;
+            break;
+        }
+    }
 
-        case 0x4:
-            {
-                SOLVE5(2);
-                break;
-            }
+    // 重みが変わったときだけ分解し直す
+    if (memcmp(_weights, *source, sizeof(_weights)) != 0) {
+        memcpy(_weights, *source, sizeof(_weights));
+        factorize();
+        _active_set_bits = 0;
+        _active_set_signs = 0;
+    }
+}
 
-        case 0x5:
-            {
-                SOLVE6(0, 2);
-                break;
+template<int WHEELS_>
+void BasicAccelerationLimitter<WHEELS_>::factorize(void) {
+    const float(&D)[WHEELS][VARIABLES] = MODEL<WHEELS>.coefficient;
+    for (int j = 0; j < VARIABLES; j++) {
+        _inverse_weights[j] = 1.0f / _weights[j];
+    }
+    for (int bits = 1; bits < ACTIVE_SETS; bits++) {
+        // アクティブな制約の番号を並べる
+        const int n = SCHUR_LAYOUT<WHEELS>.count[bits];
+        int active[WHEELS];
+        for (int index = 0, k = 0; index < WHEELS; index++) {
+            if (bits & (1 << index)) {
+                active[k++] = index;
             }
+        }
 
-        case 0x6:
-            {
-                SOLVE6(1, 2);
-                break;
+        // シューア補行列 S = A W^-1 A^T を求める
+        float* S = &_schur_inverse[SCHUR_LAYOUT<WHEELS>.offset[bits]];
+        for (int row = 0; row < n; row++) {
+            for (int col = 0; col < n; col++) {
+                float sum = 0.0f;
+                for (int j = 0; j < VARIABLES; j++) {
+                    sum += D[active[row]][j] * _inverse_weights[j] * D[active[col]][j];
+                }
+                S[row * n + col] = sum;
             }
+        }
 
-        case 0x7:
-            {
-                SOLVE7(0, 1, 2);
-                break;
+        // Sは正定値なのでピボット選択なしのガウス・ジョルダン法でその場で逆行列にする
+        for (int pivot = 0; pivot < n; pivot++) {
+            float reci_pivot = 1.0f / S[pivot * n + pivot];
+            S[pivot * n + pivot] = 1.0f;
+            for (int col = 0; col < n; col++) {
+                S[pivot * n + col] *= reci_pivot;
             }
-
-        case 0x8:
-            {
-                SOLVE5(3);
-                break;
+            for (int row = 0; row < n; row++) {
+                if (row == pivot) {
+                    continue;
+                }
+                float ratio = S[row * n + pivot];
+                S[row * n + pivot] = 0.0f;
+                for (int col = 0; col < n; col++) {
+                    S[row * n + col] -= ratio * S[pivot * n + col];
+                }
             }
+        }
+    }
+}
 
-        case 0x9:
-            {
-                SOLVE6(0, 3);
-                break;
-            }
+template<int WHEELS_>
+bool BasicAccelerationLimitter<WHEELS_>::compute(const VariableVector& accel_in, const WheelVector& current_limit, VariableVector& accel_out,
+                                                 WheelVector& current_out) {
+    return compute(accel_in, current_limit, WheelVector::Zero(), -std::numeric_limits<float>::infinity(), std::numeric_limits<float>::infinity(), accel_out,
+                   current_out);
+}
 
-        case 0xA:
-            {
-                SOLVE6(1, 3);
-                break;
-            }
+template<int WHEELS_>
+bool BasicAccelerationLimitter<WHEELS_>::compute(const VariableVector& accel_in, const WheelVector& current_limit, const WheelVector& power_gradient,
+                                                 float power_lower, float power_upper, VariableVector& accel_out, WheelVector& current_out) {
+    const float(&D)[WHEELS][VARIABLES] = MODEL<WHEELS>.coefficient;
+    const float(&K)[VARIABLES] = MODEL<WHEELS>.scale;
 
-        case 0xB:
-            {
-                SOLVE7(0, 1, 3);
-                break;
-            }
+    // 制約がないときの解 u = W^-1 p
+    float u[VARIABLES];
+    for (int j = 0; j < VARIABLES; j++) {
+        u[j] = K[j] * accel_in(j);
+    }
 
-        case 0xC:
-            {
-                SOLVE6(2, 3);
-                break;
-            }
+    // 電力の制約を各車輪の電流に対する勾配gから変数に対する係数 c = D^T g に直す
+    float power_row[VARIABLES], weighted_power_row[VARIABLES];
+    for (int j = 0; j < VARIABLES; j++) {
+        float sum = 0.0f;
+        for (int index = 0; index < WHEELS; index++) {
+            sum += power_gradient(index) * D[index][j];
+        }
+        power_row[j] = sum;
+        weighted_power_row[j] = _inverse_weights[j] * sum;
+    }
 
-        case 0xD:
-            {
-                SOLVE7(0, 2, 3);
-                break;
-            }
+    // 制約の係数と下限・上限、実行可能と見なす超過量
+    // 原点が実行可能であるように電力の下限は0以下、上限は0以上にする
+    const float* rows[CONSTRAINTS];
+    float lower[CONSTRAINTS], upper[CONSTRAINTS], tolerance[CONSTRAINTS];
+    for (int index = 0; index < WHEELS; index++) {
+        rows[index] = D[index];
+        lower[index] = -current_limit(index);
+        upper[index] = current_limit(index);
+        tolerance[index] = OC_EPS;
+    }
+    rows[POWER_INDEX] = power_row;
+    lower[POWER_INDEX] = fpu::min(power_lower, 0.0f);
+    upper[POWER_INDEX] = fpu::max(power_upper, 0.0f);
+    tolerance[POWER_INDEX] = POWER_EPS;
+
+    // 電力の制約のシューア補行列の要素 c W^-1 c^T と D_i W^-1 c^T
+    const float power_self = kernel::dot(TableRow{power_row}, weighted_power_row);
+    float power_cross[WHEELS];
+    for (int index = 0; index < WHEELS; index++) {
+        power_cross[index] = kernel::dot(TableRow{D[index]}, weighted_power_row);
+    }
 
-        case 0xE:
-            {
-                SOLVE7(1, 2, 3);
-                break;
+    // 前回収束したときのアクティブセットから開始する
+    // その解が実行可能でなければ空のアクティブセットと実行可能な原点からやり直す
+    float x[VARIABLES] = {};
+    int active_set_bits = _active_set_bits;
+    int active_set_signs = _active_set_signs;
+    bool warm_start = (active_set_bits != 0);
+
+    // 反復は電力の制約があるときは最大MAX_ITERATIONS回、ないときは最大WHEELS + 1回 (前回のアクティブセットから開始したときは+1回) で終了する
+    // 電力の制約は上限と下限がともに無限大のときだけないものとする (-ffast-mathでも畳み込まれないようにビットで調べる)
+    bool result = false;
+    bool has_power = fpu::isFinite(power_lower) || fpu::isFinite(power_upper);
+    int max_iterations = (has_power ? MAX_ITERATIONS : (WHEELS + 1)) + (warm_start ? 1 : 0);
+    int iteration = 0;
+    while (iteration < max_iterations) {
+        iteration++;
+
+        // 現在の制約下でラグランジュの未定乗数法を解く
+        // 車輪の制約だけのときラグランジュ乗数は l = S^-1 (A u - b)、解は y = u - W^-1 A^T l で求まる
+        // アクティブでない制約のラグランジュ乗数は無限大とする
+        const int wheel_bits = active_set_bits & (ACTIVE_SETS - 1);
+        const int n = SCHUR_LAYOUT<WHEELS>.count[wheel_bits];
+        const float* S_inv = &_schur_inverse[SCHUR_LAYOUT<WHEELS>.offset[wheel_bits]];
+        int active[WHEELS];
+        float residual[WHEELS], cross[WHEELS];
+        for (int index = 0, k = 0; index < WHEELS; index++) {
+            if (active_set_bits & (1 << index)) {
+                float bound = (active_set_signs & (1 << index)) ? lower[index] : upper[index];
+                active[k] = index;
+                residual[k] = kernel::dot(TableRow{D[index]}, u) - bound;
+                cross[k] = power_cross[index];
+                k++;
+            }
+        }
+        float lambda[WHEELS];
+        for (int row = 0; row < n; row++) {
+            float sum = 0.0f;
+            for (int col = 0; col < n; col++) {
+                sum += S_inv[row * n + col] * residual[col];
             }
+            lambda[row] = sum;
+        }
 
-        case 0xF:
-            {
-                SOLVE8();
-                break;
+        // 電力の制約がアクティブなときは車輪の制約のシューア補行列に1行1列を縁どりした行列の逆行列で解く
+        // z = S^-1 v, s = c W^-1 c^T - v^T z として l_p = (r_p - z^T r) / s, l = S^-1 r - z l_p となる
+        float power_lambda = 0.0f;
+        if (active_set_bits & (1 << POWER_INDEX)) {
+            float z[WHEELS];
+            float schur = power_self, z_residual = 0.0f;
+            for (int row = 0; row < n; row++) {
+                float sum = 0.0f;
+                for (int col = 0; col < n; col++) {
+                    sum += S_inv[row * n + col] * cross[col];
+                }
+                z[row] = sum;
+                schur -= cross[row] * sum;
+                z_residual += sum * residual[row];
+            }
+            if (schur <= power_self * SINGULAR_EPS) {
+                // 電力の制約はアクティブな車輪の制約に従属しているので外す
+                active_set_bits &= ~(1 << POWER_INDEX);
+                DEBUG_PRINTF("Drop dependent power constraint\n");
             }
+            else {
+                float bound = (active_set_signs & (1 << POWER_INDEX)) ? lower[POWER_INDEX] : upper[POWER_INDEX];
+                power_lambda = (kernel::dot(TableRow{power_row}, u) - bound - z_residual) / schur;
+                for (int row = 0; row < n; row++) {
+                    lambda[row] -= z[row] * power_lambda;
+                }
+            }
+        }
 
-        default:
-            active_set_bits = 0;
-            y[0] = 0.0f;
-            y[1] = 0.0f;
-            y[2] = 0.0f;
-            y[3] = 0.0f;
-            break;
+        float y[VARIABLES], l[CONSTRAINTS];
+        for (int j = 0; j < VARIABLES; j++) {
+            y[j] = u[j] - weighted_power_row[j] * power_lambda;
+        }
+        for (int index = 0; index < CONSTRAINTS; index++) {
+            l[index] = std::numeric_limits<float>::infinity();
+        }
+        for (int row = 0; row < n; row++) {
+            const int index = active[row];
+            for (int j = 0; j < VARIABLES; j++) {
+                y[j] -= _inverse_weights[j] * D[index][j] * lambda[row];
+            }
+            l[index] = (active_set_signs & (1 << index)) ? -lambda[row] : lambda[row];
+        }
+        if (active_set_bits & (1 << POWER_INDEX)) {
+            l[POWER_INDEX] = (active_set_signs & (1 << POWER_INDEX)) ? -power_lambda : power_lambda;
         }
 
-        DEBUG_PRINTF("y=[%f; %f; %f; %f], lambda=[%f; %f; %f; %f]\n", y[0], y[1], y[2], y[3], l[0], l[1], l[2], l[3]);
+        DEBUG_PRINTF("y=[%f; %f; %f; %f], lambda=[%f; %f; %f; %f; %f]\n", y[0], y[1], y[2], y[3], l[0], l[1], l[2], l[3], l[4]);
 
-        float current[4];
-        current[0] = D(0, 0) * y[0] + D(0, 1) * y[1] + D(0, 2) * y[2] + D(0, 3) * y[3];
-        current[1] = D(1, 0) * y[0] + D(1, 1) * y[1] + D(1, 2) * y[2] + D(1, 3) * y[3];
-        current[2] = D(2, 0) * y[0] + D(2, 1) * y[1] + D(2, 2) * y[2] + D(2, 3) * y[3];
-        current[3] = D(3, 0) * y[0] + D(3, 1) * y[1] + D(3, 2) * y[2] + D(3, 3) * y[3];
-        current_out[0] = fpu::clamp(current[0], -current_limit[0], current_limit[0]);
-        current_out[1] = fpu::clamp(current[1], -current_limit[1], current_limit[1]);
-        current_out[2] = fpu::clamp(current[2], -current_limit[2], current_limit[2]);
-        current_out[3] = fpu::clamp(current[3], -current_limit[3], current_limit[3]);
+        // yが実行可能か調べる
+        float value[CONSTRAINTS];
+        float over = -std::numeric_limits<float>::infinity();
+        for (int index = 0; index < CONSTRAINTS; index++) {
+            value[index] = kernel::dot(TableRow{rows[index]}, y);
+            over = fpu::max(over, fpu::max(value[index] - upper[index], lower[index] - value[index]) - tolerance[index]);
+        }
 
-        DEBUG_PRINTF("current=[%f; %f; %f; %f]\n", current[0], current[1], current[2], current[3]);
+        DEBUG_PRINTF("current=[%f; %f; %f; %f], power=%f\n", value[0], value[1], value[2], value[3], value[4]);
 
-        // yが実行可能か調べる
-        float over_current = fpu::max(fpu::max(fabs(current[0]) - current_limit[0], fabs(current[1]) - current_limit[1]),
-                                      fpu::max(fabs(current[2]) - current_limit[2], fabs(current[3]) - current_limit[3]));
-        float norm2 = (sqr(y[0] - x[0]) + sqr(y[1] - x[1]) + sqr(y[2] - x[2]) + sqr(y[3] - x[3]));
-        if ((over_current < OC_EPS) || (norm2 < EPS)) {
+        float norm2 = 0.0f;
+        for (int j = 0; j < VARIABLES; j++) {
+            norm2 += sqr(y[j] - x[j]);
+        }
+        if ((over < 0.0f) || (norm2 < EPS)) {
             // yは実行可能領域内にある
-            x[0] = y[0];
-            x[1] = y[1];
-            x[2] = y[2];
-            x[3] = y[3];
+            warm_start = false;
+            for (int j = 0; j < VARIABLES; j++) {
+                x[j] = y[j];
+            }
 
             // 収束判定
-            if (0.0f <= fpu::min(fpu::min(l[0], l[1]), fpu::min(l[2], l[3]))) {
+            int index = 0;
+            float min_lambda = l[0];
+            for (int i = 1; i < CONSTRAINTS; i++) {
+                if (l[i] < min_lambda) {
+                    min_lambda = l[i];
+                    index = i;
+                }
+            }
+            if (0.0f <= min_lambda) {
                 // 収束した
                 DEBUG_PRINTF("Finished\n");
                 result = true;
@@ -278,81 +415,51 @@ bool AccelerationLimitter::compute(const Vector4f& accel_in, const Vector4f& cur
             else {
                 // 収束しなかった
                 // 不要な制約をアクティブセットから削除する
-                int index = 0;
-                float min_lambda = l[0];
-                if (l[1] < min_lambda) {
-                    min_lambda = l[1];
-                    index = 1;
-                }
-                if (l[2] < min_lambda) {
-                    min_lambda = l[2];
-                    index = 2;
-                }
-                if (l[3] < min_lambda) {
-                    min_lambda = l[3];
-                    index = 3;
-                }
                 active_set_bits &= ~(1 << index);
                 DEBUG_PRINTF("Delete set %d, lambda = %f\n", (active_set_signs & (1 << index)) ? (-index - 1) : (index + 1), min_lambda);
             }
         }
+        else if (warm_start) {
+            // 前回のアクティブセットの解は実行可能領域外にあるので、空のアクティブセットからやり直す
+            warm_start = false;
+            active_set_bits = 0;
+            active_set_signs = 0;
+            DEBUG_PRINTF("Restart\n");
+        }
         else {
             // yは実行可能領域外にある
             // xからyにいたる経路で始めに当たる制約条件を見つけてアクティブセットに追加する
             int min_lower_bound_index = -1, min_upper_bound_index = -1;
             float min_lower_bound_t = std::numeric_limits<float>::infinity();
             float min_upper_bound_t = std::numeric_limits<float>::infinity();
-            const float d[4] = {
-                y[0] - x[0],
-                y[1] - x[1],
-                y[2] - x[2],
-                y[3] - x[3],
-            };
-            for (int index = 0; index < 4; index++) {
+            float d[VARIABLES];
+            for (int j = 0; j < VARIABLES; j++) {
+                d[j] = y[j] - x[j];
+            }
+            for (int index = 0; index < CONSTRAINTS; index++) {
                 if (active_set_bits & (1 << index)) {
                     continue;
                 }
-                float ax, ad;
-                switch (index) {
-                case 0:
-                    {
-                        constexpr auto A = D.extractRow(0);
-                        ax = A(0, 0) * x[0] + A(0, 1) * x[1] + A(0, 2) * x[2] + A(0, 3) * x[3];
-                        ad = A(0, 0) * d[0] + A(0, 1) * d[1] + A(0, 2) * d[2] + A(0, 3) * d[3];
-                        break;
-                    }
-                case 1:
-                    {
-                        constexpr auto A = D.extractRow(1);
-                        ax = A(0, 0) * x[0] + A(0, 1) * x[1] + A(0, 2) * x[2] + A(0, 3) * x[3];
-                        ad = A(0, 0) * d[0] + A(0, 1) * d[1] + A(0, 2) * d[2] + A(0, 3) * d[3];
-                        break;
-                    }
-                case 2:
-                    {
-                        constexpr auto A = D.extractRow(2);
-                        ax = A(0, 0) * x[0] + A(0, 1) * x[1] + A(0, 2) * x[2] + A(0, 3) * x[3];
-                        ad = A(0, 0) * d[0] + A(0, 1) * d[1] + A(0, 2) * d[2] + A(0, 3) * d[3];
-                        break;
-                    }
-                case 3:
-                    {
-                        constexpr auto A = D.extractRow(3);
-                        ax = A(0, 0) * x[0] + A(0, 1) * x[1] + A(0, 2) * x[2] + A(0, 3) * x[3];
-                        ad = A(0, 0) * d[0] + A(0, 1) * d[1] + A(0, 2) * d[2] + A(0, 3) * d[3];
-                        break;
-                    }
-                }
+                TableRow A{rows[index]};
+                float ax = kernel::dot(A, x);
+                float ad = kernel::dot(A, d);
+
+                // 経路が向かう側の制約だけを調べる
+                // xは許容誤差の範囲で制約を超えていることがあるので、そのときはt=0で当たるものとする
                 float reci_ad = 1.0f / ad;
-                float lb_t = (-current_limit[index] - ax) * reci_ad;
-                float ub_t = (current_limit[index] - ax) * reci_ad;
-                if ((EPS < lb_t) && (lb_t < min_lower_bound_t)) {
-                    min_lower_bound_t = lb_t;
-                    min_lower_bound_index = index;
+                if (ad < -EPS) {
+                    float lb_t = fpu::max((lower[index] - ax) * reci_ad, 0.0f);
+                    if (lb_t < min_lower_bound_t) {
+                        min_lower_bound_t = lb_t;
+                        min_lower_bound_index = index;
+                    }
                 }
-                if ((EPS < ub_t) && (ub_t < min_upper_bound_t)) {
-                    min_upper_bound_t = ub_t;
-                    min_upper_bound_index = index;
+                else if (EPS < ad) {
+                    float ub_t = fpu::max((upper[index] - ax) * reci_ad, 0.0f);
+                    if (ub_t < min_upper_bound_t) {
+                        min_upper_bound_t = ub_t;
+                        min_upper_bound_index = index;
+                    }
                 }
             }
             float min_t = fpu::min(min_lower_bound_t, min_upper_bound_t);
@@ -360,19 +467,17 @@ bool AccelerationLimitter::compute(const Vector4f& accel_in, const Vector4f& cur
                 break;
             }
             if (min_lower_bound_t < min_upper_bound_t) {
-                x[0] += min_lower_bound_t * d[0];
-                x[1] += min_lower_bound_t * d[1];
-                x[2] += min_lower_bound_t * d[2];
-                x[3] += min_lower_bound_t * d[3];
+                for (int j = 0; j < VARIABLES; j++) {
+                    x[j] += min_lower_bound_t * d[j];
+                }
                 active_set_bits |= 1 << min_lower_bound_index;
                 active_set_signs |= 1 << min_lower_bound_index;
                 DEBUG_PRINTF("New set -%d, t=%f\n", min_lower_bound_index + 1, min_lower_bound_t);
             }
             else {
-                x[0] += min_upper_bound_t * d[0];
-                x[1] += min_upper_bound_t * d[1];
-                x[2] += min_upper_bound_t * d[2];
-                x[3] += min_upper_bound_t * d[3];
+                for (int j = 0; j < VARIABLES; j++) {
+                    x[j] += min_upper_bound_t * d[j];
+                }
                 active_set_bits |= 1 << min_upper_bound_index;
                 active_set_signs &= ~(1 << min_upper_bound_index);
                 DEBUG_PRINTF("New set %d, t=%f\n", min_upper_bound_index + 1, min_upper_bound_t);
@@ -380,10 +485,40 @@ bool AccelerationLimitter::compute(const Vector4f& accel_in, const Vector4f& cur
         }
     }
 
-    accel_out[0] = x[0] * (1.0f / KX);
-    accel_out[1] = x[1] * (1.0f / KY);
-    accel_out[2] = x[2] * (1.0f / KW);
-    accel_out[3] = x[3] * (1.0f / KC);
+    // 収束したときのアクティブセットを次の計算の開始点にする
+    if (result) {
+        _active_set_bits = active_set_bits;
+        _active_set_signs = active_set_signs & active_set_bits;
+        _iteration_histogram[iteration - 1]++;
+    }
+    else {
+        _active_set_bits = 0;
+        _active_set_signs = 0;
+        _iteration_histogram[HISTOGRAM_SIZE - 1]++;
+    }
+    _last_iterations = iteration;
+
+    // 収束しなかったときもxは原点から実行可能領域の中だけを進んできた解なので、そのまま出力する
+    for (int j = 0; j < VARIABLES; j++) {
+        accel_out[j] = x[j] * MODEL<WHEELS>.inverse_scale[j];
+    }
+    for (int index = 0; index < WHEELS; index++) {
+        current_out[index] = fpu::clamp(kernel::dot(TableRow{D[index]}, x), lower[index], upper[index]);
+    }
 
     return result;
 }
+
+template<int WHEELS_>
+const float (&BasicAccelerationLimitter<WHEELS_>::currentCoefficients(void))[WHEELS][VARIABLES] {
+    return MODEL<WHEELS>.coefficient;
+}
+
+template<int WHEELS_>
+const float (&BasicAccelerationLimitter<WHEELS_>::scaleFactors(void))[VARIABLES] {
+    return MODEL<WHEELS>.scale;
+}
+
+template class BasicAccelerationLimitter<3>;
+template class BasicAccelerationLimitter<4>;
+template class BasicAccelerationLimitter<5>;
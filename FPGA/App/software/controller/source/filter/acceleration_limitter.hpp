@@ -7,17 +7,78 @@
 
 #pragma once
 
+#include <stdint.h>
 #include <Eigen/Core>
 
 /**
  * @brief 加速度を制限する
+ * 有効制約法の反復は前回の計算で収束したときのアクティブセットから開始する
+ * 目的関数の重みを変えたときに全アクティブセットのKKT条件の連立方程式を分解してキャッシュしておく
+ * 各車輪の電流の係数と加速度の換算係数は車輪の配置からコンパイル時に求める
+ * 変数はX, Y, ωと、機体に加速度を生じない車輪の力の組み合わせC1～C(WHEELS-3)
+ * @tparam WHEELS_ 車輪の数 (電流制限の制約の数、3以上)
  */
-class AccelerationLimitter {
+template<int WHEELS_>
+class BasicAccelerationLimitter {
 public:
+    /// 車輪の数 (電流制限の制約の数)
+    static constexpr int WHEELS = WHEELS_;
+    static_assert(3 <= WHEELS, "WHEELS must be at least 3 to accelerate in every direction");
+
+    /// 変数の数 (X, Y, ωと、機体に加速度を生じない組み合わせの数WHEELS - 3)
+    static constexpr int VARIABLES = 3 + (WHEELS - 3);
+
+    /// 電力の制約の番号
+    static constexpr int POWER_INDEX = WHEELS;
+
+    /// 制約の数 (各車輪の電流と電力)
+    static constexpr int CONSTRAINTS = WHEELS + 1;
+    static_assert(CONSTRAINTS < 31, "active set does not fit in int");
+
+    /// 車輪の制約だけのアクティブセットの数
+    static constexpr int ACTIVE_SETS = 1 << WHEELS;
+
+    /// 全アクティブセットのシューア補行列の逆行列を詰めて並べたときの要素数 (sum_k C(WHEELS, k) * k^2)
+    static constexpr int SCHUR_INVERSE_SIZE = (WHEELS * (WHEELS + 1)) << (WHEELS - 2);
+
+    /// 空のアクティブセットから開始したときの反復の最大回数 (電力の制約があるとき。ないときはWHEELS + 1回)
+    static constexpr int MAX_ITERATIONS = CONSTRAINTS + 1;
+
+    /// 反復回数のヒストグラムの大きさ (前回のアクティブセットで解いた1回を含む。最後の要素は収束しなかった回数)
+    static constexpr int HISTOGRAM_SIZE = MAX_ITERATIONS + 2;
+
+    /// 車輪ごとの値を並べたベクトル
+    using WheelVector = Eigen::Matrix<float, WHEELS, 1>;
+
+    /// 変数ごとの値を並べたベクトル (X, Y, ω, C1, ...)
+    using VariableVector = Eigen::Matrix<float, VARIABLES, 1>;
+
+    /**
+     * @brief 既定の重みでKKT条件の連立方程式を分解し、内部状態をリセットする
+     */
+    BasicAccelerationLimitter(void);
+
     /**
      * @brief 内部状態をリセットする
+     * 前回のアクティブセットと反復回数の統計をクリアする (重みと分解した結果は保持する)
      */
-    void reset(void) {}
+    void reset(void);
+
+    /**
+     * @brief 目的関数の重みを設定する
+     * 重みが変わったときだけKKT条件の連立方程式を分解し直す
+     * NaNと無限大を含むときと、1e-3～1e3の範囲外の重みを含むときは既定の重みを使う
+     * @param weights X, Y, ω, C1, ...の加速度の誤差に対する重み
+     */
+    void setWeights(const float (&weights)[VARIABLES]);
+
+    /**
+     * @brief 目的関数の重みを取得する
+     * @return X, Y, ω, C1, ...の加速度の誤差に対する重み
+     */
+    const float (&weights(void) const)[VARIABLES] {
+        return _weights;
+    }
 
     /**
      * @brief フィルタに新たな入力を与えて出力を更新する
@@ -25,6 +86,85 @@ public:
      * @param current_limit 各車輪の電流制限値
      * @param accel_out 制限された加速度
      * @param current_out 各車輪の目標電流
+     * @return 収束したときはtrue (収束しなかったときも最後に得た実行可能な解を出力する)
+     */
+    bool compute(const VariableVector& accel_in, const WheelVector& current_limit, VariableVector& accel_out, WheelVector& current_out);
+
+    /**
+     * @brief 電力の制約を加えてフィルタに新たな入力を与えて出力を更新する
+     * 電力は各車輪の電流Iの一次式 g・I で表し、power_lower <= g・I <= power_upper に制限する
+     * 原点が実行可能であるようにpower_lowerは0以下、power_upperは0以上に丸める
+     * @param accel_in 目標加速度
+     * @param current_limit 各車輪の電流制限値
+     * @param power_gradient 各車輪の電流に対する電力の勾配g [W/A]
+     * @param power_lower g・Iの下限 [W] (回生側)
+     * @param power_upper g・Iの上限 [W] (力行側)
+     * @param accel_out 制限された加速度
+     * @param current_out 各車輪の目標電流
+     * @return 収束したときはtrue (収束しなかったときも最後に得た実行可能な解を出力する)
+     */
+    bool compute(const VariableVector& accel_in, const WheelVector& current_limit, const WheelVector& power_gradient, float power_lower, float power_upper,
+                 VariableVector& accel_out, WheelVector& current_out);
+
+    /**
+     * @brief 直前のcompute()でKKT条件の連立方程式を解いた回数を取得する
+     * @return 解いた回数
+     */
+    int lastIterations(void) const {
+        return _last_iterations;
+    }
+
+    /**
+     * @brief reset()してからのKKT条件の連立方程式を解いた回数のヒストグラムを取得する
+     * @return ヒストグラム (i番目の要素は(i+1)回で収束した回数)
+     */
+    const uint32_t (&iterationHistogram(void) const)[HISTOGRAM_SIZE] {
+        return _iteration_histogram;
+    }
+
+    /**
+     * @brief 各車輪の電流を表す制約の係数を取得する
+     * @return i行j列の要素は変数jに対する車輪iの電流の係数
+     */
+    static const float (&currentCoefficients(void))[WHEELS][VARIABLES];
+
+    /**
+     * @brief 加速度を制約の変数 (車輪の電流と同じ単位) に換算する係数を取得する
+     * @return X, Y, ω, C1, ...の係数
      */
-    bool compute(const Eigen::Vector4f& accel_in, const Eigen::Vector4f& current_limit, Eigen::Vector4f& accel_out, Eigen::Vector4f& current_out);
+    static const float (&scaleFactors(void))[VARIABLES];
+
+private:
+    /**
+     * @brief 全アクティブセットについてシューア補行列 (A W^-1 A^T) の逆行列を求める
+     */
+    void factorize(void);
+
+    /// 目的関数の重み
+    float _weights[VARIABLES];
+
+    /// 目的関数の重みの逆数
+    float _inverse_weights[VARIABLES];
+
+    /// アクティブセットごとのシューア補行列の逆行列 (アクティブな制約の数をkとしてk*k要素ずつ詰めて並べる)
+    float _schur_inverse[SCHUR_INVERSE_SIZE];
+
+    /// 前回収束したときのアクティブセット (POWER_INDEX番目のビットは電力の制約)
+    int _active_set_bits;
+
+    /// 前回収束したときのアクティブセットの制約の符号 (ビットが1のとき下限)
+    int _active_set_signs;
+
+    /// 直前のcompute()でKKT条件の連立方程式を解いた回数
+    int _last_iterations;
+
+    /// KKT条件の連立方程式を解いた回数のヒストグラム
+    uint32_t _iteration_histogram[HISTOGRAM_SIZE];
 };
+
+extern template class BasicAccelerationLimitter<3>;
+extern template class BasicAccelerationLimitter<4>;
+extern template class BasicAccelerationLimitter<5>;
+
+/// 4輪の機体の加速度制限
+using AccelerationLimitter = BasicAccelerationLimitter<4>;
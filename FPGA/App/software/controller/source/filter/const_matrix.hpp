@@ -41,7 +41,7 @@ public:
         }
     }
 
-    ConstMatrix<ROWS, COLS>& operator=(const ConstMatrix<ROWS, COLS>& src) {
+    constexpr ConstMatrix<ROWS, COLS>& operator=(const ConstMatrix<ROWS, COLS>& src) {
         for (size_t row = 0; row < ROWS; row++) {
             for (size_t col = 0; col < COLS; col++) {
                 elem[row][col] = src.elem[row][col];
@@ -234,6 +234,15 @@ public:
         return ConstMatrix<ROWS, COLS>();
     }
 
+    static constexpr ConstMatrix<ROWS, COLS> identity(void) {
+        static_assert(COLS == ROWS, "COLS must euqal ROWS");
+        ConstMatrix<ROWS, COLS> result;
+        for (size_t i = 0; i < ROWS; i++) {
+            result.elem[i][i] = 1;
+        }
+        return result;
+    }
+
     double elem[ROWS][COLS];
 };
 
@@ -300,6 +309,114 @@ static constexpr ConstMatrix<ROWS1 + ROWS2, COLS1 + COLS2> mergeBlocks(const Con
     return result;
 }
 
+/**
+ * @brief ニュートン法で平方根を求める
+ */
+static constexpr double squareRoot(double x) {
+    if (x <= 0) {
+        return 0;
+    }
+    double y = (1 < x) ? x : 1;
+    while (true) {
+        double next = (y + x / y) / 2;
+        if (y <= next) {
+            return y;
+        }
+        y = next;
+    }
+}
+
+/**
+ * @brief 全方向移動の機体で加速度から各車輪の電流を求める係数を作る
+ * 車輪の駆動方向は機体の中心を回る円の接線方向とし、並進と回転の加速度に必要な力は車輪の力の2乗和が最小になるように配る。
+ * 4番目以降の変数C1～C(WHEELS-3)は機体に加速度を生じない車輪の力の互いに直交する組み合わせで、
+ * 各変数は絶対値が最大の係数が1になるように正規化する
+ * @tparam WHEELS 車輪の数
+ */
+template<size_t WHEELS>
+struct WheelCurrentModel {
+    static_assert(3 <= WHEELS, "WHEELS must be at least 3 to accelerate in every direction");
+
+    /// 変数の数 (X, Y, ωと機体に加速度を生じない組み合わせWHEELS - 3個)
+    static constexpr size_t VARIABLES = 3 + (WHEELS - 3);
+
+    /**
+     * @brief 係数を求める
+     * @param position 各車輪の位置 (x, y) [m]
+     * @param mass 機体の質量 [kg]
+     * @param inertia 機体の慣性モーメント [kg m^2]
+     * @param current_per_force 車輪の力あたりの電流 (車輪の半径 / トルク定数) [A/N]
+     */
+    constexpr WheelCurrentModel(const ConstMatrix<WHEELS, 2>& position, double mass, double inertia, double current_per_force)
+        : coefficient(), scale(), inverse_scale() {
+        // 車輪の力から機体の力とトルクへの行列T
+        ConstMatrix<3, WHEELS> T;
+        for (size_t i = 0; i < WHEELS; i++) {
+            double x = position.elem[i][0], y = position.elem[i][1];
+            double r = squareRoot(x * x + y * y);
+            T.elem[0][i] = -y / r;
+            T.elem[1][i] = x / r;
+            T.elem[2][i] = r;
+        }
+
+        // 2乗和が最小になる力の配分 P = T^T (T T^T)^-1 と、機体に加速度を生じない成分への射影 I - P T
+        ConstMatrix<WHEELS, 3> P = T.t() * (T * T.t()).inv();
+        ConstMatrix<WHEELS, WHEELS> N = ConstMatrix<WHEELS, WHEELS>::identity() - P * T;
+
+        // 変数ごとの車輪の力の組み合わせを列に並べる
+        // C1以降は射影の対角要素が最大の列を取り出し、その方向を射影から除くことを繰り返す
+        ConstMatrix<WHEELS, VARIABLES> basis;
+        for (size_t i = 0; i < WHEELS; i++) {
+            for (size_t j = 0; j < 3; j++) {
+                basis.elem[i][j] = P.elem[i][j];
+            }
+        }
+        for (size_t j = 3; j < VARIABLES; j++) {
+            size_t balanced = 0;
+            for (size_t i = 1; i < WHEELS; i++) {
+                if (N.elem[balanced][balanced] < N.elem[i][i]) {
+                    balanced = i;
+                }
+            }
+            double v[WHEELS] = {};
+            for (size_t i = 0; i < WHEELS; i++) {
+                v[i] = N.elem[i][balanced];
+                basis.elem[i][j] = v[i];
+            }
+            double reci_norm2 = 1 / N.elem[balanced][balanced];
+            for (size_t row = 0; row < WHEELS; row++) {
+                for (size_t col = 0; col < WHEELS; col++) {
+                    N.elem[row][col] -= v[row] * v[col] * reci_norm2;
+                }
+            }
+        }
+
+        for (size_t j = 0; j < VARIABLES; j++) {
+            double max_abs = 0;
+            for (size_t i = 0; i < WHEELS; i++) {
+                double value = basis.elem[i][j];
+                max_abs = (max_abs < value) ? value : ((max_abs < -value) ? -value : max_abs);
+            }
+            for (size_t i = 0; i < WHEELS; i++) {
+                coefficient[i][j] = static_cast<float>(basis.elem[i][j] / max_abs);
+            }
+            double generalized_mass = (j < 2) ? mass : ((j == 2) ? inertia : (mass / WHEELS));
+            double k = current_per_force * generalized_mass * ((j < 3) ? max_abs : 1);
+            scale[j] = static_cast<float>(k);
+            inverse_scale[j] = static_cast<float>(1 / k);
+        }
+    }
+
+    /// 各車輪の電流を表す変数の係数
+    float coefficient[WHEELS][VARIABLES];
+
+    /// 加速度を変数に換算する係数
+    float scale[VARIABLES];
+
+    /// scaleの逆数
+    float inverse_scale[VARIABLES];
+};
+
 using ConstMatrix1 = ConstMatrix<1, 1>;
 using ConstMatrix2 = ConstMatrix<2, 2>;
 using ConstMatrix3 = ConstMatrix<3, 3>;
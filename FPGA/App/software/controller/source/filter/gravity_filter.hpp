@@ -11,6 +11,7 @@
 #include <fpu.hpp>
 #include <Eigen/Core>
 #include "board.hpp"
+#include "matrix_kernel.hpp"
 
 /**
  * @brief IMUの測定値から重力の影響を取り除くフィルタ
@@ -28,8 +29,9 @@ public:
      * @brief フィルタに新たな入力を与えて出力を更新する
      * @param accel 加速度センサーの測定値
      * @param gyro ジャイロスコープの測定値
+     * @param period 制御周期 [s]
      */
-    void update(const Eigen::Vector3f& accel, const Eigen::Vector3f& gyro) {
+    void update(const Eigen::Vector3f& accel, const Eigen::Vector3f& gyro, float period) {
         using namespace Eigen;
 
         static constexpr float GYRO_GAIN_P = 1.0;
@@ -37,6 +39,10 @@ public:
         static constexpr float GRAVITY_LOW_THRESHOLD = 0.0625f;
         static constexpr float GRAVITY_COMPENSATION = 0.001f;
 
+        // ゲインはIMU_OUTPUT_RATEの周期あたりの値なので制御周期との比を掛けて使う
+        float ratio = period * IMU_OUTPUT_RATE;
+        float gravity_compensation = GRAVITY_COMPENSATION * ratio;
+
         if (!_initialized) {
             // 重力加速度ベクトルを初期化する
             _initialized = true;
@@ -49,12 +55,12 @@ public:
         float gravity_scale = fpu::sqrt(_gravity.squaredNorm());
         if (GRAVITY_LOW_THRESHOLD < gravity_scale) {
             gyro_error = accel.cross(_gravity) / (gravity_scale * gravity_scale);
-            _gyro_error_integ += gyro_error;
+            _gyro_error_integ += gyro_error * ratio;
         }
         else {
             // 重力が異様に小さいときは加速度センサーによる角速度の補正を減らす
             gyro_error = Vector3f::Zero();
-            _gyro_error_integ *= fpu::max(1.0f - 1.0f / IMU_OUTPUT_RATE, 0.0f);
+            _gyro_error_integ *= fpu::max(1.0f - period, 0.0f);
         }
 
         // 角速度を加速度センサーから得た角度誤差で補正する
@@ -62,17 +68,17 @@ public:
         _compensated_gyro = gyro + delta_omega;
 
         // 重力ベクトルを回転する
-        Matrix3f Rt = rotationMatrixTransposed(_compensated_gyro * (1.0f / IMU_OUTPUT_RATE));
-        _gravity = Rt * _gravity;
+        Matrix3f Rt = rotationMatrixTransposed(_compensated_gyro * period);
+        kernel::matmulvec(Rt, _gravity, _gravity);
 
         // 重力加速度ベクトルの大きさを徐々に加速度の大きさに近づける
         // 重力が小さいときは大きさではなくベクトルそのものを使って補正する
         float accel_scale = fpu::sqrt(accel.squaredNorm());
         if (GRAVITY_LOW_THRESHOLD < fpu::min(accel_scale, gravity_scale)) {
-            _gravity *= ((1.0f - GRAVITY_COMPENSATION) + GRAVITY_COMPENSATION * accel_scale / gravity_scale);
+            _gravity *= ((1.0f - gravity_compensation) + gravity_compensation * accel_scale / gravity_scale);
         }
         else {
-            _gravity = (1.0f - GRAVITY_COMPENSATION) * _gravity + GRAVITY_COMPENSATION * accel;
+            _gravity = (1.0f - gravity_compensation) * _gravity + gravity_compensation * accel;
         }
 
         // 加速度ベクトルから重力の影響を除去する
@@ -0,0 +1,390 @@
+/**
+ * @file matrix_kernel.hpp
+ * @author Fujii Naomichi
+ * @copyright (c) 2021 Fujii Naomichi
+ * SPDX-License-Identifier: MIT
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <Eigen/Core>
+#include "fpu.hpp"
+#include "fpu_kernel.hpp"
+#include "symmetric_matrix.hpp"
+
+/**
+ * @brief 固定サイズの行列演算カーネル
+ * 積和は要素の読み出し・MUL・ACCを交互に発行するように展開して、FPUのレイテンシを隠す
+ * 行列にはEigen::MatrixとSymmetricMatrixを使える
+ */
+namespace kernel {
+
+/// 行列の大きさ
+template<class MATRIX>
+struct Shape;
+
+template<int R, int C, int OPTIONS, int MAX_R, int MAX_C>
+struct Shape<Eigen::Matrix<float, R, C, OPTIONS, MAX_R, MAX_C>> {
+    static constexpr size_t ROWS = R;
+    static constexpr size_t COLS = C;
+};
+
+template<size_t N>
+struct Shape<SymmetricMatrix<N>> {
+    static constexpr size_t ROWS = N;
+    static constexpr size_t COLS = N;
+};
+
+/// 行列の1行を参照する
+template<class MATRIX>
+struct Row {
+    const MATRIX& matrix;
+    size_t row;
+
+    float operator()(size_t col) const {
+        return matrix(row, col);
+    }
+};
+
+/// 行列の1行を参照するRowを作る
+template<class MATRIX>
+static inline Row<MATRIX> rowOf(const MATRIX& matrix, size_t row) {
+    return Row<MATRIX>{matrix, row};
+}
+
+/**
+ * @brief sum += a(k) * b[k] (K <= k < N) を計算する
+ * k番目の項の乗算を(k-1)番目の項の加算と交互に発行する
+ * @param sum 累積値
+ * @param product (K-1)番目の項の積
+ */
+template<size_t N, size_t K, bool END = (K == N)>
+struct Accumulate {
+    template<class VECTOR>
+    static inline void apply(float& sum, float product, const VECTOR& a, const float (&b)[N]) {
+        float next;
+        float ak = a(K);
+        ACC(sum, product);
+        MUL(next, ak, b[K]);
+        Accumulate<N, K + 1>::apply(sum, next, a, b);
+    }
+};
+
+template<size_t N, size_t K>
+struct Accumulate<N, K, true> {
+    template<class VECTOR>
+    static inline void apply(float& sum, float product, const VECTOR&, const float (&)[N]) {
+        ACC(sum, product);
+    }
+};
+
+/**
+ * @brief sum_k a(k) * b[k] を計算する
+ */
+template<size_t N, class VECTOR>
+static inline float dot(const VECTOR& a, const float (&b)[N]) {
+    static_assert(2 <= N, "N must be at least 2");
+    float sum, product;
+    float a0 = a(0);
+    float a1 = a(1);
+    MUL(sum, a0, b[0]);
+    MUL(product, a1, b[1]);
+    Accumulate<N, 2>::apply(sum, product, a, b);
+    return sum;
+}
+
+/**
+ * @brief c + sum_k a(k) * b[k] を計算する
+ */
+template<size_t N, class VECTOR>
+static inline float dotAdd(float c, const VECTOR& a, const float (&b)[N]) {
+    float sum = c, product;
+    float a0 = a(0);
+    MUL(product, a0, b[0]);
+    Accumulate<N, 1>::apply(sum, product, a, b);
+    return sum;
+}
+
+/**
+ * @brief d[row] += a(row) * m を計算する
+ * row番目の乗算を(row-1)番目の加算と交互に発行する
+ */
+template<size_t N, size_t ROW, bool END = (ROW == N)>
+struct Axpy {
+    template<class VECTOR>
+    static inline void apply(float (&d)[N], float product, const VECTOR& a, float m) {
+        float next;
+        float a_row = a(ROW);
+        MUL(next, a_row, m);
+        ACC(d[ROW - 1], product);
+        Axpy<N, ROW + 1>::apply(d, next, a, m);
+    }
+};
+
+template<size_t N, size_t ROW>
+struct Axpy<N, ROW, true> {
+    template<class VECTOR>
+    static inline void apply(float (&d)[N], float product, const VECTOR&, float) {
+        ACC(d[N - 1], product);
+    }
+};
+
+/// 行列の1列を参照する
+template<class MATRIX>
+struct Column {
+    const MATRIX& matrix;
+    size_t col;
+
+    float operator()(size_t row) const {
+        return matrix(row, col);
+    }
+};
+
+#if defined(FPU_KERNEL_SSE)
+/**
+ * @brief A(row + lane, k) (0 <= lane < 4) を読み出す
+ */
+template<class MATRIX>
+static inline __m128 loadRows(const MATRIX& A, size_t row, size_t k) {
+    return _mm_setr_ps(A(row, k), A(row + 1, k), A(row + 2, k), A(row + 3, k));
+}
+#endif
+
+/**
+ * @brief store(row, init(row) + sum_k A(row, k) * b[k]) を begin <= row < end について行う
+ * FPU_KERNEL_SSEでは独立な4行をパックド命令の4レーンで同時に計算する
+ * 各レーンはdot(), dotAdd()と同じ順で1演算ずつ丸めるので、結果は1行ずつ計算したときとビット単位で一致する
+ * @tparam ADD falseのときはinitを使わずdot()と同じく最初の積から始める
+ * @param init 行ごとの初期値を返す関数
+ * @param store 結果を格納する関数
+ */
+template<bool ADD, class MATRIX_A, size_t N, class INIT, class STORE>
+static inline void dotRows(const MATRIX_A& A, const float (&b)[N], size_t begin, size_t end, INIT init, STORE store) {
+    size_t row = begin;
+#if defined(FPU_KERNEL_SSE)
+    for (; (row + 4) <= end; row += 4) {
+        __m128 sum = _mm_mul_ps(loadRows(A, row, 0), _mm_set1_ps(b[0]));
+        if (ADD) {
+            sum = _mm_add_ps(_mm_setr_ps(init(row), init(row + 1), init(row + 2), init(row + 3)), sum);
+        }
+        for (size_t k = 1; k < N; k++) {
+            sum = _mm_add_ps(sum, _mm_mul_ps(loadRows(A, row, k), _mm_set1_ps(b[k])));
+        }
+        float result[4];
+        _mm_storeu_ps(result, sum);
+        store(row, result[0]);
+        store(row + 1, result[1]);
+        store(row + 2, result[2]);
+        store(row + 3, result[3]);
+    }
+#endif
+    for (; row < end; row++) {
+        store(row, ADD ? dotAdd(init(row), rowOf(A, row), b) : dot(rowOf(A, row), b));
+    }
+}
+
+/// dotRows()で初期値を使わないときのinit
+static inline float noInit(size_t) {
+    return 0.0f;
+}
+
+/**
+ * @brief c - sum_k a(k) * b(k) (begin <= k < end) を計算する
+ * 要素数が実行時に決まる三角行列の積和に使う
+ * k番目の項の乗算を(k-1)番目の項の減算と交互に発行する
+ */
+template<class VECTOR_A, class VECTOR_B>
+static inline float dotSub(float c, const VECTOR_A& a, const VECTOR_B& b, size_t begin, size_t end) {
+    float sum = c;
+    if (begin < end) {
+        float product;
+        float a0 = a(begin);
+        float b0 = b(begin);
+        MUL(product, a0, b0);
+        for (size_t k = begin + 1; k < end; k++) {
+            float next;
+            float ak = a(k);
+            float bk = b(k);
+            SAC(sum, product);
+            MUL(next, ak, bk);
+            product = next;
+        }
+        SAC(sum, product);
+    }
+    return sum;
+}
+
+/**
+ * @brief C = A * B を計算する
+ */
+template<class MATRIX_A, class MATRIX_B, class MATRIX_C>
+static void matmul(const MATRIX_A& A, const MATRIX_B& B, MATRIX_C& C) {
+    constexpr size_t ROWS = Shape<MATRIX_A>::ROWS;
+    constexpr size_t N = Shape<MATRIX_A>::COLS;
+    constexpr size_t COLS = Shape<MATRIX_B>::COLS;
+    static_assert((Shape<MATRIX_B>::ROWS == N) && (Shape<MATRIX_C>::ROWS == ROWS) && (Shape<MATRIX_C>::COLS == COLS), "size mismatch");
+    for (size_t col = 0; col < COLS; col++) {
+        float b[N];
+        for (size_t k = 0; k < N; k++) {
+            b[k] = B(k, col);
+        }
+        dotRows<false>(A, b, 0, ROWS, noInit, [&](size_t row, float value) { C(row, col) = value; });
+    }
+}
+
+/**
+ * @brief C = A * B^T を計算する
+ */
+template<class MATRIX_A, class MATRIX_B, class MATRIX_C>
+static void matmult(const MATRIX_A& A, const MATRIX_B& B, MATRIX_C& C) {
+    constexpr size_t ROWS = Shape<MATRIX_A>::ROWS;
+    constexpr size_t N = Shape<MATRIX_A>::COLS;
+    constexpr size_t COLS = Shape<MATRIX_B>::ROWS;
+    static_assert((Shape<MATRIX_B>::COLS == N) && (Shape<MATRIX_C>::ROWS == ROWS) && (Shape<MATRIX_C>::COLS == COLS), "size mismatch");
+    for (size_t col = 0; col < COLS; col++) {
+        float b[N];
+        for (size_t k = 0; k < N; k++) {
+            b[k] = B(col, k);
+        }
+        dotRows<false>(A, b, 0, ROWS, noInit, [&](size_t row, float value) { C(row, col) = value; });
+    }
+}
+
+/**
+ * @brief C = A * B の下三角部分のみ計算して対称行列を作成する
+ */
+template<class MATRIX_A, class MATRIX_B, size_t N>
+static void matmuls(const MATRIX_A& A, const MATRIX_B& B, SymmetricMatrix<N>& C) {
+    constexpr size_t K = Shape<MATRIX_A>::COLS;
+    static_assert((Shape<MATRIX_A>::ROWS == N) && (Shape<MATRIX_B>::ROWS == K) && (Shape<MATRIX_B>::COLS == N), "size mismatch");
+    for (size_t col = 0; col < N; col++) {
+        float b[K];
+        for (size_t k = 0; k < K; k++) {
+            b[k] = B(k, col);
+        }
+        dotRows<false>(A, b, col, N, noInit, [&](size_t row, float value) { C(row, col) = value; });
+    }
+}
+
+/**
+ * @brief D = C + A * B^T の下三角部分のみ計算して対称行列を作成する
+ */
+template<class MATRIX_A, class MATRIX_B, size_t N>
+static void matmultadds(const MATRIX_A& A, const MATRIX_B& B, const SymmetricMatrix<N>& C, SymmetricMatrix<N>& D) {
+    constexpr size_t K = Shape<MATRIX_A>::COLS;
+    static_assert((Shape<MATRIX_A>::ROWS == N) && (Shape<MATRIX_B>::ROWS == N) && (Shape<MATRIX_B>::COLS == K), "size mismatch");
+    for (size_t col = 0; col < N; col++) {
+        float b[K];
+        for (size_t k = 0; k < K; k++) {
+            b[k] = B(col, k);
+        }
+        dotRows<true>(A, b, col, N, [&](size_t row) { return C(row, col); }, [&](size_t row, float value) { D(row, col) = value; });
+    }
+}
+
+/**
+ * @brief A * B * A^T を計算する。Bは対称行列
+ * @param B_AT B * A^T
+ */
+template<class MATRIX_A, size_t N, size_t M, class MATRIX_B_AT>
+static inline void matmulmult(const MATRIX_A& A, const SymmetricMatrix<N>& B, SymmetricMatrix<M>& A_B_AT, MATRIX_B_AT& B_AT) {
+    matmult(B, A, B_AT);
+    matmuls(A, B_AT, A_B_AT);
+}
+
+/**
+ * @brief A * B * A^T を計算する。Bは対称行列
+ */
+template<class MATRIX_A, size_t N, size_t M>
+static inline void matmulmult(const MATRIX_A& A, const SymmetricMatrix<N>& B, SymmetricMatrix<M>& A_B_AT) {
+    Eigen::Matrix<float, N, M> B_AT;
+    matmulmult(A, B, A_B_AT, B_AT);
+}
+
+/**
+ * @brief 対称行列の逆行列を計算する。符号を反転する
+ * LとinvLは下三角行列として扱う
+ */
+template<size_t N>
+static inline void invmuls(const SymmetricMatrix<N>& A, SymmetricMatrix<N>& L, SymmetricMatrix<N>& invL, SymmetricMatrix<N>& invA) {
+    // コレスキー分解する
+    for (size_t row = 0; row < N; row++) {
+        for (size_t col = 0;;) {
+            float sum = dotSub(A(row, col), rowOf(L, row), rowOf(L, col), 0, col);
+            if (row != col) {
+                L(row, col) = sum * invL(col, col);
+                col++;
+            }
+            else {
+                L(row, col) = fpu::sqrt(sum);
+                invL(row, col) = 1.0f / L(row, col);
+                break;
+            }
+        }
+    }
+
+    // 下三角行列の逆行列を計算する
+    for (size_t col = 0; col < (N - 1); col++) {
+        for (size_t row = col + 1; row < N; row++) {
+            float sum = dotSub(0.0f, rowOf(L, row), Column<SymmetricMatrix<N>>{invL, col}, col, row);
+            invL(row, col) = sum * invL(row, row);
+        }
+    }
+
+    // A^-1 = -L^-T * L^-1 の下三角部分を計算する
+    for (size_t col = 0; col < N; col++) {
+        for (size_t row = col; row < N; row++) {
+            invA(row, col) = dotSub(0.0f, Column<SymmetricMatrix<N>>{invL, row}, Column<SymmetricMatrix<N>>{invL, col}, row, N);
+        }
+    }
+}
+
+/**
+ * @brief d = A * b + c を計算する
+ */
+template<class MATRIX_A, class VECTOR_B, class VECTOR_C, class VECTOR_D>
+static inline void matmuladdvec(const MATRIX_A& A, const VECTOR_B& b, const VECTOR_C& c, VECTOR_D& d) {
+    constexpr size_t ROWS = Shape<MATRIX_A>::ROWS;
+    constexpr size_t COLS = Shape<MATRIX_A>::COLS;
+    static_assert(2 <= ROWS, "ROWS must be at least 2");
+#if defined(FPU_KERNEL_SSE)
+    float v[COLS];
+    for (size_t col = 0; col < COLS; col++) {
+        v[col] = b(col);
+    }
+    dotRows<true>(A, v, 0, ROWS, [&](size_t row) { return c(row); }, [&](size_t row, float value) { d(row) = value; });
+#else
+    float sum[ROWS];
+    for (size_t row = 0; row < ROWS; row++) {
+        sum[row] = c(row);
+    }
+    for (size_t col = 0; col < COLS; col++) {
+        float product;
+        float m = b(col);
+        float a0 = A(0, col);
+        MUL(product, a0, m);
+        Axpy<ROWS, 1>::apply(sum, product, Column<MATRIX_A>{A, col}, m);
+    }
+    for (size_t row = 0; row < ROWS; row++) {
+        d(row) = sum[row];
+    }
+#endif
+}
+
+/**
+ * @brief d = A * b を計算する
+ * bを先に読み出すので、dはbと同じでもよい
+ */
+template<class MATRIX_A, class VECTOR_B, class VECTOR_D>
+static inline void matmulvec(const MATRIX_A& A, const VECTOR_B& b, VECTOR_D& d) {
+    constexpr size_t ROWS = Shape<MATRIX_A>::ROWS;
+    constexpr size_t COLS = Shape<MATRIX_A>::COLS;
+    float v[COLS];
+    for (size_t col = 0; col < COLS; col++) {
+        v[col] = b(col);
+    }
+    dotRows<false>(A, v, 0, ROWS, noInit, [&](size_t row, float value) { d(row) = value; });
+}
+
+}
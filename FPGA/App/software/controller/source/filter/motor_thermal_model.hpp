@@ -0,0 +1,79 @@
+/**
+ * @file motor_thermal_model.hpp
+ * @author Fujii Naomichi
+ * @copyright (c) 2021 Fujii Naomichi
+ * SPDX-License-Identifier: MIT
+ */
+
+#pragma once
+
+#include <fpu.hpp>
+#include <Eigen/Core>
+#include "board.hpp"
+
+/**
+ * @brief 各モーターの巻線の温度上昇をI^2tモデルで推定し、電流の上限値を求める
+ * 温度上昇は銅損 R * (Id^2 + Iq^2) を入力とする1次遅れで近似し、CONTINUOUS_CURRENTを流し続けたときの定常値を1に正規化する
+ * 巻線が冷えている間はBURST_CURRENTまで流せるようにし、温度上昇がDERATING_STARTから1に近づくにつれてCONTINUOUS_CURRENTまで下げる
+ */
+class MotorThermalModel {
+public:
+    /// モーターの数
+    static constexpr int MOTORS = 4;
+
+    /// 連続して流せる電流 [A]
+    static constexpr float CONTINUOUS_CURRENT = 3.0f;
+
+    /// 巻線が冷えているときに流せる電流 [A]
+    static constexpr float BURST_CURRENT = 4.5f;
+
+    /// 巻線の熱時定数 [s]
+    static constexpr float THERMAL_TIME_CONSTANT = 20.0f;
+
+    /// 電流の上限値を下げ始める温度上昇 (CONTINUOUS_CURRENTの定常値を1とする)
+    static constexpr float DERATING_START = 0.5f;
+
+    /**
+     * @brief 巻線の温度上昇を0にする
+     */
+    void reset(void) {
+        _temperature_rise.setZero();
+    }
+
+    /**
+     * @brief 測定した電流から巻線の温度上昇を更新する
+     * @param current_d 各モーターのd軸電流 [A]
+     * @param current_q 各モーターのq軸電流 [A]
+     * @param period 制御周期 [s]
+     */
+    void update(const Eigen::Vector4f& current_d, const Eigen::Vector4f& current_q, float period) {
+        static constexpr float RATED_LOSS = MOTOR_RESISTANCE * CONTINUOUS_CURRENT * CONTINUOUS_CURRENT;
+        float k = period * (1.0f / THERMAL_TIME_CONSTANT);
+        for (int i = 0; i < MOTORS; i++) {
+            float loss = MOTOR_RESISTANCE * (current_d[i] * current_d[i] + current_q[i] * current_q[i]);
+            _temperature_rise[i] += k * (loss * (1.0f / RATED_LOSS) - _temperature_rise[i]);
+        }
+    }
+
+    /**
+     * @brief 巻線の温度上昇から電流の上限値を求める
+     * @param index モーターの番号 (0～3)
+     * @return 電流の上限値 [A]
+     */
+    float currentCeiling(int index) const {
+        float ratio = (1.0f - _temperature_rise[index]) * (1.0f / (1.0f - DERATING_START));
+        return CONTINUOUS_CURRENT + (BURST_CURRENT - CONTINUOUS_CURRENT) * fpu::clamp(ratio, 0.0f, 1.0f);
+    }
+
+    /**
+     * @brief 巻線の温度上昇を取得する
+     * @return 各モーターの温度上昇 (CONTINUOUS_CURRENTの定常値を1とする)
+     */
+    const Eigen::Vector4f& temperatureRise(void) const {
+        return _temperature_rise;
+    }
+
+private:
+    /// 各モーターの巻線の温度上昇 (CONTINUOUS_CURRENTの定常値を1とする)
+    Eigen::Vector4f _temperature_rise;
+};
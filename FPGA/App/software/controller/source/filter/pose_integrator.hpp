@@ -0,0 +1,127 @@
+/**
+ * @file pose_integrator.hpp
+ * @author Fujii Naomichi
+ * @copyright (c) 2021 Fujii Naomichi
+ * SPDX-License-Identifier: MIT
+ */
+
+#pragma once
+
+#include <math.h>
+#include <fpu.hpp>
+#include <Eigen/Core>
+
+/**
+ * @brief 車体速度と角速度を制御周期ごとに積分して自己位置を求める
+ * 三角関数を毎回計算しないように、向きは単位ベクトル(cosθ, sinθ)を微小角だけ回転させて更新し、長さを1に正規化する
+ * 並進速度は周期の中間の向きで座標変換する
+ */
+class PoseIntegrator {
+public:
+    /// 円周率
+    static constexpr float PI = static_cast<float>(M_PI);
+
+    /// reset()で受け付ける向きの絶対値の最大値 [rad] (2πの倍数を引くときの丸め誤差を1e-6rad程度に抑える)
+    static constexpr float MAX_RESET_ANGLE = 8 * PI;
+
+    /**
+     * @brief 自己位置を設定する
+     * @param x X座標 [m]
+     * @param y Y座標 [m]
+     * @param theta 向き [rad]
+     * @return 有限の値で向きの絶対値がMAX_RESET_ANGLE以下ならtrue (falseのときは自己位置を変更しない)
+     */
+    bool reset(float x, float y, float theta) {
+        // -ffast-mathではisfinite()が常にtrueになるのでビットで調べ、有限と分かってから向きの範囲を比べる
+        if (!fpu::isFinite(x) || !fpu::isFinite(y) || !fpu::isFinite(theta) || (MAX_RESET_ANGLE < fabsf(theta))) {
+            return false;
+        }
+
+        // 2πの倍数を引いて-π～πの範囲に収める
+        float turns = static_cast<float>(fpu::round(theta * (0.5f / PI)));
+        float angle = theta - turns * (2 * PI);
+        _pose << x, y, angle;
+
+        // さらにπ/2の倍数を引いて-π/4～π/4の範囲でテイラー展開し、象限に合わせて回転する
+        // 9次までの展開の誤差は最大で3e-7程度
+        int quadrant = fpu::round(angle * (2.0f / PI));
+        float r = angle - static_cast<float>(quadrant) * (0.5f * PI);
+        float r_2 = r * r;
+        float c = 1.0f - r_2 * (1.0f / 2) * (1.0f - r_2 * (1.0f / 12) * (1.0f - r_2 * (1.0f / 30) * (1.0f - r_2 * (1.0f / 56))));
+        float s = r * (1.0f - r_2 * (1.0f / 6) * (1.0f - r_2 * (1.0f / 20) * (1.0f - r_2 * (1.0f / 42) * (1.0f - r_2 * (1.0f / 72)))));
+        switch (quadrant & 3) {
+        case 0:
+            _heading << c, s;
+            break;
+        case 1:
+            _heading << -s, c;
+            break;
+        case 2:
+            _heading << -c, -s;
+            break;
+        default:
+            _heading << s, -c;
+            break;
+        }
+        return true;
+    }
+
+    /**
+     * @brief 1制御周期分の移動を積分する
+     * @param body_velocity 車体速度 X [m/s], Y [m/s] (車体座標系)
+     * @param omega 角速度 [rad/s]
+     * @param period 制御周期 [s]
+     */
+    void update(const Eigen::Vector2f& body_velocity, float omega, float period) {
+        // 半周期分の回転を求める
+        // 回転角は制御周期あたり0.02rad程度なので3次までのテイラー展開で十分な精度がある
+        float half_angle = 0.5f * omega * period;
+        float half_angle_2 = half_angle * half_angle;
+        float half_cos = 1.0f - 0.5f * half_angle_2;
+        float half_sin = half_angle * (1.0f - half_angle_2 * (1.0f / 6));
+        auto rotate = [half_cos, half_sin](const Eigen::Vector2f& v) -> Eigen::Vector2f {
+            return {v[0] * half_cos - v[1] * half_sin, v[0] * half_sin + v[1] * half_cos};
+        };
+
+        // 中間の向きで車体速度を座標変換して位置を進める
+        Eigen::Vector2f middle = rotate(_heading);
+        _pose[0] += (middle[0] * body_velocity[0] - middle[1] * body_velocity[1]) * period;
+        _pose[1] += (middle[1] * body_velocity[0] + middle[0] * body_velocity[1]) * period;
+
+        // 向きを進めて正規化する
+        Eigen::Vector2f heading = rotate(middle);
+        float norm_2 = heading.squaredNorm();
+        _heading = heading * (1.0f / fpu::sqrt(norm_2));
+        _pose[2] = wrapAngle(_pose[2] + 2.0f * half_angle);
+    }
+
+    /**
+     * @brief 自己位置を取得する
+     * @return X [m], Y [m], θ [rad] (θは-π～πの範囲)
+     */
+    const Eigen::Vector3f& pose(void) const {
+        return _pose;
+    }
+
+private:
+    /**
+     * @brief 角度を-π～πの範囲に収める
+     * @param angle 角度 [rad]
+     * @return -π～πの範囲の角度 [rad]
+     */
+    static float wrapAngle(float angle) {
+        if (PI < angle) {
+            angle -= 2 * PI;
+        }
+        else if (angle < -PI) {
+            angle += 2 * PI;
+        }
+        return angle;
+    }
+
+    /// 自己位置 X [m], Y [m], θ [rad]
+    Eigen::Vector3f _pose;
+
+    /// 向きの単位ベクトル (cosθ, sinθ)
+    Eigen::Vector2f _heading;
+};
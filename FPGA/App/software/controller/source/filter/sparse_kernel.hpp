@@ -0,0 +1,341 @@
+/**
+ * @file sparse_kernel.hpp
+ * @author Fujii Naomichi
+ * @copyright (c) 2021 Fujii Naomichi
+ * SPDX-License-Identifier: MIT
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <Eigen/Core>
+#include "fpu_kernel.hpp"
+#include "symmetric_matrix.hpp"
+
+/**
+ * @brief 構造が既知の疎行列との積を計算する
+ * 行列の構造は次のようなクラスで記述する。0の要素と1の要素はコンパイル時に省略されるので読み出されない
+ * @code
+ * struct Pattern {
+ *     static constexpr size_t ROWS = 7;
+ *     static constexpr size_t COLS = 7;
+ *     static constexpr sparse::Element_t element(size_t row, size_t col) { ... }
+ * };
+ * @endcode
+ */
+namespace sparse {
+
+/// 行列の要素の種類
+enum Element_t {
+    /// 常に0
+    ElementZero,
+
+    /// 常に1
+    ElementOne,
+
+    /// 実行時に値が決まる
+    ElementVariable,
+};
+
+/**
+ * @brief 疎行列の0でない要素の数を数える
+ * @tparam PATTERN 行列の構造
+ * @return 0でない要素の数
+ */
+template<class PATTERN>
+static constexpr size_t countNonZero(void) {
+    size_t count = 0;
+    for (size_t row = 0; row < PATTERN::ROWS; row++) {
+        for (size_t col = 0; col < PATTERN::COLS; col++) {
+            if (PATTERN::element(row, col) != ElementZero) {
+                count++;
+            }
+        }
+    }
+    return count;
+}
+
+/**
+ * @brief 疎行列の値が実行時に決まる要素の数を数える
+ * @tparam PATTERN 行列の構造
+ * @return 値が実行時に決まる要素の数 (積に必要な乗算の数)
+ */
+template<class PATTERN>
+static constexpr size_t countVariable(void) {
+    size_t count = 0;
+    for (size_t row = 0; row < PATTERN::ROWS; row++) {
+        for (size_t col = 0; col < PATTERN::COLS; col++) {
+            if (PATTERN::element(row, col) == ElementVariable) {
+                count++;
+            }
+        }
+    }
+    return count;
+}
+
+/**
+ * @brief A(row, col)以降で最初に0でない要素の列を求める
+ * @tparam PATTERN Aの構造
+ * @return 列 (0でない要素が無いときはPATTERN::COLS)
+ */
+template<class PATTERN>
+static constexpr size_t nextNonZero(size_t row, size_t col) {
+    while ((col < PATTERN::COLS) && (PATTERN::element(row, col) == ElementZero)) {
+        col++;
+    }
+    return col;
+}
+
+/// x * A(row, col) の項を要素の種類に応じて計算する
+template<class VECTOR, class MATRIX>
+static inline float term(const VECTOR& x, const MATRIX&, size_t, size_t col, std::integral_constant<Element_t, ElementOne>) {
+    return x[col];
+}
+
+template<class VECTOR, class MATRIX>
+static inline float term(const VECTOR& x, const MATRIX& a, size_t row, size_t col, std::integral_constant<Element_t, ElementVariable>) {
+    float product;
+    float xk = x[col];
+    float ak = a(row, col);
+    MUL(product, xk, ak);
+    return product;
+}
+
+/// sum += product を計算してから x * A(row, col) の項を計算する。乗算の前に要素を読み出して加算と交互に発行する
+template<class VECTOR, class MATRIX>
+static inline float accumulateTerm(float& sum, float product, const VECTOR& x, const MATRIX&, size_t, size_t col, std::integral_constant<Element_t, ElementOne>) {
+    float next = x[col];
+    ACC(sum, product);
+    return next;
+}
+
+template<class VECTOR, class MATRIX>
+static inline float accumulateTerm(float& sum, float product, const VECTOR& x, const MATRIX& a, size_t row, size_t col, std::integral_constant<Element_t, ElementVariable>) {
+    float next;
+    float xk = x[col];
+    float ak = a(row, col);
+    ACC(sum, product);
+    MUL(next, xk, ak);
+    return next;
+}
+
+/**
+ * @brief sum += product + sum_k x[k] * A(ROW, k) (COL <= k) を計算する
+ * k番目の項の乗算を直前の項の加算と交互に発行する
+ * @tparam PATTERN Aの構造
+ * @tparam ROW Aの行
+ * @tparam COL 次に計算する0でない要素の列
+ */
+template<class PATTERN, size_t ROW, size_t COL, bool END = (COL == PATTERN::COLS)>
+struct RowAccumulate {
+    template<class VECTOR, class MATRIX>
+    static inline void apply(float& sum, float product, const VECTOR& x, const MATRIX& a) {
+        float next = accumulateTerm(sum, product, x, a, ROW, COL, std::integral_constant<Element_t, PATTERN::element(ROW, COL)>());
+        RowAccumulate<PATTERN, ROW, nextNonZero<PATTERN>(ROW, COL + 1)>::apply(sum, next, x, a);
+    }
+};
+
+template<class PATTERN, size_t ROW, size_t COL>
+struct RowAccumulate<PATTERN, ROW, COL, true> {
+    template<class VECTOR, class MATRIX>
+    static inline void apply(float& sum, float product, const VECTOR&, const MATRIX&) {
+        ACC(sum, product);
+    }
+};
+
+/**
+ * @brief sum_k x[k] * A(ROW, k) を計算する
+ * 0の要素を除いた項をkernel::dot()と同じように読み出し・MUL・ACCを交互に発行して計算する
+ * @tparam PATTERN Aの構造
+ * @tparam ROW Aの行
+ */
+template<class PATTERN, size_t ROW,
+         size_t FIRST = nextNonZero<PATTERN>(ROW, 0),
+         size_t SECOND = (FIRST == PATTERN::COLS) ? PATTERN::COLS : nextNonZero<PATTERN>(ROW, FIRST + 1),
+         int TERMS = (FIRST == PATTERN::COLS) ? 0 : ((SECOND == PATTERN::COLS) ? 1 : 2)>
+struct RowDot {
+    /**
+     * @param x ベクトル (x[k]で要素を読み出せるもの)。Aの0の要素に対応する要素は使われない
+     * @param a 疎行列
+     */
+    template<class VECTOR, class MATRIX>
+    static inline float apply(const VECTOR& x, const MATRIX& a) {
+        float sum = term(x, a, ROW, FIRST, std::integral_constant<Element_t, PATTERN::element(ROW, FIRST)>());
+        float product = term(x, a, ROW, SECOND, std::integral_constant<Element_t, PATTERN::element(ROW, SECOND)>());
+        RowAccumulate<PATTERN, ROW, nextNonZero<PATTERN>(ROW, SECOND + 1)>::apply(sum, product, x, a);
+        return sum;
+    }
+};
+
+/// 0でない要素が1個の行
+template<class PATTERN, size_t ROW, size_t FIRST, size_t SECOND>
+struct RowDot<PATTERN, ROW, FIRST, SECOND, 1> {
+    template<class VECTOR, class MATRIX>
+    static inline float apply(const VECTOR& x, const MATRIX& a) {
+        return term(x, a, ROW, FIRST, std::integral_constant<Element_t, PATTERN::element(ROW, FIRST)>());
+    }
+};
+
+/// 0でない要素が無い行
+template<class PATTERN, size_t ROW, size_t FIRST, size_t SECOND>
+struct RowDot<PATTERN, ROW, FIRST, SECOND, 0> {
+    template<class VECTOR, class MATRIX>
+    static inline float apply(const VECTOR&, const MATRIX&) {
+        return 0.0f;
+    }
+};
+
+/**
+ * @brief 疎行列の行ごとの0でない要素の列の表
+ * RowDotのように行ごとに展開せず、実行時に表を引いて積を計算するために使う
+ * @tparam PATTERN 行列の構造
+ */
+template<class PATTERN>
+struct RowIndex {
+    /// row行目の0でない要素の列はcols[begin[row]]～cols[begin[row + 1] - 1]
+    uint8_t begin[PATTERN::ROWS + 1];
+
+    /// 0でない要素の列
+    uint8_t cols[countNonZero<PATTERN>()];
+};
+
+/**
+ * @brief 疎行列の行ごとの0でない要素の列の表を作る
+ * @tparam PATTERN 行列の構造
+ * @return 表
+ */
+template<class PATTERN>
+static constexpr RowIndex<PATTERN> makeRowIndex(void) {
+    RowIndex<PATTERN> index = {};
+    size_t count = 0;
+    for (size_t row = 0; row < PATTERN::ROWS; row++) {
+        index.begin[row] = static_cast<uint8_t>(count);
+        for (size_t col = 0; col < PATTERN::COLS; col++) {
+            if (PATTERN::element(row, col) != ElementZero) {
+                index.cols[count++] = static_cast<uint8_t>(col);
+            }
+        }
+    }
+    index.begin[PATTERN::ROWS] = static_cast<uint8_t>(count);
+    return index;
+}
+
+/**
+ * @brief c + sum_k x[k] * A(row, k) を表に載っている0でない要素のみについて計算する
+ * 行ごとに展開しないのでRowDotよりコードが小さい。1の要素もAに格納されていること
+ * k番目の項の乗算を直前の項の加算と交互に発行する
+ * @param index Aの0でない要素の列の表
+ * @param row Aの行
+ * @param c 加える値
+ * @param x ベクトル (x[k]で要素を読み出せるもの)
+ * @param a 疎行列
+ */
+template<class PATTERN, class VECTOR, class MATRIX>
+static inline float rowDotAdd(const RowIndex<PATTERN>& index, size_t row, float c, const VECTOR& x, const MATRIX& a) {
+    const uint8_t* col = &index.cols[index.begin[row]];
+    const uint8_t* end = &index.cols[index.begin[row + 1]];
+    float sum = c;
+    if (col != end) {
+        float product;
+        size_t k = *col++;
+        float xk = x[k];
+        float ak = a(row, k);
+        MUL(product, xk, ak);
+        while (col != end) {
+            float next;
+            k = *col++;
+            xk = x[k];
+            ak = a(row, k);
+            ACC(sum, product);
+            MUL(next, xk, ak);
+            product = next;
+        }
+        ACC(sum, product);
+    }
+    return sum;
+}
+
+/**
+ * @brief 対称行列の1行をベクトルとして参照する
+ */
+template<size_t N>
+struct SymmetricRow {
+    const SymmetricMatrix<N>& matrix;
+    size_t row;
+
+    float operator[](size_t col) const {
+        return matrix(row, col);
+    }
+};
+
+/**
+ * @brief Aの行ごとに展開される処理
+ * @tparam PATTERN Aの構造
+ * @tparam ROW Aの行
+ */
+template<class PATTERN, size_t ROW = 0, bool END = (ROW == PATTERN::ROWS)>
+struct Rows {
+    /// C(row, ROW) = sum_k x[k] * A(ROW, k) をAのすべての行について計算する
+    template<class MATRIX, class RESULT>
+    static inline void multTransposedRow(const float (&x)[PATTERN::COLS], const MATRIX& a, RESULT& c, size_t row) {
+        c(row, ROW) = RowDot<PATTERN, ROW>::apply(x, a);
+        Rows<PATTERN, ROW + 1>::multTransposedRow(x, a, c, row);
+    }
+
+    /// C(ROW, col) = sum_k A(ROW, k) * B(k, col) の下三角部分をAのすべての行について計算する
+    template<class MATRIX, class RESULT, size_t N>
+    static inline void multSymmetric(const MATRIX& a, const RESULT& b, SymmetricMatrix<N>& c) {
+        for (size_t col = 0; col <= ROW; col++) {
+            const float* b_col = &b(0, col);
+            c(ROW, col) = RowDot<PATTERN, ROW>::apply(b_col, a);
+        }
+        Rows<PATTERN, ROW + 1>::multSymmetric(a, b, c);
+    }
+};
+
+template<class PATTERN, size_t ROW>
+struct Rows<PATTERN, ROW, true> {
+    template<class MATRIX, class RESULT>
+    static inline void multTransposedRow(const float (&)[PATTERN::COLS], const MATRIX&, RESULT&, size_t) {}
+
+    template<class MATRIX, class RESULT, size_t N>
+    static inline void multSymmetric(const MATRIX&, const RESULT&, SymmetricMatrix<N>&) {}
+};
+
+/**
+ * @brief C = S * A^T を計算する
+ * @tparam PATTERN Aの構造
+ * @param S 対称行列
+ * @param A 疎行列
+ * @param C 結果 (列優先で格納されていること)
+ */
+template<class PATTERN, size_t N, class MATRIX, class RESULT>
+static inline void multTransposed(const SymmetricMatrix<N>& S, const MATRIX& A, RESULT& C) {
+    static_assert(PATTERN::COLS == N, "size mismatch");
+    for (size_t row = 0; row < N; row++) {
+        float s[N];
+        for (size_t k = 0; k < N; k++) {
+            s[k] = S(row, k);
+        }
+        Rows<PATTERN>::multTransposedRow(s, A, C, row);
+    }
+}
+
+/**
+ * @brief A * S * A^T を計算する
+ * @tparam PATTERN Aの構造
+ * @param A 疎行列
+ * @param S 対称行列
+ * @param A_S_AT 結果
+ * @param S_AT S * A^T (列優先で格納されていること)
+ */
+template<class PATTERN, size_t N, class MATRIX, class RESULT>
+static inline void multMultTransposed(const MATRIX& A, const SymmetricMatrix<N>& S, SymmetricMatrix<PATTERN::ROWS>& A_S_AT, RESULT& S_AT) {
+    static_assert(!RESULT::IsRowMajor, "S_AT must be column major");
+    multTransposed<PATTERN>(S, A, S_AT);
+    Rows<PATTERN>::multSymmetric(A, S_AT, A_S_AT);
+}
+
+}
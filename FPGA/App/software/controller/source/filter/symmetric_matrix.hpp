@@ -0,0 +1,43 @@
+/**
+ * @file symmetric_matrix.hpp
+ * @author Fujii Naomichi
+ * @copyright (c) 2021 Fujii Naomichi
+ * SPDX-License-Identifier: MIT
+ */
+
+#pragma once
+
+#include <cstddef>
+
+/**
+ * @brief 対称行列の下三角部分のみを行優先で詰めて格納する
+ * 要素(row, col)と要素(col, row)は同じ場所を指すので、下三角行列の格納にも使える
+ * @tparam N 行数および列数
+ */
+template<size_t N>
+class SymmetricMatrix {
+public:
+    /// 格納する要素の数
+    static constexpr size_t SIZE = N * (N + 1) / 2;
+
+    /**
+     * @brief 要素の格納位置を求める
+     * @param row 行
+     * @param col 列
+     * @return 格納位置
+     */
+    static constexpr size_t index(size_t row, size_t col) {
+        return (col <= row) ? (row * (row + 1) / 2 + col) : (col * (col + 1) / 2 + row);
+    }
+
+    float& operator()(size_t row, size_t col) {
+        return data[index(row, col)];
+    }
+
+    float operator()(size_t row, size_t col) const {
+        return data[index(row, col)];
+    }
+
+    /// 要素
+    float data[SIZE];
+};
@@ -0,0 +1,134 @@
+/**
+ * @file traction_limitter.hpp
+ * @author Fujii Naomichi
+ * @copyright (c) 2021 Fujii Naomichi
+ * SPDX-License-Identifier: MIT
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <math.h>
+#include <fpu.hpp>
+#include <Eigen/Core>
+#include "board.hpp"
+
+/**
+ * @brief 速度フィルタが推定した摩擦係数から各車輪の電流制限値を下げてスリップを抑える
+ * 速度フィルタのモデルでは車輪が路面に伝える力は 摩擦係数kf * 滑り速度 なので、滑り速度をSLIP_VELOCITY_LIMIT以下に
+ * 保てる力は kf * SLIP_VELOCITY_LIMIT であり、それを出す電流は WHEEL_RADIUS / MOTOR_TORQUE_CONSTANT を掛けたものになる
+ * 摩擦係数は車輪が力を出して滑っているときにしか観測できないので、滑り速度がSLIP_VELOCITY_ONSETを超えた車輪だけを制限する
+ */
+class TractionLimitter {
+public:
+    /// 車輪の数
+    static constexpr int WHEELS = 4;
+
+    /// 車輪ごとのスリップの状態のビット (車輪iのビットは (SlipState_t << (SLIP_STATE_BITS * i)))
+    enum SlipState_t : uint32_t {
+        /// 摩擦係数から求めた電流制限値で制限した
+        SlipStateLimited = 1u << 0,
+
+        /// 滑り速度がSLIP_VELOCITY_LIMITを超えた
+        SlipStateSlipping = 1u << 1,
+    };
+
+    /// 1車輪あたりのスリップの状態のビット数
+    static constexpr int SLIP_STATE_BITS = 2;
+
+    /// 制限を始める滑り速度 [m/s]
+    static constexpr float SLIP_VELOCITY_ONSET = 0.05f;
+
+    /// 許容する滑り速度 [m/s]
+    static constexpr float SLIP_VELOCITY_LIMIT = 0.1f;
+
+    /// 制限を解除するときの電流制限値の増加率 [A/s]
+    static constexpr float RELEASE_RATE = 20.0f;
+
+    /// 制限していないときの電流制限値 [A]
+    static constexpr float UNLIMITED_CURRENT = 100.0f;
+
+    /// 前回clearStatistics()を呼んでからの統計値
+    struct Statistics_t {
+        /// 各車輪のスリップの状態の論理和
+        uint32_t slip_state;
+
+        /// 各車輪の滑り速度の絶対値の最大値 [m/s]
+        float max_slip_velocity[WHEELS];
+
+        /// 各車輪の摩擦係数から求めた電流制限値の最小値 [A]
+        float min_current_limit[WHEELS];
+    };
+
+    /**
+     * @brief 内部状態をリセットする
+     */
+    void reset(void) {
+        for (int i = 0; i < WHEELS; i++) {
+            _current_limit[i] = UNLIMITED_CURRENT;
+        }
+        clearStatistics();
+    }
+
+    /**
+     * @brief 電流制限値を摩擦係数から求めた値以下に下げる
+     * @param friction_coefficients 速度フィルタが推定した摩擦係数 [Ns]
+     * @param slip_velocity 各車輪の滑り速度 [m/s] (符号は問わない)
+     * @param period 制御周期 [s]
+     * @param current_limit 各車輪の電流制限値 [A] (下げた値で上書きする)
+     */
+    void update(const Eigen::Vector4f& friction_coefficients, const Eigen::Vector4f& slip_velocity, float period, Eigen::Vector4f& current_limit) {
+        static constexpr float CURRENT_PER_FRICTION = SLIP_VELOCITY_LIMIT * WHEEL_RADIUS / MOTOR_TORQUE_CONSTANT;
+        float release = RELEASE_RATE * period;
+        uint32_t slip_state = 0;
+        for (int i = 0; i < WHEELS; i++) {
+            // 滑り始めた車輪は摩擦係数から求めた値まで直ちに下げ、そうでない車輪はゆっくり戻す
+            float slip = fabsf(slip_velocity[i]);
+            float limit = fpu::min(_current_limit[i] + release, UNLIMITED_CURRENT);
+            if (SLIP_VELOCITY_ONSET < slip) {
+                limit = fpu::min(limit, CURRENT_PER_FRICTION * friction_coefficients[i]);
+            }
+            _current_limit[i] = limit;
+
+            // 統計値を更新する
+            uint32_t state = 0;
+            if (limit < current_limit[i]) {
+                current_limit[i] = limit;
+                state |= SlipStateLimited;
+            }
+            if (SLIP_VELOCITY_LIMIT < slip) {
+                state |= SlipStateSlipping;
+            }
+            slip_state |= state << (SLIP_STATE_BITS * i);
+            _statistics.max_slip_velocity[i] = fpu::max(_statistics.max_slip_velocity[i], slip);
+            _statistics.min_current_limit[i] = fpu::min(_statistics.min_current_limit[i], limit);
+        }
+        _statistics.slip_state |= slip_state;
+    }
+
+    /**
+     * @brief 前回clearStatistics()を呼んでからの統計値を取得する
+     * @return 統計値
+     */
+    const Statistics_t& statistics(void) const {
+        return _statistics;
+    }
+
+    /**
+     * @brief 統計値をクリアする
+     */
+    void clearStatistics(void) {
+        _statistics.slip_state = 0;
+        for (int i = 0; i < WHEELS; i++) {
+            _statistics.max_slip_velocity[i] = 0.0f;
+            _statistics.min_current_limit[i] = UNLIMITED_CURRENT;
+        }
+    }
+
+private:
+    /// 摩擦係数から求めた各車輪の電流制限値 [A]
+    float _current_limit[WHEELS];
+
+    /// 統計値
+    Statistics_t _statistics;
+};
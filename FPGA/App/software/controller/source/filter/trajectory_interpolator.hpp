@@ -0,0 +1,118 @@
+/**
+ * @file trajectory_interpolator.hpp
+ * @author Fujii Naomichi
+ * @copyright (c) 2021 Fujii Naomichi
+ * SPDX-License-Identifier: MIT
+ */
+
+#pragma once
+
+#include <fpu.hpp>
+#include <Eigen/Core>
+#include <shared_memory.hpp>
+
+/**
+ * @brief 共有メモリーの軌道の経由点を補間して制御周期ごとの目標車体速度を求める
+ * 経由点の間は両端の速度と加速度から3次エルミート補間を行うので、速度とその微分が連続になる
+ */
+class TrajectoryInterpolator {
+public:
+    /// 経由点の最大数
+    static constexpr int SIZE = SharedMemory::Parameters::TRAJECTORY_SIZE;
+
+    /**
+     * @brief 内部状態をリセットする
+     */
+    void reset(void) {
+        _time = 0.0f;
+        _index = 0;
+        _valid = true;
+    }
+
+    /**
+     * @brief 新しいParametersを受け取ったときに時刻を0に戻し、経由点を検査する
+     * @param parameters 共有メモリーから読み出したParameters
+     * @return 経由点が正しければtrue
+     */
+    bool restart(const SharedMemory::Parameters& parameters) {
+        reset();
+        int count = static_cast<int>(parameters.trajectory_count);
+        if ((count < 0) || (SIZE < count)) {
+            _valid = false;
+        }
+        else if (0 < count) {
+            // 時刻と速度と加速度が全て有限で、時刻が狭義単調増加していることを確認する
+            // -ffast-mathではisfinite()が常にtrueになるのでビットで調べ、有限と分かった値だけを比べる
+            for (int index = 0; index < count; index++) {
+                const SharedMemory::Parameters::TrajectoryPoint& point = parameters.trajectory[index];
+                _valid &= fpu::isFinite(point.time);
+                for (int axis = 0; axis < 3; axis++) {
+                    _valid &= fpu::isFinite(point.speed[axis]) && fpu::isFinite(point.accel[axis]);
+                }
+            }
+            for (int index = 1; _valid && (index < count); index++) {
+                _valid &= (parameters.trajectory[index - 1].time < parameters.trajectory[index].time);
+            }
+        }
+        return _valid;
+    }
+
+    /**
+     * @brief 現在の時刻の目標車体速度を求めて時刻を1制御周期進める
+     * 経由点がないときはspeed_x, speed_y, speed_omegaをそのまま使う
+     * @param parameters restart()に与えたものと同じParameters
+     * @param period 制御周期 [s]
+     * @param velocity 目標車体速度 X [m/s], Y [m/s], ω [rad/s]
+     * @return 経由点が正しければtrue
+     */
+    bool update(const SharedMemory::Parameters& parameters, float period, Eigen::Vector3f& velocity) {
+        if (!_valid) {
+            return false;
+        }
+        int count = static_cast<int>(parameters.trajectory_count);
+        if (count == 0) {
+            velocity << parameters.speed_x, parameters.speed_y, parameters.speed_omega;
+            return true;
+        }
+
+        // 現在の時刻を含む区間を探す
+        // 時刻は単調に進むので前回の区間から先だけを探せばよい
+        auto points = parameters.trajectory;
+        float time = _time;
+        while (((_index + 1) < count) && (points[_index + 1].time <= time)) {
+            _index++;
+        }
+        _time = time + period;
+
+        const SharedMemory::Parameters::TrajectoryPoint& p0 = points[_index];
+        if ((time <= p0.time) || ((_index + 1) == count)) {
+            // 最初の経由点より前か最後の経由点より後なので端点の速度を保持する
+            velocity << p0.speed[0], p0.speed[1], p0.speed[2];
+            return true;
+        }
+
+        // 3次エルミート補間を行う
+        const SharedMemory::Parameters::TrajectoryPoint& p1 = points[_index + 1];
+        float h = p1.time - p0.time;
+        float s = (time - p0.time) / h;
+        float s2 = s * s;
+        float s3 = s2 * s;
+        float k_speed = 3.0f * s2 - 2.0f * s3;
+        float k_accel0 = h * (s3 - 2.0f * s2 + s);
+        float k_accel1 = h * (s3 - s2);
+        for (int axis = 0; axis < 3; axis++) {
+            velocity[axis] = p0.speed[axis] + k_speed * (p1.speed[axis] - p0.speed[axis]) + k_accel0 * p0.accel[axis] + k_accel1 * p1.accel[axis];
+        }
+        return true;
+    }
+
+private:
+    /// 最後にrestart()してからの時刻 [s]
+    float _time;
+
+    /// 現在の時刻を含む区間の始点の経由点の番号
+    int _index;
+
+    /// 経由点が正しいときtrue
+    bool _valid;
+};
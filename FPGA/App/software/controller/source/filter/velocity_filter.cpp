@@ -6,20 +6,19 @@
  */
 
 #include "velocity_filter.hpp"
+#include "sparse_kernel.hpp"
+#include "matrix_kernel.hpp"
+#include "velocity_filter_model.hpp"
+#include "const_matrix.hpp"
 #include "board.hpp"
 #include "fpu.hpp"
+#include <float.h>
 #include <math.h>
+#include <string.h>
 
-#ifdef _MSC_VER
-#define MUL(dst, src1, src2) dst = src1 * src2
-#define ACC(dst, src)        dst += src
-#define SAC(dst, src)        dst -= src
-#else
+#ifndef _MSC_VER
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wclass-memaccess"
-#define MUL(dst, src1, src2) __asm__ __volatile__("custom 252,%0,%1,%2" : "=r"(dst) : "r"(src1), "r"(src2) : "memory")
-#define ACC(dst, src)        __asm__ __volatile__("custom 253,%0,%1,%2" : "=r"(dst) : "r"(dst), "r"(src) : "memory")
-#define SAC(dst, src)        __asm__ __volatile__("custom 254,%0,%1,%2" : "=r"(dst) : "r"(dst), "r"(src) : "memory")
 #endif
 
 using namespace Eigen;
@@ -45,451 +44,577 @@ static constexpr float MIN_KF = 1.0f;
 /// 摩擦係数の最大値
 static constexpr float MAX_KF = 1000.0f;
 
+/// G, Hの構造を利用して既知の0と1の要素を省略した積を使う (falseにすると密行列の積を使うので処理時間を比較できる)
+static constexpr bool USE_SPARSE_JACOBIAN = true;
+
 /**
- * @brief wheel_velocity - velocity を計算する
+ * @brief 線形化された状態方程式Gの構造
+ * 摩擦係数は状態方程式で変化しないので下4行は単位行列の一部になる
  */
-static inline Vector4f wheelVelocityError(const Vector4f& wheel_velocity, float vx, float vy, float omega) {
-    Vector4f error;
-    vx *= (WHEEL_POS_Y / sqrt(WHEEL_POS_R_2));
-    vy *= (WHEEL_POS_X / sqrt(WHEEL_POS_R_2));
-    omega *= sqrt(WHEEL_POS_R_2);
-    error(0) = wheel_velocity(0) - (omega - vx + vy);
-    error(1) = wheel_velocity(1) - (omega + vx + vy);
-    error(2) = wheel_velocity(2) - (omega + vx - vy);
-    error(3) = wheel_velocity(3) - (omega - vx - vy);
-    return error;
-}
+struct StateJacobianPattern {
+    static constexpr size_t ROWS = 7;
+    static constexpr size_t COLS = 7;
+    static constexpr sparse::Element_t element(size_t row, size_t col) {
+        return VELOCITY_FILTER_G_PATTERN[row][col];
+    }
+};
 
 /**
- * @brief C = A * B を計算する
+ * @brief 線形化された観測方程式Hの構造
+ * 車輪の角加速度(0～3行目)は車体速度とその車輪の摩擦係数のみに、ジャイロセンサー(6行目)はωのみに依存する
  */
-static void matmul(const Matrix<float, 7, 7>& A, const Matrix<float, 7, 7>& B, Matrix<float, 7, 7>& C) {
-    for (size_t col = 0; col < 7; col++) {
-        float b0 = B(0, col);
-        float b1 = B(1, col);
-        float b2 = B(2, col);
-        float b3 = B(3, col);
-        float b4 = B(4, col);
-        float b5 = B(5, col);
-        float b6 = B(6, col);
-        for (size_t row = 0; row < 7; row++) {
-            float s0, s1, s2, s3, s4, s5, s6;
-            float a0, a1, a2, a3, a4, a5, a6;
-            a0 = A(row, 0);
-            a1 = A(row, 1);
-            MUL(s0, a0, b0);
-            MUL(s1, a1, b1);
-            a2 = A(row, 2);
-            ACC(s0, s1);
-            MUL(s2, a2, b2);
-            a3 = A(row, 3);
-            ACC(s0, s2);
-            MUL(s3, a3, b3);
-            a4 = A(row, 4);
-            ACC(s0, s3);
-            MUL(s4, a4, b4);
-            a5 = A(row, 5);
-            ACC(s0, s4);
-            MUL(s5, a5, b5);
-            a6 = A(row, 6);
-            ACC(s0, s5);
-            MUL(s6, a6, b6);
-            ACC(s0, s6);
-            C(row, col) = s0;
+struct ObservationJacobianPattern {
+    static constexpr size_t ROWS = 7;
+    static constexpr size_t COLS = 7;
+    static constexpr sparse::Element_t element(size_t row, size_t col) {
+        return VELOCITY_FILTER_H_PATTERN[row][col];
+    }
+};
+
+static_assert(sparse::countVariable<StateJacobianPattern>() == 21, "unexpected structure of G");
+static_assert(sparse::countVariable<ObservationJacobianPattern>() == 30, "unexpected structure of H");
+
+/// Hの行ごとの0でない要素の列
+static constexpr sparse::RowIndex<ObservationJacobianPattern> OBSERVATION_JACOBIAN_INDEX = sparse::makeRowIndex<ObservationJacobianPattern>();
+
+/// 定常カルマンゲインを求める摩擦係数の格子点 [Ns]
+static constexpr float SCHEDULE_KF[] = {MIN_KF, 3.0f, 10.0f, 30.0f, 100.0f, 300.0f, MAX_KF};
+
+/// 定常カルマンゲインの格子点の数
+static constexpr size_t SCHEDULE_POINTS = sizeof(SCHEDULE_KF) / sizeof(SCHEDULE_KF[0]);
+
+/// 定常カルマンゲインで更新してよい新息の大きさ (自由度7のカイ二乗分布の上側0.1%点)
+static constexpr float SCHEDULE_NIS_GATE = 24.32f;
+
+/// リセットした後に摩擦係数を推定するため通常のEKFで更新する回数
+static constexpr int SCHEDULE_WARMUP_UPDATES = static_cast<int>(IMU_OUTPUT_RATE);
+
+/// 新息が大きくなった後に通常のEKFで更新する回数
+static constexpr int SCHEDULE_FALLBACK_UPDATES = static_cast<int>(IMU_OUTPUT_RATE / 10);
+
+/// 定常カルマンゲインの表の1点
+struct ScheduledGain_t {
+    /// カルマンゲインの車体速度に関する行
+    float K[3][7];
+
+    /// 新息の分散の対角成分の逆数
+    float inv_innovation_variance[7];
+
+    /// 事後誤差の車体速度に関する部分 (下三角部分のみ)
+    float sigma[6];
+};
+
+/**
+ * @brief 摩擦係数がすべてkfで車輪が滑っていないときの定常カルマンゲインを求める
+ * このとき摩擦係数は車体速度と無相関になるので、車体速度の3状態についてリッカチ方程式を二重化法(SDA)で解く
+ * @param kf 摩擦係数 [Ns]
+ * @return 定常カルマンゲイン
+ */
+static constexpr ScheduledGain_t computeScheduledGain(double kf) {
+    using namespace ctmath;
+    constexpr double DELTA_TIME = 1.0 / IMU_OUTPUT_RATE;
+    constexpr double WHEEL_POS_R = squareRoot(WHEEL_POS_R_2);
+    constexpr double COS_PHI = WHEEL_POS_X / WHEEL_POS_R;
+    constexpr double SIN_PHI = WHEEL_POS_Y / WHEEL_POS_R;
+    double kf_sum = 4 * kf;
+
+    // 状態方程式と状態ノイズ
+    double gx = 1 - (DELTA_TIME * SIN_PHI / MACHINE_WEIGHT * SIN_PHI) * kf_sum;
+    double gy = 1 - (DELTA_TIME * COS_PHI / MACHINE_WEIGHT * COS_PHI) * kf_sum;
+    double gw = 1 - (DELTA_TIME * WHEEL_POS_R / MACHINE_INERTIA * WHEEL_POS_R) * kf_sum;
+    double qx = (DELTA_TIME * SIN_PHI / MACHINE_WEIGHT * WHEEL_RADIUS * SIGMA_VELOCITY) * kf_sum;
+    double qy = (DELTA_TIME * COS_PHI / MACHINE_WEIGHT * WHEEL_RADIUS * SIGMA_VELOCITY) * kf_sum;
+    double qw = (DELTA_TIME * WHEEL_POS_R / MACHINE_INERTIA * WHEEL_RADIUS * SIGMA_VELOCITY) * kf_sum;
+    ConstMatrix<3, 3> G = {gx, 0, 0, 0, gy, 0, 0, 0, gw};
+    ConstMatrix<3, 3> Q = {qx * qx, 0, 0, 0, qy * qy, 0, 0, 0, qw * qw};
+
+    // 観測方程式と観測ノイズ
+    double a = WHEEL_RADIUS / WHEEL_INERTIA * kf;
+    double ax = -SIN_PHI / MACHINE_WEIGHT * SIN_PHI * kf_sum;
+    double ay = -COS_PHI / MACHINE_WEIGHT * COS_PHI * kf_sum;
+    ConstMatrix<7, 3> H = {
+        -a * SIN_PHI, a * COS_PHI, a * WHEEL_POS_R,
+        a * SIN_PHI, a * COS_PHI, a * WHEEL_POS_R,
+        a * SIN_PHI, -a * COS_PHI, a * WHEEL_POS_R,
+        -a * SIN_PHI, -a * COS_PHI, a * WHEEL_POS_R,
+        ax, 0, 0,
+        0, ay, 0,
+        0, 0, 1,
+    };
+    constexpr double RW = (MOTOR_TORQUE_CONSTANT / WHEEL_INERTIA * SIGMA_CURRENT) * (MOTOR_TORQUE_CONSTANT / WHEEL_INERTIA * SIGMA_CURRENT) +
+                          (SIGMA_VELOCITY / DELTA_TIME) * (SIGMA_VELOCITY / DELTA_TIME);
+    constexpr double RA = static_cast<double>(SIGMA_ACCELEROMETER) * SIGMA_ACCELEROMETER;
+    constexpr double RG = static_cast<double>(SIGMA_GYROSCOPE) * SIGMA_GYROSCOPE;
+    double R[7] = {RW, RW, RW, RW, RA, RA, RG};
+    ConstMatrix<7, 7> invR;
+    for (size_t i = 0; i < 7; i++) {
+        invR.elem[i][i] = 1 / R[i];
+    }
+    ConstMatrix<3, 3> HT_invR_H = H.t() * invR * H;
+
+    // 二重化法で事前誤差の定常値を求める
+    ConstMatrix<3, 3> I = ConstMatrix<3, 3>::identity();
+    ConstMatrix<3, 3> Ak = G.t(), Gk = HT_invR_H, Hk = Q;
+    for (int i = 0; i < 30; i++) {
+        ConstMatrix<3, 3> W = (I + Gk * Hk).inv();
+        ConstMatrix<3, 3> Ak_W = Ak * W;
+        Gk = Gk + Ak_W * Gk * Ak.t();
+        Hk = Hk + Ak.t() * Hk * W * Ak;
+        Ak = Ak_W * Ak;
+    }
+    ConstMatrix<3, 3> S_hat = Hk;
+
+    // 事後誤差とカルマンゲインを求める
+    ConstMatrix<3, 3> S = (S_hat.inv() + HT_invR_H).inv();
+    ConstMatrix<3, 7> K = S * H.t() * invR;
+    ConstMatrix<7, 7> H_S_hat_HT = H * S_hat * H.t();
+
+    ScheduledGain_t result{};
+    for (size_t row = 0; row < 3; row++) {
+        for (size_t col = 0; col < 7; col++) {
+            result.K[row][col] = static_cast<float>(K.elem[row][col]);
         }
     }
+    for (size_t i = 0; i < 7; i++) {
+        result.inv_innovation_variance[i] = static_cast<float>(1 / (H_S_hat_HT.elem[i][i] + R[i]));
+    }
+    for (size_t row = 0, i = 0; row < 3; row++) {
+        for (size_t col = 0; col <= row; col++, i++) {
+            result.sigma[i] = static_cast<float>(S.elem[row][col]);
+        }
+    }
+    return result;
 }
 
+/// 格子点ごとの定常カルマンゲイン
+static constexpr ScheduledGain_t SCHEDULED_GAIN[SCHEDULE_POINTS] = {
+    computeScheduledGain(SCHEDULE_KF[0]),
+    computeScheduledGain(SCHEDULE_KF[1]),
+    computeScheduledGain(SCHEDULE_KF[2]),
+    computeScheduledGain(SCHEDULE_KF[3]),
+    computeScheduledGain(SCHEDULE_KF[4]),
+    computeScheduledGain(SCHEDULE_KF[5]),
+    computeScheduledGain(SCHEDULE_KF[6]),
+};
+
 /**
- * @brief C = A * B^T を計算する
+ * @brief 7個の観測値をまとめて処理して状態変数と共分散を更新する
+ * @param H 線形化された観測方程式
+ * @param R 観測ノイズの分散
+ * @param h_minus_z 観測値と予測値との差
+ * @param mu_hat 事前状態推定値
+ * @param S_hat 事前誤差
+ * @param mu 事後状態推定値
+ * @param sigma 事後誤差
+ * @param statistics 統計値
  */
-static void matmult(const Matrix<float, 7, 7>& A, const Matrix<float, 7, 7>& B, Matrix<float, 7, 7>& C) {
-    for (size_t col = 0; col < 7; col++) {
-        float b0 = B(col, 0);
-        float b1 = B(col, 1);
-        float b2 = B(col, 2);
-        float b3 = B(col, 3);
-        float b4 = B(col, 4);
-        float b5 = B(col, 5);
-        float b6 = B(col, 6);
-        for (size_t row = 0; row < 7; row++) {
-            float s0, s1, s2, s3, s4, s5, s6;
-            float a0, a1, a2, a3, a4, a5, a6;
-            a0 = A(row, 0);
-            a1 = A(row, 1);
-            MUL(s0, a0, b0);
-            MUL(s1, a1, b1);
-            a2 = A(row, 2);
-            ACC(s0, s1);
-            MUL(s2, a2, b2);
-            a3 = A(row, 3);
-            ACC(s0, s2);
-            MUL(s3, a3, b3);
-            a4 = A(row, 4);
-            ACC(s0, s3);
-            MUL(s4, a4, b4);
-            a5 = A(row, 5);
-            ACC(s0, s4);
-            MUL(s5, a5, b5);
-            a6 = A(row, 6);
-            ACC(s0, s5);
-            MUL(s6, a6, b6);
-            ACC(s0, s6);
-            C(row, col) = s0;
-        }
+static void correctBatch(const Matrix<float, 7, 7>& H, const Matrix<float, 7, 1>& R, const Matrix<float, 7, 1>& h_minus_z, const Matrix<float, 7, 1>& mu_hat,
+                         const SymmetricMatrix<7>& S_hat, Matrix<float, 7, 1>& mu, SymmetricMatrix<7>& sigma, VelocityFilter::Statistics_t& statistics) {
+    // 事前誤差を更新する
+    Matrix<float, 7, 7> S_hat_HT;
+    SymmetricMatrix<7> H_S_hat_HT;
+    if (USE_SPARSE_JACOBIAN) {
+        sparse::multMultTransposed<ObservationJacobianPattern>(H, S_hat, H_S_hat_HT, S_hat_HT);
+    }
+    else {
+        kernel::matmulmult(H, S_hat, H_S_hat_HT, S_hat_HT);
+    }
+    H_S_hat_HT(0, 0) += R(0);
+    H_S_hat_HT(1, 1) += R(1);
+    H_S_hat_HT(2, 2) += R(2);
+    H_S_hat_HT(3, 3) += R(3);
+    H_S_hat_HT(4, 4) += R(4);
+    H_S_hat_HT(5, 5) += R(5);
+    H_S_hat_HT(6, 6) += R(6);
+    SymmetricMatrix<7> L, invL, inv_H_S_hat_HT;
+    kernel::invmuls(H_S_hat_HT, L, invL, inv_H_S_hat_HT);
+
+    // 観測値ごとのNISとコレスキー分解のピボットを記録する
+    for (size_t obs = 0; obs < 7; obs++) {
+        statistics.nis_sum[obs] += h_minus_z(obs) * h_minus_z(obs) / H_S_hat_HT(obs, obs);
+        statistics.min_pivot_squared = fpu::min(statistics.min_pivot_squared, L(obs, obs) * L(obs, obs));
     }
+    statistics.nis_count++;
+
+    // カルマンゲインを計算する
+    Matrix<float, 7, 7> K;
+    kernel::matmul(S_hat_HT, inv_H_S_hat_HT, K);
+
+    // 共分散を更新する
+    // (I + K * H) * S_hat = S_hat + K * (S_hat * H^T)^T なので下三角部分のみ計算すればよい
+    kernel::matmultadds(K, S_hat_HT, S_hat, sigma);
+
+    // 状態変数を更新する
+    kernel::matmuladdvec(K, h_minus_z, mu_hat, mu); // mu = mu_hat + K * h_minus_z;
 }
 
 /**
- * @brief C = A * B の下三角行列のみ計算して対称行列を作成する
+ * @brief 1個の観測値によりこれまでの修正量と共分散の下三角部分を更新する
+ * @param S_hT sigma * h^T
+ * @param h_S_hT 新息の分散
+ * @param error これまでの修正量を反映した観測値と予測値との差
+ * @param sigma 共分散
+ * @param dmu 状態変数の修正量
+ * @param nis_sum この観測値のNISの合計
+ * @param min_pivot_squared 新息の分散の最小値
  */
-static void matmuls(const Matrix<float, 7, 7>& A, const Matrix<float, 7, 7>& B, Matrix<float, 7, 7>& C) {
-    for (size_t col = 0; col < 7; col++) {
-        float b0 = B(0, col);
-        float b1 = B(1, col);
-        float b2 = B(2, col);
-        float b3 = B(3, col);
-        float b4 = B(4, col);
-        float b5 = B(5, col);
-        float b6 = B(6, col);
-        for (size_t row = col; row < 7; row++) {
-            float s0, s1, s2, s3, s4, s5, s6;
-            float a0, a1, a2, a3, a4, a5, a6;
-            a0 = A(row, 0);
-            a1 = A(row, 1);
-            MUL(s0, a0, b0);
-            MUL(s1, a1, b1);
-            a2 = A(row, 2);
-            ACC(s0, s1);
-            MUL(s2, a2, b2);
-            a3 = A(row, 3);
-            ACC(s0, s2);
-            MUL(s3, a3, b3);
-            a4 = A(row, 4);
-            ACC(s0, s3);
-            MUL(s4, a4, b4);
-            a5 = A(row, 5);
-            ACC(s0, s4);
-            MUL(s5, a5, b5);
-            a6 = A(row, 6);
-            ACC(s0, s5);
-            MUL(s6, a6, b6);
-            ACC(s0, s6);
-            C(row, col) = s0;
-            C(col, row) = s0;
+static inline void updateSequential(const float (&S_hT)[7], float h_S_hT, float error, SymmetricMatrix<7>& sigma, float (&dmu)[7], float& nis_sum,
+                                    float& min_pivot_squared) {
+    // 逐次処理した新息は互いに無相関で、その分散は新息の共分散をLDL^T分解したときのピボットになる
+    float inv_h_S_hT = 1.0f / h_S_hT;
+    nis_sum += error * error * inv_h_S_hT;
+    min_pivot_squared = fpu::min(min_pivot_squared, h_S_hT);
+    float* d = sigma.data;
+    for (size_t row = 0; row < 7; row++) {
+        float k = S_hT[row] * inv_h_S_hT;
+        dmu[row] -= k * error;
+        for (size_t col = 0; col <= row; col++) {
+            *d++ -= k * S_hT[col];
         }
     }
 }
 
 /**
- * @brief A * B * A^T を計算する
+ * @brief 観測値を1個ずつ逐次処理して状態変数と共分散を更新する
+ * 観測ノイズが互いに無相関なのでcorrectBatch()と同じ結果になるが、スカラーの除算のみで済み逆行列を必要としない
+ * @param H 線形化された観測方程式
+ * @param R 観測ノイズの分散
+ * @param h_minus_z 観測値と予測値との差
+ * @param mu_hat 事前状態推定値
+ * @param S_hat 事前誤差
+ * @param mu 事後状態推定値
+ * @param sigma 事後誤差
+ * @param statistics 統計値
  */
-static inline void matmulmult(const Matrix<float, 7, 7>& A, const Matrix<float, 7, 7>& B, Matrix<float, 7, 7>& A_B_AT) {
-    Matrix<float, 7, 7> B_AT;
-    matmult(B, A, B_AT);
-    matmuls(A, B_AT, A_B_AT);
+static void correctSequential(const Matrix<float, 7, 7>& H, const Matrix<float, 7, 1>& R, const Matrix<float, 7, 1>& h_minus_z, const Matrix<float, 7, 1>& mu_hat,
+                              const SymmetricMatrix<7>& S_hat, Matrix<float, 7, 1>& mu, SymmetricMatrix<7>& sigma, VelocityFilter::Statistics_t& statistics) {
+    float dmu[7] = {0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f};
+    sigma = S_hat;
+    if (USE_SPARSE_JACOBIAN) {
+        // 観測値ごとに展開するとコードが大きくなるので、Hの0でない要素の列を表から引いて計算する
+        for (size_t obs = 0; obs < 7; obs++) {
+            // sigma * h^T を計算する
+            float S_hT[7];
+            for (size_t row = 0; row < 7; row++) {
+                S_hT[row] = sparse::rowDotAdd(OBSERVATION_JACOBIAN_INDEX, obs, 0.0f, sparse::SymmetricRow<7>{sigma, row}, H);
+            }
+
+            // 新息の分散と、これまでの修正量を反映した観測値と予測値との差を求める
+            float h_S_hT = sparse::rowDotAdd(OBSERVATION_JACOBIAN_INDEX, obs, R(obs), S_hT, H);
+            float error = sparse::rowDotAdd(OBSERVATION_JACOBIAN_INDEX, obs, h_minus_z(obs), dmu, H);
+            updateSequential(S_hT, h_S_hT, error, sigma, dmu, statistics.nis_sum[obs], statistics.min_pivot_squared);
+        }
+    }
+    else {
+        for (size_t obs = 0; obs < 7; obs++) {
+            float h[7];
+            for (size_t col = 0; col < 7; col++) {
+                h[col] = H(obs, col);
+            }
+
+            // sigma * h^T を計算する
+            // 下三角部分の各要素を対角要素を挟んだ2か所に使う
+            float S_hT[7] = {0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f};
+            const float* s = sigma.data;
+            for (size_t row = 0; row < 7; row++) {
+                for (size_t col = 0; col < row; col++) {
+                    float a = *s++;
+                    S_hT[row] += a * h[col];
+                    S_hT[col] += a * h[row];
+                }
+                S_hT[row] += *s++ * h[row];
+            }
+
+            // 新息の分散と、これまでの修正量を反映した観測値と予測値との差を求める
+            float h_S_hT = R(obs);
+            float error = h_minus_z(obs);
+            for (size_t col = 0; col < 7; col++) {
+                h_S_hT += h[col] * S_hT[col];
+                error += h[col] * dmu[col];
+            }
+            updateSequential(S_hT, h_S_hT, error, sigma, dmu, statistics.nis_sum[obs], statistics.min_pivot_squared);
+        }
+    }
+    statistics.nis_count++;
+
+    // 状態変数を更新する
+    mu(0) = mu_hat(0) + dmu[0];
+    mu(1) = mu_hat(1) + dmu[1];
+    mu(2) = mu_hat(2) + dmu[2];
+    mu(3) = mu_hat(3) + dmu[3];
+    mu(4) = mu_hat(4) + dmu[4];
+    mu(5) = mu_hat(5) + dmu[5];
+    mu(6) = mu_hat(6) + dmu[6];
 }
 
 /**
- * @brief A * B * A^T を計算する
+ * @brief 定常カルマンゲインの表を線形補間する位置を求める
+ * @param kf 摩擦係数の平均値 [Ns]
+ * @param t 補間の重み
+ * @return 補間に使う格子点のうち小さい方の番号
  */
-static inline void matmulmult(const Matrix<float, 7, 7>& A, const Matrix<float, 7, 7>& B, Matrix<float, 7, 7>& A_B_AT, Matrix<float, 7, 7>& B_AT) {
-    matmult(B, A, B_AT);
-    matmuls(A, B_AT, A_B_AT);
+static inline size_t findSchedule(float kf, float& t) {
+    size_t index = 0;
+    while ((index < (SCHEDULE_POINTS - 2)) && (SCHEDULE_KF[index + 1] < kf)) {
+        index++;
+    }
+    t = fpu::clamp((kf - SCHEDULE_KF[index]) / (SCHEDULE_KF[index + 1] - SCHEDULE_KF[index]), 0.0f, 1.0f);
+    return index;
 }
 
 /**
- * @brief 対称行列の逆行列を計算する。符号を反転する
+ * @brief 線形化された状態方程式の積 C = A * B を求める
+ * 摩擦係数の行(3～6行目)は単位行列の一部なので、上3行のみ計算する
  */
-static inline void invmuls(const Matrix<float, 7, 7>& A, Matrix<float, 7, 7>& L, Matrix<float, 7, 7>& invL, Matrix<float, 7, 7>& invA) {
-    // コレスキー分解する
-    for (size_t row = 0; row < 7; row++) {
-        for (size_t col = 0;;) {
-            float sum = A(row, col);
-            for (size_t i = 0; i < col; i++) {
-                sum -= L(row, i) * L(col, i);
-            }
-            if (row != col) {
-                L(row, col) = sum * invL(col, col);
-                col++;
-            }
-            else {
-                L(row, col) = fpu::sqrt(sum);
-                invL(row, col) = 1.0f / L(row, col);
-                break;
-            }
+static inline void multiplyStateJacobian(const Matrix<float, 7, 7>& A, const Matrix<float, 7, 7>& B, Matrix<float, 7, 7>& C) {
+    for (size_t row = 0; row < 3; row++) {
+        for (size_t col = 0; col < 7; col++) {
+            float sum = A(row, 0) * B(0, col) + A(row, 1) * B(1, col) + A(row, 2) * B(2, col);
+            C(row, col) = (3 <= col) ? (sum + A(row, col)) : sum;
         }
     }
+}
 
-    // 下三角行列の逆行列を計算する
-    for (size_t col = 0; col < 6; col++) {
-        for (size_t row = col + 1; row < 7; row++) {
-            float sum = 0.0f;
-            for (size_t i = 0; i < row; i++) {
-                sum -= L(row, i) * invL(i, col);
+/**
+ * @brief n回分の状態遷移 G^n を二乗を繰り返して求める
+ * @param G 線形化された状態方程式
+ * @param n 回数 (1以上)
+ * @param G_n n回分の線形化された状態方程式
+ */
+static void powerStateJacobian(const Matrix<float, 7, 7>& G, int n, Matrix<float, 7, 7>& G_n) {
+    Matrix<float, 7, 7> power = G, temp;
+    bool first = true;
+    while (true) {
+        if (n & 1) {
+            if (first) {
+                G_n = power;
+                first = false;
+            }
+            else {
+                multiplyStateJacobian(G_n, power, temp);
+                G_n.topRows<3>() = temp.topRows<3>();
             }
-            invL(row, col) = sum * invL(row, row);
         }
-    }
-
-    // A^-1 = -L^-T * L^-1
-    for (size_t col = 0; col < 7; col++) {
-        float b0 = -invL(0, col);
-        float b1 = invL(1, col);
-        float b2 = invL(2, col);
-        float b3 = invL(3, col);
-        float b4 = invL(4, col);
-        float b5 = invL(5, col);
-        float b6 = invL(6, col);
-        for (size_t row = col; row < 7; row++) {
-            float s0, s1, s2, s3, s4, s5, s6;
-            float a0, a1, a2, a3, a4, a5, a6;
-            a0 = invL(0, row);
-            a1 = invL(1, row);
-            MUL(s0, a0, b0);
-            MUL(s1, a1, b1);
-            a2 = invL(2, row);
-            SAC(s0, s1);
-            MUL(s2, a2, b2);
-            a3 = invL(3, row);
-            SAC(s0, s2);
-            MUL(s3, a3, b3);
-            a4 = invL(4, row);
-            SAC(s0, s3);
-            MUL(s4, a4, b4);
-            a5 = invL(5, row);
-            SAC(s0, s4);
-            MUL(s5, a5, b5);
-            a6 = invL(6, row);
-            SAC(s0, s5);
-            MUL(s6, a6, b6);
-            SAC(s0, s6);
-            invA(row, col) = s0;
-            invA(col, row) = s0;
+        n >>= 1;
+        if (n == 0) {
+            break;
         }
+        multiplyStateJacobian(power, power, temp);
+        power.topRows<3>() = temp.topRows<3>();
     }
 }
 
 /**
- * @brief d = A * b + c を計算する
+ * @brief 事後誤差からカルマンゲインの車体速度に関する行を求める
+ * K = -sigma * H^T * R^-1 (観測ノイズが対角行列なのでcorrectBatch()のKと一致する)
+ * @param H 線形化された観測方程式
+ * @param R 観測ノイズの分散
+ * @param sigma 事後誤差
+ * @param K カルマンゲインの上3行
  */
-static inline void matmuladdvec(const Matrix<float, 7, 7>& A, const Matrix<float, 7, 1>& b, const Matrix<float, 7, 1>& c, Matrix<float, 7, 1>& d) {
-    float d0 = c(0);
-    float d1 = c(1);
-    float d2 = c(2);
-    float d3 = c(3);
-    float d4 = c(4);
-    float d5 = c(5);
-    float d6 = c(6);
+static void computeGain(const Matrix<float, 7, 7>& H, const Matrix<float, 7, 1>& R, const SymmetricMatrix<7>& sigma, Matrix<float, 3, 7>& K) {
+    for (size_t row = 0; row < 3; row++) {
+        float s[7];
+        for (size_t k = 0; k < 7; k++) {
+            s[k] = sigma(row, k);
+        }
+        if (USE_SPARSE_JACOBIAN) {
+            sparse::Rows<ObservationJacobianPattern>::multTransposedRow(s, H, K, row);
+        }
+        else {
+            for (size_t col = 0; col < 7; col++) {
+                K(row, col) = kernel::dot(kernel::rowOf(H, col), s);
+            }
+        }
+    }
     for (size_t col = 0; col < 7; col++) {
-        float s0, s1, s2, s3, s4, s5, s6;
-        float a0, a1, a2, a3, a4, a5, a6;
-        float m = b(col);
-        a0 = A(0, col);
-        a1 = A(1, col);
-        MUL(s0, a0, m);
-        a2 = A(2, col);
-        ACC(d0, s0);
-        MUL(s1, a1, m);
-        a3 = A(3, col);
-        ACC(d1, s1);
-        MUL(s2, a2, m);
-        a4 = A(4, col);
-        ACC(d2, s2);
-        MUL(s3, a3, m);
-        a5 = A(5, col);
-        ACC(d3, s3);
-        MUL(s4, a4, m);
-        a6 = A(6, col);
-        ACC(d4, s4);
-        MUL(s5, a5, m);
-        MUL(s6, a6, m);
-        ACC(d5, s5);
-        ACC(d6, s6);
-    }
-    d(0) = d0;
-    d(1) = d1;
-    d(2) = d2;
-    d(3) = d3;
-    d(4) = d4;
-    d(5) = d5;
-    d(6) = d6;
+        float inv_r = -1.0f / R(col);
+        K(0, col) *= inv_r;
+        K(1, col) *= inv_r;
+        K(2, col) *= inv_r;
+    }
 }
 
 void VelocityFilter::reset(void) {
+    UpdateMode_t update_mode = _update_mode;
+    int covariance_decimation = _covariance_decimation;
     memset(this, 0, sizeof(*this));
-    G(3, 3) = 1.0f;
-    G(4, 4) = 1.0f;
-    G(5, 5) = 1.0f;
-    G(6, 6) = 1.0f;
-    H(6, 2) = 1.0f;
+    _update_mode = update_mode;
+    setCovarianceDecimation(covariance_decimation);
+    _full_update_count = SCHEDULE_WARMUP_UPDATES;
+    initializeVelocityFilterJacobian(G, H);
+    clearStatistics();
+}
+
+void VelocityFilter::clearStatistics(void) {
+    memset(&_statistics, 0, sizeof(_statistics));
+    _statistics.min_pivot_squared = FLT_MAX;
+}
+
+float VelocityFilter::covarianceTrace(void) const {
+    float trace = 0.0f;
+    for (size_t i = 0; i < 7; i++) {
+        trace += _sigma(i, i);
+    }
+    return trace;
 }
 
 void VelocityFilter::update(const Vector3f& accel, const Vector3f& gyro, const Vector4f& wheel_velocity, const Vector4f& wheel_current) {
-    // 定数の定義
-    constexpr float DELTA_TIME = 1.0f / IMU_OUTPUT_RATE;
-    const float WHEEL_POS_R = sqrt(WHEEL_POS_R_2);
-    const float COS_PHI = WHEEL_POS_X / WHEEL_POS_R;
-    const float SIN_PHI = WHEEL_POS_Y / WHEEL_POS_R;
-
-    // 車輪速度を微分する
-    Vector4f domega;
-    domega(0) = (IMU_OUTPUT_RATE / WHEEL_RADIUS) * (wheel_velocity(0) - _last_wheel_velocity(0));
-    domega(1) = (IMU_OUTPUT_RATE / WHEEL_RADIUS) * (wheel_velocity(1) - _last_wheel_velocity(1));
-    domega(2) = (IMU_OUTPUT_RATE / WHEEL_RADIUS) * (wheel_velocity(2) - _last_wheel_velocity(2));
-    domega(3) = (IMU_OUTPUT_RATE / WHEEL_RADIUS) * (wheel_velocity(3) - _last_wheel_velocity(3));
+    // 事前状態推定値と線形化した状態方程式・観測方程式を求める
+    Vector7f mu_hat, h_minus_z, R, Q;
+    float kf_hat_mean;
+    computeVelocityFilterModel(_mu, accel, gyro, wheel_velocity, _last_wheel_velocity, wheel_current, mu_hat, G, H, h_minus_z, R, Q, kf_hat_mean);
     _last_wheel_velocity(0) = wheel_velocity(0);
     _last_wheel_velocity(1) = wheel_velocity(1);
     _last_wheel_velocity(2) = wheel_velocity(2);
     _last_wheel_velocity(3) = wheel_velocity(3);
 
-    // 事前状態推定値を求める
-    float vx = _mu(0);
-    float vy = _mu(1);
-    float Omega = _mu(2);
-    Vector4f kf, force;
-    kf(0) = _mu(3);
-    kf(1) = _mu(4);
-    kf(2) = _mu(5);
-    kf(3) = _mu(6);
-    Vector4f romega_minus_v = wheelVelocityError(wheel_velocity, vx, vy, Omega);
-    force(0) = kf(0) * romega_minus_v(0);
-    force(1) = kf(1) * romega_minus_v(1);
-    force(2) = kf(2) * romega_minus_v(2);
-    force(3) = kf(3) * romega_minus_v(3);
-    Vector7f mu_hat;
-    mu_hat(0) = _mu(0) + (SIN_PHI / MACHINE_WEIGHT * DELTA_TIME) * (force(1) - force(0) + force(2) - force(3)) + Omega * vy * DELTA_TIME;
-    mu_hat(1) = _mu(1) + (COS_PHI / MACHINE_WEIGHT * DELTA_TIME) * (force(0) + force(1) - force(2) - force(3)) - Omega * vx * DELTA_TIME;
-    mu_hat(2) = _mu(2) + (WHEEL_POS_R / MACHINE_INERTIA * DELTA_TIME) * (force(0) + force(1) + force(2) + force(3));
-    mu_hat(3) = _mu(3);
-    mu_hat(4) = _mu(4);
-    mu_hat(5) = _mu(5);
-    mu_hat(6) = _mu(6);
-
-    // 状態方程式を線形化する
-    float kf_sum = kf(0) + kf(1) + kf(2) + kf(3);
-    G(0, 0) = 1.0f - (DELTA_TIME * SIN_PHI / MACHINE_WEIGHT * SIN_PHI) * kf_sum;
-    G(0, 1) = (DELTA_TIME * SIN_PHI / MACHINE_WEIGHT * COS_PHI) * (kf(0) - kf(1) + kf(2) - kf(3)) + DELTA_TIME * Omega;
-    G(0, 2) = (DELTA_TIME * SIN_PHI / MACHINE_WEIGHT * WHEEL_POS_R) * (kf(0) - kf(1) - kf(2) + kf(3)) + DELTA_TIME * vy;
-    G(0, 3) = (-DELTA_TIME * SIN_PHI / MACHINE_WEIGHT) * romega_minus_v(0);
-    G(0, 4) = (DELTA_TIME * SIN_PHI / MACHINE_WEIGHT) * romega_minus_v(1);
-    G(0, 5) = (DELTA_TIME * SIN_PHI / MACHINE_WEIGHT) * romega_minus_v(2);
-    G(0, 6) = (-DELTA_TIME * SIN_PHI / MACHINE_WEIGHT) * romega_minus_v(3);
-    G(1, 0) = (DELTA_TIME * COS_PHI / MACHINE_WEIGHT * SIN_PHI) * (kf(0) - kf(1) + kf(2) - kf(3)) - DELTA_TIME * Omega;
-    G(1, 1) = 1.0f - (DELTA_TIME * COS_PHI / MACHINE_WEIGHT * COS_PHI) * kf_sum;
-    G(1, 2) = (DELTA_TIME * COS_PHI / MACHINE_WEIGHT) * WHEEL_POS_R * (kf(2) - kf(0) - kf(1) + kf(3)) - DELTA_TIME * vx;
-    G(1, 3) = (DELTA_TIME * COS_PHI / MACHINE_WEIGHT) * romega_minus_v(0);
-    G(1, 4) = (DELTA_TIME * COS_PHI / MACHINE_WEIGHT) * romega_minus_v(1);
-    G(1, 5) = (-DELTA_TIME * COS_PHI / MACHINE_WEIGHT) * romega_minus_v(2);
-    G(1, 6) = (-DELTA_TIME * COS_PHI / MACHINE_WEIGHT) * romega_minus_v(3);
-    G(2, 0) = (DELTA_TIME * WHEEL_POS_R / MACHINE_INERTIA * SIN_PHI) * (kf(0) - kf(1) - kf(2) + kf(3));
-    G(2, 1) = (DELTA_TIME * WHEEL_POS_R / MACHINE_INERTIA * COS_PHI) * (kf(2) - kf(0) - kf(1) + kf(3));
-    G(2, 2) = 1.0f - (DELTA_TIME * WHEEL_POS_R / MACHINE_INERTIA * WHEEL_POS_R) * kf_sum;
-    G(2, 3) = (DELTA_TIME * WHEEL_POS_R / MACHINE_INERTIA) * romega_minus_v(0);
-    G(2, 4) = (DELTA_TIME * WHEEL_POS_R / MACHINE_INERTIA) * romega_minus_v(1);
-    G(2, 5) = (DELTA_TIME * WHEEL_POS_R / MACHINE_INERTIA) * romega_minus_v(2);
-    G(2, 6) = (DELTA_TIME * WHEEL_POS_R / MACHINE_INERTIA) * romega_minus_v(3);
+    // 定常カルマンゲインで状態変数を更新する
+    // 新息が大きいときはしばらく通常のEKFで更新する
+    _covariance_updated = false;
+    if ((_update_mode == UpdateModeScheduled) && (_full_update_count <= 0)) {
+        if (correctScheduled(kf_hat_mean, mu_hat, h_minus_z)) {
+            _decimation_count = 0;
+            return;
+        }
+        _full_update_count = SCHEDULE_FALLBACK_UPDATES;
+    }
+    if (0 < _full_update_count) {
+        _full_update_count--;
+    }
+
+    // 共分散を更新しない回は前回のカルマンゲインで車体速度のみ更新する
+    // 観測方程式は摩擦係数について非線形が強く、古いカルマンゲインで更新すると発散しやすいので摩擦係数は更新しない
+    if (0 < _decimation_count) {
+        _decimation_count--;
+        for (size_t row = 0; row < 3; row++) {
+            float sum = mu_hat(row);
+            for (size_t obs = 0; obs < 7; obs++) {
+                sum += _gain(row, obs) * h_minus_z(obs);
+            }
+            _mu(row) = sum;
+        }
+        _mu(3) = mu_hat(3);
+        _mu(4) = mu_hat(4);
+        _mu(5) = mu_hat(5);
+        _mu(6) = mu_hat(6);
+        return;
+    }
+    if (_scheduled_update_count != 0) {
+        restoreCovariance(kf_hat_mean);
+    }
 
     // 事前誤差を計算する
-    Matrix7f S_hat;
-    matmulmult(G, _sigma, S_hat);
-    float kf_sum_2 = kf_sum * kf_sum;
-    S_hat(0, 0) += powf((DELTA_TIME * SIN_PHI / MACHINE_WEIGHT * WHEEL_RADIUS * SIGMA_VELOCITY), 2) * kf_sum_2;
-    S_hat(1, 1) += powf((DELTA_TIME * COS_PHI / MACHINE_WEIGHT * WHEEL_RADIUS * SIGMA_VELOCITY), 2) * kf_sum_2;
-    S_hat(2, 2) += powf((DELTA_TIME * WHEEL_POS_R / MACHINE_INERTIA * WHEEL_RADIUS * SIGMA_VELOCITY), 2) * kf_sum_2;
-    S_hat(3, 3) += powf(DELTA_TIME * SIGMA_KF, 2);
-    S_hat(4, 4) += powf(DELTA_TIME * SIGMA_KF, 2);
-    S_hat(5, 5) += powf(DELTA_TIME * SIGMA_KF, 2);
-    S_hat(6, 6) += powf(DELTA_TIME * SIGMA_KF, 2);
-
-    // 観測予測値を計算する
-    float vx_hat = mu_hat(0);
-    float vy_hat = mu_hat(1);
-    float Omega_hat = mu_hat(2);
-    Vector4f kf_hat, force_hat;
-    kf_hat(0) = mu_hat(3);
-    kf_hat(1) = mu_hat(4);
-    kf_hat(2) = mu_hat(5);
-    kf_hat(3) = mu_hat(6);
-    Vector4f romega_minus_v_hat = wheelVelocityError(wheel_velocity, vx_hat, vy_hat, Omega_hat);
-    force_hat(0) = kf_hat(0) * romega_minus_v_hat(0);
-    force_hat(1) = kf_hat(1) * romega_minus_v_hat(1);
-    force_hat(2) = kf_hat(2) * romega_minus_v_hat(2);
-    force_hat(3) = kf_hat(3) * romega_minus_v_hat(3);
-    Vector7f h_minus_z; // 観測値と予測値との差
-    h_minus_z(0) = (MOTOR_TORQUE_CONSTANT / WHEEL_INERTIA) * wheel_current(0) - (WHEEL_RADIUS / WHEEL_INERTIA) * force_hat(0) - domega(0);
-    h_minus_z(1) = (MOTOR_TORQUE_CONSTANT / WHEEL_INERTIA) * wheel_current(1) - (WHEEL_RADIUS / WHEEL_INERTIA) * force_hat(1) - domega(1);
-    h_minus_z(2) = (MOTOR_TORQUE_CONSTANT / WHEEL_INERTIA) * wheel_current(2) - (WHEEL_RADIUS / WHEEL_INERTIA) * force_hat(2) - domega(2);
-    h_minus_z(3) = (MOTOR_TORQUE_CONSTANT / WHEEL_INERTIA) * wheel_current(3) - (WHEEL_RADIUS / WHEEL_INERTIA) * force_hat(3) - domega(3);
-    h_minus_z(4) = (SIN_PHI / MACHINE_WEIGHT) * (force_hat(1) - force_hat(0) + force_hat(2) - force_hat(3)) - accel.x();
-    h_minus_z(5) = (COS_PHI / MACHINE_WEIGHT) * (force_hat(0) + force_hat(1) - force_hat(2) - force_hat(3)) - accel.y();
-    h_minus_z(6) = Omega_hat - gyro.z();
-
-    // 観測方程式を線形化する
-    float kf_hat_sum = kf_hat(0) + kf_hat(1) + kf_hat(2) + kf_hat(3);
-    H(0, 0) = (-WHEEL_RADIUS / WHEEL_INERTIA * SIN_PHI) * kf_hat(0);
-    H(1, 0) = (WHEEL_RADIUS / WHEEL_INERTIA * SIN_PHI) * kf_hat(1);
-    H(2, 0) = (WHEEL_RADIUS / WHEEL_INERTIA * SIN_PHI) * kf_hat(2);
-    H(3, 0) = (-WHEEL_RADIUS / WHEEL_INERTIA * SIN_PHI) * kf_hat(3);
-    H(0, 1) = (WHEEL_RADIUS / WHEEL_INERTIA * COS_PHI) * kf_hat(0);
-    H(1, 1) = (WHEEL_RADIUS / WHEEL_INERTIA * COS_PHI) * kf_hat(1);
-    H(2, 1) = (-WHEEL_RADIUS / WHEEL_INERTIA * COS_PHI) * kf_hat(2);
-    H(3, 1) = (-WHEEL_RADIUS / WHEEL_INERTIA * COS_PHI) * kf_hat(3);
-    H(0, 2) = (WHEEL_RADIUS / WHEEL_INERTIA * WHEEL_POS_R) * kf_hat(0);
-    H(1, 2) = (WHEEL_RADIUS / WHEEL_INERTIA * WHEEL_POS_R) * kf_hat(1);
-    H(2, 2) = (WHEEL_RADIUS / WHEEL_INERTIA * WHEEL_POS_R) * kf_hat(2);
-    H(3, 2) = (WHEEL_RADIUS / WHEEL_INERTIA * WHEEL_POS_R) * kf_hat(3);
-    H(0, 3) = (-WHEEL_RADIUS / WHEEL_INERTIA) * romega_minus_v_hat(0);
-    H(1, 4) = (-WHEEL_RADIUS / WHEEL_INERTIA) * romega_minus_v_hat(1);
-    H(2, 5) = (-WHEEL_RADIUS / WHEEL_INERTIA) * romega_minus_v_hat(2);
-    H(3, 6) = (-WHEEL_RADIUS / WHEEL_INERTIA) * romega_minus_v_hat(3);
-    H(4, 0) = (-SIN_PHI / MACHINE_WEIGHT * SIN_PHI) * kf_hat_sum;
-    H(4, 1) = (SIN_PHI / MACHINE_WEIGHT * COS_PHI) * (kf_hat(0) - kf_hat(1) + kf_hat(2) - kf_hat(3));
-    H(4, 2) = (SIN_PHI / MACHINE_WEIGHT * WHEEL_POS_R) * (kf_hat(0) - kf_hat(1) - kf_hat(2) + kf_hat(3));
-    H(4, 3) = (-SIN_PHI / MACHINE_WEIGHT) * romega_minus_v_hat(0);
-    H(4, 4) = (SIN_PHI / MACHINE_WEIGHT) * romega_minus_v_hat(1);
-    H(4, 5) = (SIN_PHI / MACHINE_WEIGHT) * romega_minus_v_hat(2);
-    H(4, 6) = (-SIN_PHI / MACHINE_WEIGHT) * romega_minus_v_hat(3);
-    H(5, 0) = (COS_PHI / MACHINE_WEIGHT * SIN_PHI) * (kf_hat(0) - kf_hat(1) + kf_hat(2) - kf_hat(3));
-    H(5, 1) = (-COS_PHI / MACHINE_WEIGHT * COS_PHI) * kf_hat_sum;
-    H(5, 2) = (COS_PHI / MACHINE_WEIGHT * WHEEL_POS_R) * (kf_hat(2) - kf_hat(0) - kf_hat(1) + kf_hat(3));
-    H(5, 3) = (COS_PHI / MACHINE_WEIGHT) * romega_minus_v_hat(0);
-    H(5, 4) = (COS_PHI / MACHINE_WEIGHT) * romega_minus_v_hat(1);
-    H(5, 5) = (-COS_PHI / MACHINE_WEIGHT) * romega_minus_v_hat(2);
-    H(5, 6) = (-COS_PHI / MACHINE_WEIGHT) * romega_minus_v_hat(3);
+    // 共分散を間引いて更新するときは前回の更新からの回数分の状態遷移 G^n と状態ノイズ n * Q をまとめて適用する
+    // 間の回の観測値による共分散の減少は反映されないので、事前誤差は大きめに見積もられる
+    SymmetricMatrix<7> S_hat;
+    const Matrix7f* G_step = &G;
+    Matrix7f G_n;
+    float steps = static_cast<float>(_covariance_decimation);
+    if (1 < _covariance_decimation) {
+        powerStateJacobian(G, _covariance_decimation, G_n);
+        G_step = &G_n;
+    }
+    if (USE_SPARSE_JACOBIAN) {
+        Matrix7f S_GT;
+        sparse::multMultTransposed<StateJacobianPattern>(*G_step, _sigma, S_hat, S_GT);
+    }
+    else {
+        kernel::matmulmult(*G_step, _sigma, S_hat);
+    }
+    for (size_t i = 0; i < 7; i++) {
+        S_hat(i, i) += steps * Q(i);
+    }
 
-    // 事前誤差を更新する
-    Matrix7f S_hat_HT, H_S_hat_HT;
-    matmulmult(H, S_hat, H_S_hat_HT, S_hat_HT);
-    H_S_hat_HT(0, 0) += powf(MOTOR_TORQUE_CONSTANT / WHEEL_INERTIA * SIGMA_CURRENT, 2) + powf(SIGMA_VELOCITY / DELTA_TIME, 2);
-    H_S_hat_HT(1, 1) += powf(MOTOR_TORQUE_CONSTANT / WHEEL_INERTIA * SIGMA_CURRENT, 2) + powf(SIGMA_VELOCITY / DELTA_TIME, 2);
-    H_S_hat_HT(2, 2) += powf(MOTOR_TORQUE_CONSTANT / WHEEL_INERTIA * SIGMA_CURRENT, 2) + powf(SIGMA_VELOCITY / DELTA_TIME, 2);
-    H_S_hat_HT(3, 3) += powf(MOTOR_TORQUE_CONSTANT / WHEEL_INERTIA * SIGMA_CURRENT, 2) + powf(SIGMA_VELOCITY / DELTA_TIME, 2);
-    H_S_hat_HT(4, 4) += powf(SIGMA_ACCELEROMETER, 2);
-    H_S_hat_HT(5, 5) += powf(SIGMA_ACCELEROMETER, 2);
-    H_S_hat_HT(6, 6) += powf(SIGMA_GYROSCOPE, 2);
-    Matrix7f inv_H_S_hat_HT;
-    invmuls(H_S_hat_HT, L, invL, inv_H_S_hat_HT);
+    // 状態変数と共分散を更新する
+    if (_update_mode == UpdateModeBatch) {
+        correctBatch(H, R, h_minus_z, mu_hat, S_hat, _mu, _sigma, _statistics);
+    }
+    else {
+        correctSequential(H, R, h_minus_z, mu_hat, S_hat, _mu, _sigma, _statistics);
+    }
+    for (size_t i = 3; i < 7; i++) {
+        float kf = _mu(i);
+        if (kf < MIN_KF) {
+            _statistics.kf_clamp_min_count++;
+        }
+        else if (MAX_KF < kf) {
+            _statistics.kf_clamp_max_count++;
+        }
+        _mu(i) = fpu::clamp(kf, MIN_KF, MAX_KF);
+    }
 
-    // カルマンゲインを計算する
-    Matrix7f K, K_H;
-    matmul(S_hat_HT, inv_H_S_hat_HT, K);
-    matmul(K, H, K_H);
-    K_H(0, 0) += 1.0f;
-    K_H(1, 1) += 1.0f;
-    K_H(2, 2) += 1.0f;
-    K_H(3, 3) += 1.0f;
-    K_H(4, 4) += 1.0f;
-    K_H(5, 5) += 1.0f;
-    K_H(6, 6) += 1.0f;
-    matmul(K_H, S_hat, _sigma);
+    // 次の回から使うカルマンゲインを保存する
+    if (1 < _covariance_decimation) {
+        computeGain(H, R, _sigma, _gain);
+        _decimation_count = _covariance_decimation - 1;
+    }
+    _covariance_updated = true;
+}
 
-    // 状態変数を更新する
-    matmuladdvec(K, h_minus_z, mu_hat, _mu); //_mu = mu_hat + K * h_minus_z;
-    _mu(3) = fpu::clamp(_mu(3), MIN_KF, MAX_KF);
-    _mu(4) = fpu::clamp(_mu(4), MIN_KF, MAX_KF);
-    _mu(5) = fpu::clamp(_mu(5), MIN_KF, MAX_KF);
-    _mu(6) = fpu::clamp(_mu(6), MIN_KF, MAX_KF);
+bool VelocityFilter::correctScheduled(float kf, const Vector7f& mu_hat, const Vector7f& h_minus_z) {
+    float t;
+    size_t index = findSchedule(kf, t);
+    const ScheduledGain_t& g0 = SCHEDULED_GAIN[index];
+    const ScheduledGain_t& g1 = SCHEDULED_GAIN[index + 1];
+
+    // 新息が大きいときは定常カルマンゲインを使わない
+    float nis_obs[7];
+    float nis = 0.0f;
+    for (size_t obs = 0; obs < 7; obs++) {
+        float inv_innovation_variance = g0.inv_innovation_variance[obs] + t * (g1.inv_innovation_variance[obs] - g0.inv_innovation_variance[obs]);
+        nis_obs[obs] = h_minus_z(obs) * h_minus_z(obs) * inv_innovation_variance;
+        nis += nis_obs[obs];
+    }
+    if (SCHEDULE_NIS_GATE < nis) {
+        return false;
+    }
+    for (size_t obs = 0; obs < 7; obs++) {
+        _statistics.nis_sum[obs] += nis_obs[obs];
+    }
+    _statistics.nis_count++;
+
+    // mu = mu_hat - K * h_minus_z
+    // 摩擦係数は車体速度と無相関なので更新しない
+    for (size_t row = 0; row < 3; row++) {
+        float sum = mu_hat(row);
+        for (size_t obs = 0; obs < 7; obs++) {
+            float k = g0.K[row][obs] + t * (g1.K[row][obs] - g0.K[row][obs]);
+            sum -= k * h_minus_z(obs);
+        }
+        _mu(row) = sum;
+    }
+    _mu(3) = mu_hat(3);
+    _mu(4) = mu_hat(4);
+    _mu(5) = mu_hat(5);
+    _mu(6) = mu_hat(6);
+    _scheduled_update_count++;
+    return true;
+}
+
+void VelocityFilter::restoreCovariance(float kf) {
+    constexpr float DELTA_TIME = 1.0f / IMU_OUTPUT_RATE;
+    float t;
+    size_t index = findSchedule(kf, t);
+    const ScheduledGain_t& g0 = SCHEDULED_GAIN[index];
+    const ScheduledGain_t& g1 = SCHEDULED_GAIN[index + 1];
+
+    // 車体速度の部分は定常値を使う
+    for (size_t row = 0, i = 0; row < 3; row++) {
+        for (size_t col = 0; col <= row; col++, i++) {
+            _sigma(row, col) = g0.sigma[i] + t * (g1.sigma[i] - g0.sigma[i]);
+        }
+    }
+
+    // 摩擦係数の分散は更新しなかった回数だけ増やす
+    float kf_variance_growth = static_cast<float>(_scheduled_update_count) * powf(DELTA_TIME * SIGMA_KF, 2);
+    for (size_t row = 3; row < 7; row++) {
+        _sigma(row, 0) = 0.0f;
+        _sigma(row, 1) = 0.0f;
+        _sigma(row, 2) = 0.0f;
+        _sigma(row, row) += kf_variance_growth;
+    }
+    _scheduled_update_count = 0;
 }
 
 #ifndef _MSC_VER
@@ -8,6 +8,7 @@
 #pragma once
 
 #include <Eigen/Core>
+#include "symmetric_matrix.hpp"
 
 /**
  * @brief IMUの測定値とオドメトリから車体速度を推定する
@@ -18,11 +19,85 @@ private:
     using Matrix7f = Eigen::Matrix<float, 7, 7>;
 
 public:
+    /// 観測値による更新の方法
+    enum UpdateMode_t {
+        /// 7個の観測値をまとめて処理する (7x7行列の逆行列を求める)
+        UpdateModeBatch,
+
+        /// 観測ノイズが対角行列であることを利用して観測値を1個ずつ処理する (逆行列を必要としない)
+        UpdateModeSequential,
+
+        /// 摩擦係数の格子点ごとに事前に求めた定常カルマンゲインを補間して使い、共分散を更新しない
+        /// 新息が大きいときはしばらくUpdateModeSequentialで処理する
+        UpdateModeScheduled,
+    };
+
+    /// 推定の健全性を監視するための統計値
+    struct Statistics_t {
+        /// 観測値ごとの正規化新息二乗(NIS)の合計
+        /// UpdateModeSequentialではそれより前の観測値で更新した後の新息から求める
+        float nis_sum[7];
+
+        /// NISを合計した回数
+        int nis_count;
+
+        /// 新息の共分散をコレスキー分解したときのピボットの2乗の最小値
+        float min_pivot_squared;
+
+        /// 摩擦係数が下限に制限された回数
+        int kf_clamp_min_count;
+
+        /// 摩擦係数が上限に制限された回数
+        int kf_clamp_max_count;
+    };
+
     /**
      * @brief 内部状態をリセットする
+     * 更新の方法と共分散の更新の間引き数は保持される
      */
     void reset(void);
 
+    /**
+     * @brief 観測値による更新の方法を設定する
+     * @param update_mode 更新の方法
+     */
+    void setUpdateMode(UpdateMode_t update_mode) {
+        _update_mode = update_mode;
+    }
+
+    /**
+     * @brief 観測値による更新の方法を取得する
+     * @return 更新の方法
+     */
+    UpdateMode_t updateMode(void) const {
+        return _update_mode;
+    }
+
+    /**
+     * @brief 共分散とカルマンゲインを更新する間隔を設定する
+     * 間の回では状態変数のみを前回のカルマンゲインで更新する
+     * @param decimation 共分散を更新する間隔 [回] (1のときは毎回更新する)
+     */
+    void setCovarianceDecimation(int decimation) {
+        _covariance_decimation = (1 < decimation) ? decimation : 1;
+    }
+
+    /**
+     * @brief 共分散とカルマンゲインを更新する間隔を取得する
+     * @return 共分散を更新する間隔 [回]
+     */
+    int covarianceDecimation(void) const {
+        return _covariance_decimation;
+    }
+
+    /**
+     * @brief 直前のupdate()で共分散とカルマンゲインを更新したか取得する
+     * @return 更新したときはtrue
+     */
+    bool isCovarianceUpdated(void) const {
+        return _covariance_updated;
+    }
+
     /**
      * @brief フィルタに新たな入力を与えて出力を更新する
      * @param accel 加速度センサーの測定値
@@ -32,6 +107,26 @@ public:
      */
     void update(const Eigen::Vector3f& accel, const Eigen::Vector3f& gyro, const Eigen::Vector4f& wheel_velocity, const Eigen::Vector4f& wheel_current);
 
+    /**
+     * @brief 前回clearStatistics()を呼んでからの統計値を取得する
+     * 共分散を更新しなかった回は含まれない
+     * @return 統計値
+     */
+    const Statistics_t& statistics(void) const {
+        return _statistics;
+    }
+
+    /**
+     * @brief 統計値をクリアする
+     */
+    void clearStatistics(void);
+
+    /**
+     * @brief 共分散のトレースを計算する
+     * @return 共分散のトレース
+     */
+    float covarianceTrace(void) const;
+
     /**
      * @brief 車体速度の推定値を取得する
      * @return 車体速度 X [m/s], Y [m/s], ω [rad/s]
@@ -51,8 +146,8 @@ public:
     /// 状態変数の最尤値
     Vector7f _mu;
 
-    /// 共分散
-    Matrix7f _sigma;
+    /// 共分散 (下三角部分のみ格納する)
+    SymmetricMatrix<7> _sigma;
 
     /// 前回の更新時の車輪速度
     Eigen::Vector4f _last_wheel_velocity;
@@ -63,6 +158,43 @@ public:
     /// 線形化された観測方程式
     Matrix7f H;
 
-    /// 逆行列を求める際の途中計算結果
-    Matrix7f L, invL;
+    /// 観測値による更新の方法
+    UpdateMode_t _update_mode;
+
+    /// 定常カルマンゲインを使えるようになるまでに通常のEKFで更新する残りの回数
+    int _full_update_count;
+
+    /// 定常カルマンゲインで続けて更新した回数
+    int _scheduled_update_count;
+
+    /// 共分散とカルマンゲインを更新する間隔 [回]
+    int _covariance_decimation;
+
+    /// 前回のカルマンゲインで状態変数を更新する残りの回数
+    int _decimation_count;
+
+    /// 直前のupdate()で共分散を更新したか
+    bool _covariance_updated;
+
+    /// 統計値
+    Statistics_t _statistics;
+
+    /// 前回求めたカルマンゲインの車体速度に関する行 (mu = mu_hat + K * h_minus_z となるように符号を反転して格納する)
+    Eigen::Matrix<float, 3, 7> _gain;
+
+private:
+    /**
+     * @brief 定常カルマンゲインで状態変数を更新する
+     * @param kf 摩擦係数の平均値 [Ns]
+     * @param mu_hat 事前状態推定値
+     * @param h_minus_z 観測値と予測値との差
+     * @return 新息が大きく更新しなかったときはfalse
+     */
+    bool correctScheduled(float kf, const Vector7f& mu_hat, const Vector7f& h_minus_z);
+
+    /**
+     * @brief 定常カルマンゲインで更新している間に更新しなかった共分散を作り直す
+     * @param kf 摩擦係数の平均値 [Ns]
+     */
+    void restoreCovariance(float kf);
 };
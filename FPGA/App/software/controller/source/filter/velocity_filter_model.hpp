@@ -0,0 +1,193 @@
+/**
+ * @file velocity_filter_model.hpp
+ * @author Fujii Naomichi
+ * @copyright (c) 2021 Fujii Naomichi
+ * SPDX-License-Identifier: MIT
+ */
+
+// このファイルは tools/velocity_filter_model.py で生成される。直接編集しないこと
+// 浮動小数点演算: 加算 20, 減算 46, 乗算 92, 符号反転 0, 合計 158
+
+#pragma once
+
+#include <Eigen/Core>
+#include "sparse_kernel.hpp"
+
+/// 線形化された状態方程式Gの構造
+static constexpr sparse::Element_t VELOCITY_FILTER_G_PATTERN[7][7] = {
+    {sparse::ElementVariable, sparse::ElementVariable, sparse::ElementVariable, sparse::ElementVariable, sparse::ElementVariable, sparse::ElementVariable, sparse::ElementVariable},
+    {sparse::ElementVariable, sparse::ElementVariable, sparse::ElementVariable, sparse::ElementVariable, sparse::ElementVariable, sparse::ElementVariable, sparse::ElementVariable},
+    {sparse::ElementVariable, sparse::ElementVariable, sparse::ElementVariable, sparse::ElementVariable, sparse::ElementVariable, sparse::ElementVariable, sparse::ElementVariable},
+    {sparse::ElementZero, sparse::ElementZero, sparse::ElementZero, sparse::ElementOne, sparse::ElementZero, sparse::ElementZero, sparse::ElementZero},
+    {sparse::ElementZero, sparse::ElementZero, sparse::ElementZero, sparse::ElementZero, sparse::ElementOne, sparse::ElementZero, sparse::ElementZero},
+    {sparse::ElementZero, sparse::ElementZero, sparse::ElementZero, sparse::ElementZero, sparse::ElementZero, sparse::ElementOne, sparse::ElementZero},
+    {sparse::ElementZero, sparse::ElementZero, sparse::ElementZero, sparse::ElementZero, sparse::ElementZero, sparse::ElementZero, sparse::ElementOne},
+};
+
+/// 線形化された観測方程式Hの構造
+static constexpr sparse::Element_t VELOCITY_FILTER_H_PATTERN[7][7] = {
+    {sparse::ElementVariable, sparse::ElementVariable, sparse::ElementVariable, sparse::ElementVariable, sparse::ElementZero, sparse::ElementZero, sparse::ElementZero},
+    {sparse::ElementVariable, sparse::ElementVariable, sparse::ElementVariable, sparse::ElementZero, sparse::ElementVariable, sparse::ElementZero, sparse::ElementZero},
+    {sparse::ElementVariable, sparse::ElementVariable, sparse::ElementVariable, sparse::ElementZero, sparse::ElementZero, sparse::ElementVariable, sparse::ElementZero},
+    {sparse::ElementVariable, sparse::ElementVariable, sparse::ElementVariable, sparse::ElementZero, sparse::ElementZero, sparse::ElementZero, sparse::ElementVariable},
+    {sparse::ElementVariable, sparse::ElementVariable, sparse::ElementVariable, sparse::ElementVariable, sparse::ElementVariable, sparse::ElementVariable, sparse::ElementVariable},
+    {sparse::ElementVariable, sparse::ElementVariable, sparse::ElementVariable, sparse::ElementVariable, sparse::ElementVariable, sparse::ElementVariable, sparse::ElementVariable},
+    {sparse::ElementZero, sparse::ElementZero, sparse::ElementOne, sparse::ElementZero, sparse::ElementZero, sparse::ElementZero, sparse::ElementZero},
+};
+
+/**
+ * @brief G, Hの定数の要素を設定する
+ * 0の要素は設定しないので、事前に0で初期化しておくこと
+ */
+static inline void initializeVelocityFilterJacobian(Eigen::Matrix<float, 7, 7>& G, Eigen::Matrix<float, 7, 7>& H) {
+    G(3, 3) = 1.0f;
+    G(4, 4) = 1.0f;
+    G(5, 5) = 1.0f;
+    G(6, 6) = 1.0f;
+    H(6, 2) = 1.0f;
+}
+
+/**
+ * @brief 事前状態推定値と線形化した状態方程式・観測方程式、観測値と予測値との差を計算する
+ * G, Hは値が変化する要素のみ更新する
+ * @param mu 状態変数
+ * @param accel 加速度センサーの測定値
+ * @param gyro ジャイロスコープの測定値
+ * @param wheel_velocity 車輪速度
+ * @param last_wheel_velocity 前回の更新時の車輪速度
+ * @param wheel_current モーター電流
+ * @param mu_hat 事前状態推定値
+ * @param G 線形化された状態方程式
+ * @param H 線形化された観測方程式
+ * @param h_minus_z 観測値と予測値との差
+ * @param R 観測ノイズの分散
+ * @param Q プロセスノイズの分散 (対角成分)
+ * @param kf_hat_mean 摩擦係数の事前推定値の平均値
+ */
+static inline void computeVelocityFilterModel(const Eigen::Matrix<float, 7, 1>& mu, const Eigen::Vector3f& accel, const Eigen::Vector3f& gyro,
+                                              const Eigen::Vector4f& wheel_velocity, const Eigen::Vector4f& last_wheel_velocity, const Eigen::Vector4f& wheel_current,
+                                              Eigen::Matrix<float, 7, 1>& mu_hat, Eigen::Matrix<float, 7, 7>& G, Eigen::Matrix<float, 7, 7>& H,
+                                              Eigen::Matrix<float, 7, 1>& h_minus_z, Eigen::Matrix<float, 7, 1>& R, Eigen::Matrix<float, 7, 1>& Q, float& kf_hat_mean) {
+    const float t0 = 0.8320503f * mu(1);
+    const float t1 = 0.07571658f * mu(2);
+    const float t2 = 0.5547002f * mu(0);
+    const float t3 = t1 - t2;
+    const float t4 = t0 + wheel_velocity(3) - t3;
+    const float t5 = t4 * mu(6);
+    const float t6 = wheel_velocity(0) - t0 - t3;
+    const float t7 = t6 * mu(3);
+    const float t8 = t1 + t2;
+    const float t9 = wheel_velocity(1) - t0 - t8;
+    const float t10 = t9 * mu(4);
+    const float t11 = t0 + wheel_velocity(2) - t8;
+    const float t12 = t11 * mu(5);
+    mu_hat(0) = 0.001f * (mu(1) * mu(2)) + mu(0) - 0.00016809096f * (t5 + t7 - t10 - t12);
+    const float t14 = t7 + t10;
+    const float t15 = t12 + t5;
+    mu_hat(1) = 0.00025213647f * (t14 - t15) + mu(1) - 0.001f * (mu(0) * mu(2));
+    mu_hat(2) = 0.007571658f * (t15 + t14) + mu(2);
+    mu_hat(3) = mu(3);
+    mu_hat(4) = mu(4);
+    mu_hat(5) = mu(5);
+    mu_hat(6) = mu(6);
+    const float t18 = mu(3) + mu(4);
+    const float t19 = mu(5) + mu(6);
+    const float t20 = t18 + t19;
+    G(0, 0) = 1.0f - 9.324009e-05f * t20;
+    const float t21 = mu(3) - mu(4);
+    const float t22 = mu(5) - mu(6);
+    const float t23 = t21 + t22;
+    const float t24 = 0.00013986015f * t23;
+    const float t25 = 0.001f * mu(2);
+    G(0, 1) = t24 + t25;
+    const float t26 = t21 - t22;
+    G(0, 2) = 1.2727272e-05f * t26 + 0.001f * mu(1);
+    G(0, 3) = -0.00016809096f * t6;
+    G(0, 4) = 0.00016809096f * t9;
+    G(0, 5) = 0.00016809096f * t11;
+    G(0, 6) = -0.00016809096f * t4;
+    G(1, 0) = t24 - t25;
+    G(1, 1) = 1.0f - 0.00020979022f * t20;
+    const float t27 = t18 - t19;
+    G(1, 2) = -0.001f * mu(0) - 1.909091e-05f * t27;
+    G(1, 3) = 0.00025213647f * t6;
+    G(1, 4) = 0.00025213647f * t9;
+    G(1, 5) = -0.00025213647f * t11;
+    G(1, 6) = -0.00025213647f * t4;
+    G(2, 0) = 0.0042f * t26;
+    G(2, 1) = -0.0063000005f * t27;
+    G(2, 2) = 1.0f - 0.0005733f * t20;
+    G(2, 3) = 0.007571658f * t6;
+    G(2, 4) = 0.007571658f * t9;
+    G(2, 5) = 0.007571658f * t11;
+    G(2, 6) = 0.007571658f * t4;
+    H(0, 0) = -423.72928f * mu(3);
+    H(0, 1) = 635.59393f * mu(3);
+    H(0, 2) = 57.83905f * mu(3);
+    const float t28 = 0.8320503f * mu_hat(1);
+    const float t29 = 0.07571658f * mu_hat(2);
+    const float t30 = 0.5547002f * mu_hat(0);
+    const float t31 = t29 - t30;
+    const float t32 = wheel_velocity(0) - t28 - t31;
+    H(0, 3) = -763.88885f * t32;
+    H(1, 0) = 423.72928f * mu(4);
+    H(1, 1) = 635.59393f * mu(4);
+    H(1, 2) = 57.83905f * mu(4);
+    const float t33 = t29 + t30;
+    const float t34 = wheel_velocity(1) - t28 - t33;
+    H(1, 4) = -763.88885f * t34;
+    H(2, 0) = 423.72928f * mu(5);
+    H(2, 1) = -635.59393f * mu(5);
+    H(2, 2) = 57.83905f * mu(5);
+    const float t35 = t28 + wheel_velocity(2) - t33;
+    H(2, 5) = -763.88885f * t35;
+    H(3, 0) = -423.72928f * mu(6);
+    H(3, 1) = -635.59393f * mu(6);
+    H(3, 2) = 57.83905f * mu(6);
+    const float t36 = t28 + wheel_velocity(3) - t31;
+    H(3, 6) = -763.88885f * t36;
+    H(4, 0) = -0.09324009f * t20;
+    const float t37 = 0.13986014f * t23;
+    H(4, 1) = t37;
+    H(4, 2) = 0.012727273f * t26;
+    H(4, 3) = -0.16809097f * t32;
+    H(4, 4) = 0.16809097f * t34;
+    H(4, 5) = 0.16809097f * t35;
+    H(4, 6) = -0.16809097f * t36;
+    H(5, 0) = t37;
+    H(5, 1) = -0.20979021f * t20;
+    H(5, 2) = -0.01909091f * t27;
+    H(5, 3) = 0.25213647f * t32;
+    H(5, 4) = 0.25213647f * t34;
+    H(5, 5) = -0.25213647f * t35;
+    H(5, 6) = -0.25213647f * t36;
+    const float t38 = t32 * mu(3);
+    h_minus_z(0) = 3638.8887f * wheel_current(0) - 36363.637f * (wheel_velocity(0) - last_wheel_velocity(0)) - 763.88885f * t38;
+    const float t39 = t34 * mu(4);
+    h_minus_z(1) = 3638.8887f * wheel_current(1) - 36363.637f * (wheel_velocity(1) - last_wheel_velocity(1)) - 763.88885f * t39;
+    const float t40 = t35 * mu(5);
+    h_minus_z(2) = 3638.8887f * wheel_current(2) - 36363.637f * (wheel_velocity(2) - last_wheel_velocity(2)) - 763.88885f * t40;
+    const float t41 = t36 * mu(6);
+    h_minus_z(3) = 3638.8887f * wheel_current(3) - 36363.637f * (wheel_velocity(3) - last_wheel_velocity(3)) - 763.88885f * t41;
+    const float t42 = t38 - t40;
+    const float t43 = t39 - t41;
+    h_minus_z(4) = -0.16809097f * (t42 - t43) - accel.x();
+    h_minus_z(5) = 0.25213647f * (t42 + t43) - accel.y();
+    h_minus_z(6) = mu_hat(2) - gyro.z();
+    R(0) = 1328.151f;
+    R(1) = 1328.151f;
+    R(2) = 1328.151f;
+    R(3) = 1328.151f;
+    R(4) = 0.0001f;
+    R(5) = 0.0001f;
+    R(6) = 0.0001f;
+    const float t44 = t20 * t20;
+    Q(0) = 8.547009e-17f * t44;
+    Q(1) = 1.9230771e-16f * t44;
+    Q(2) = 1.7342327e-13f * t44;
+    Q(3) = 0.01f;
+    Q(4) = 0.01f;
+    Q(5) = 0.01f;
+    Q(6) = 0.01f;
+    kf_hat_mean = 0.25f * t20;
+}
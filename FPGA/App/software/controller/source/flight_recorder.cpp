@@ -0,0 +1,71 @@
+/**
+ * @file flight_recorder.cpp
+ * @author Fujii Naomichi
+ * @copyright (c) 2021 Fujii Naomichi
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "flight_recorder.hpp"
+#include "event_log.hpp"
+#include "shared_memory_manager.hpp"
+#include <driver/critical_section.hpp>
+#include <peripheral/imu_spim.hpp>
+#include <peripheral/vector_controller.hpp>
+#include <system.h>
+
+void FlightRecorder::record(void) {
+    SharedMemory::FlightRecorder &recorder = SharedMemoryManager::getFlightRecorder();
+    if (__builtin_ldwio(&recorder.frozen) != 0) {
+        return;
+    }
+
+    // 換算する前のレジスタの値を記録する
+    // I/O命令で書き込み、記録を書き終えてからwrite_indexとfrozenを書き込む順序をコンパイラに入れ替えさせない
+    uint32_t index = __builtin_ldwio(&recorder.write_index);
+    SharedMemory::FlightRecorder::Record &record = recorder.records[index];
+    __builtin_stwio(&record.tick, EventLog::tick());
+    __builtin_sthio(&record.accelerometer[0], IMU_SPIM_GetAccelDataX(IMU_SPIM_BASE));
+    __builtin_sthio(&record.accelerometer[1], IMU_SPIM_GetAccelDataY(IMU_SPIM_BASE));
+    __builtin_sthio(&record.accelerometer[2], IMU_SPIM_GetAccelDataZ(IMU_SPIM_BASE));
+    __builtin_sthio(&record.gyroscope[0], IMU_SPIM_GetGyroDataX(IMU_SPIM_BASE));
+    __builtin_sthio(&record.gyroscope[1], IMU_SPIM_GetGyroDataY(IMU_SPIM_BASE));
+    __builtin_sthio(&record.gyroscope[2], IMU_SPIM_GetGyroDataZ(IMU_SPIM_BASE));
+    for (int i = 0; i < 4; i++) {
+        __builtin_sthio(&record.encoder[i], VectorController::getEncoderValue(i + 1));
+        __builtin_sthio(&record.current_d[i], VectorController::getCurrentMeasurementD(i + 1));
+        __builtin_sthio(&record.current_q[i], VectorController::getCurrentMeasurementQ(i + 1));
+        __builtin_sthio(&record.current_ref[i], VectorController::getCurrentReferenceQ(i + 1));
+    }
+    __builtin_sthio(&record.status, VectorController::getStatusRegister());
+    __builtin_sthio(&record.fault, VectorController::getFaultRegister());
+    index = (index + 1 < SharedMemory::FlightRecorder::SIZE) ? (index + 1) : 0;
+    __builtin_stwio(&recorder.write_index, index);
+
+    // 凍結を要求されていればこの記録を最後に凍結する
+    if (_freeze_requested) {
+        __builtin_stwio(&recorder.frozen, 1);
+    }
+}
+
+void FlightRecorder::freeze(uint32_t error_flags, uint32_t fault_flags) {
+    CriticalSection cs;
+    SharedMemory::FlightRecorder &recorder = SharedMemoryManager::getFlightRecorder();
+    if ((__builtin_ldwio(&recorder.frozen) != 0) || _freeze_requested) {
+        return;
+    }
+    __builtin_stwio(&recorder.error_flags, error_flags);
+    __builtin_stwio(&recorder.fault_flags, fault_flags);
+    _freeze_requested = true;
+}
+
+void FlightRecorder::rearm(void) {
+    CriticalSection cs;
+    SharedMemory::FlightRecorder &recorder = SharedMemoryManager::getFlightRecorder();
+    __builtin_stwio(&recorder.frozen, 0);
+    __builtin_stwio(&recorder.write_index, 0);
+    __builtin_stwio(&recorder.error_flags, 0);
+    __builtin_stwio(&recorder.fault_flags, 0);
+    _freeze_requested = false;
+}
+
+volatile bool FlightRecorder::_freeze_requested = false;
@@ -0,0 +1,48 @@
+/**
+ * @file flight_recorder.hpp
+ * @author Fujii Naomichi
+ * @copyright (c) 2021 Fujii Naomichi
+ * SPDX-License-Identifier: MIT
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <shared_memory.hpp>
+
+/**
+ * @brief 制御周期ごとのセンサーと指令値のレジスタ値を共有メモリーのリングバッファに記録し、異常の発生時に凍結する
+ */
+class FlightRecorder {
+public:
+    /**
+     * @brief 記録を破棄して記録を開始する
+     */
+    static void initialize(void) {
+        rearm();
+    }
+
+    /**
+     * @brief 現在のレジスタ値を記録する
+     * 制御ループでレジスタに指令値を書き込んだ後に呼ぶ
+     * freeze()が呼ばれていたときは、この記録を最後に凍結する
+     */
+    static void record(void);
+
+    /**
+     * @brief 次のrecord()で記録を凍結する
+     * 既に凍結しているか凍結を要求しているときは何もしない
+     * @param error_flags エラーフラグ
+     * @param fault_flags フォルトフラグ
+     */
+    static void freeze(uint32_t error_flags, uint32_t fault_flags);
+
+    /**
+     * @brief 記録を破棄して記録を再開する
+     */
+    static void rearm(void);
+
+private:
+    /// freeze()で凍結を要求されたときtrue
+    static volatile bool _freeze_requested;
+};
@@ -7,19 +7,26 @@
 
 #pragma once
 
-#include <system.h>
 #include <cstdint>
 
+#ifdef __nios2__
+#include <system.h>
+
 #undef sqrtf
 #undef lroundf
 #undef fmaxf
 #undef fminf
+#else
+#include <cmath>
+#include <cstring>
+#endif
 
 /// 半精度浮動小数点数をuint16_tに格納するために型宣言する
 using __fp16 = std::uint16_t;
 
 namespace fpu {
 
+#ifdef __nios2__
 static inline float max(float a, float b) {
     return __builtin_custom_fnff(ALT_CI_NIOS_CUSTOM_INSTR_FLOATING_POINT_2_0_FMAXS_N, a, b);
 }
@@ -35,11 +42,42 @@ static inline int round(float a) {
 static inline float sqrt(float a) {
     return __builtin_custom_fnf(ALT_CI_NIOS_CUSTOM_INSTR_FLOATING_POINT_2_0_1_FSQRTS_N, a);
 }
+#else
+// ホストでビルドするときは標準ライブラリで同じ処理を行う
+
+static inline float max(float a, float b) {
+    return std::fmax(a, b);
+}
+
+static inline float min(float a, float b) {
+    return std::fmin(a, b);
+}
+
+static inline int round(float a) {
+    return static_cast<int>(std::lround(a));
+}
+
+static inline float sqrt(float a) {
+    return std::sqrt(a);
+}
+#endif
 
 static inline float clamp(float value, float min_value, float max_value) {
     return max(min_value, min(max_value, value));
 }
 
+/**
+ * @brief 有限の値か調べる
+ * -ffast-mathではisfinite()が常にtrueに畳み込まれるので、指数部のビットで調べる
+ * @param a 単精度浮動小数点数
+ * @return 無限大とNaNでなければtrue
+ */
+static inline bool isFinite(float a) {
+    std::uint32_t x;
+    __builtin_memcpy(&x, &a, sizeof(x));
+    return ((x >> 23) & 0xFF) != 0xFF;
+}
+
 /**
  * @brief 単精度浮動小数点数を半精度浮動小数点数に変換する。
  * カスタム命令により高速に変換できる。
@@ -47,7 +85,39 @@ static inline float clamp(float value, float min_value, float max_value) {
  * @return 半精度浮動小数点数 (上位16bitは0)
  */
 static inline int to_fp16(float a) {
+#ifdef __nios2__
     return __builtin_custom_inf(ALT_CI_FLOAT32TO16_0_N, a);
+#else
+    // 最近接偶数丸めでソフトウェア変換する
+    std::uint32_t x;
+    std::memcpy(&x, &a, sizeof(x));
+    std::uint32_t sign = (x >> 16) & 0x8000;
+    std::uint32_t mantissa = x & 0x7FFFFF;
+    int exponent = static_cast<int>((x >> 23) & 0xFF) - 127 + 15;
+    if (((x >> 23) & 0xFF) == 0xFF) {
+        return static_cast<int>(sign | 0x7C00 | (mantissa ? 0x200 : 0));
+    }
+    if (31 <= exponent) {
+        return static_cast<int>(sign | 0x7C00);
+    }
+    int shift = 13;
+    std::uint32_t half = (static_cast<std::uint32_t>(exponent) << 10);
+    if (exponent <= 0) {
+        if (exponent < -10) {
+            return static_cast<int>(sign);
+        }
+        mantissa |= 0x800000;
+        shift = 14 - exponent;
+        half = 0;
+    }
+    std::uint32_t remainder = mantissa & ((1U << shift) - 1);
+    std::uint32_t middle = 1U << (shift - 1);
+    half += mantissa >> shift;
+    if ((middle < remainder) || ((remainder == middle) && (half & 1))) {
+        half++;
+    }
+    return static_cast<int>(sign | half);
+#endif
 }
 
 }
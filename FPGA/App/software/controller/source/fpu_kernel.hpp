@@ -0,0 +1,47 @@
+/**
+ * @file fpu_kernel.hpp
+ * @author Fujii Naomichi
+ * @copyright (c) 2021 Fujii Naomichi
+ * SPDX-License-Identifier: MIT
+ */
+
+#pragma once
+
+/*
+ * 行列演算カーネルで使う単精度浮動小数点数の演算を定義する
+ *   MUL(dst, src1, src2) : dst = src1 * src2
+ *   ACC(dst, src)        : dst = dst + src
+ *   SAC(dst, src)        : dst = dst - src
+ *
+ * 次のバックエンドから選択される
+ *   FPU_KERNEL_NIOS2  : Nios IIのカスタム命令。コンパイラに順序を入れ替えさせずに記述した順で発行してFPUのレイテンシを隠す
+ *   FPU_KERNEL_SSE    : x86のSSE命令。MUL, ACC, SACはFPU_KERNEL_SCALARと同じで、matrix_kernel.hppの行列の積が
+ *                       独立な4行をパックド命令の4レーンで同時に計算する (-mavxを付けるとVEX命令になる)
+ *   FPU_KERNEL_SCALAR : 移植性のあるC++の実装。参照実装として使う
+ *
+ * ホストのバックエンドはどのレーンも記述した順に1演算ずつ丸めるので、-ffp-contract=off かつ -ffast-math なしで
+ * ビルドすればFPU_KERNEL_SCALARとFPU_KERNEL_SSEはビット単位で一致する (tools/fpu_kernel_test.cppで確認する)。
+ * FPU_KERNEL_SCALARを定義するとホストでもFPU_KERNEL_SCALARを使う。
+ */
+
+#if defined(__nios2__)
+#define FPU_KERNEL_NIOS2
+#define MUL(dst, src1, src2) __asm__ __volatile__("custom 252,%0,%1,%2" : "=r"(dst) : "r"(src1), "r"(src2) : "memory")
+#define ACC(dst, src)        __asm__ __volatile__("custom 253,%0,%1,%2" : "=r"(dst) : "r"(dst), "r"(src) : "memory")
+#define SAC(dst, src)        __asm__ __volatile__("custom 254,%0,%1,%2" : "=r"(dst) : "r"(dst), "r"(src) : "memory")
+
+#elif !defined(FPU_KERNEL_SCALAR) && (defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && (1 <= _M_IX86_FP)))
+#include <xmmintrin.h>
+#define FPU_KERNEL_SSE
+#define MUL(dst, src1, src2) dst = (src1) * (src2)
+#define ACC(dst, src)        dst = (dst) + (src)
+#define SAC(dst, src)        dst = (dst) - (src)
+
+#else
+#ifndef FPU_KERNEL_SCALAR
+#define FPU_KERNEL_SCALAR
+#endif
+#define MUL(dst, src1, src2) dst = (src1) * (src2)
+#define ACC(dst, src)        dst = (dst) + (src)
+#define SAC(dst, src)        dst = (dst) - (src)
+#endif
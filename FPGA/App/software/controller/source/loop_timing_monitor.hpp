@@ -0,0 +1,178 @@
+/**
+ * @file loop_timing_monitor.hpp
+ * @author Fujii Naomichi
+ * @copyright (c) 2021 Fujii Naomichi
+ * SPDX-License-Identifier: MIT
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * @brief 制御ループの割り込みハンドラの入口と出口のタイムスタンプから周期の揺らぎを測る
+ * IMUのデータ準備完了信号はIMUに供給しているクロックから作られるので、割り込みの要因は一定の周期で発生する
+ * そのため入口の時刻と一定周期の格子とのずれの変動幅は、割り込みが要因から遅れた時間の変動幅に等しい
+ * 格子の周期はIMUとCPUのクロックの誤差を除くため、前回の統計値の区間で測った周期の平均値を使う
+ * 要因の発生時刻そのものはハードウェアで記録していないので、遅れの絶対値は測れない
+ */
+class LoopTimingMonitor {
+public:
+    /// 前回clearStatistics()を呼んでからの統計値 (単位は全てサイクル数)
+    struct Statistics_t {
+        /// 周期を測った回数
+        uint32_t count;
+
+        /// 入口から次の入口までの周期の最小値
+        uint32_t min_period;
+
+        /// 入口から次の入口までの周期の最大値
+        uint32_t max_period;
+
+        /// 入口から次の入口までの周期の合計
+        uint32_t sum_period;
+
+        /// 入口の時刻と一定周期の格子とのずれの変動幅 (割り込みの遅れの変動幅)
+        uint32_t latency_jitter;
+
+        /// 出口から次の入口までの時間の最小値
+        uint32_t min_slack;
+
+        /// 入口から出口までの時間の最大値
+        uint32_t max_busy;
+
+        /// 公称周期の1.5倍を超えた周期の数 (割り込みを取りこぼした回数)
+        uint32_t overrun_count;
+    };
+
+    /**
+     * @brief 前回の入口と出口の時刻を破棄し、統計値をクリアする
+     * @param nominal_period 公称周期 [サイクル]
+     */
+    void reset(uint32_t nominal_period) {
+        _nominal_period = nominal_period;
+        _grid_period_q8 = nominal_period << 8;
+        _regular_count = 0;
+        _regular_sum = 0;
+        _running = false;
+        clearStatistics();
+    }
+
+    /**
+     * @brief 割り込みハンドラの入口で呼ぶ
+     * @param timestamp 現在の時刻 [サイクル]
+     */
+    void enter(uint32_t timestamp) {
+        if (_running) {
+            Statistics_t &statistics = _statistics;
+            uint32_t period = timestamp - _entry_timestamp;
+            uint32_t slack = timestamp - _exit_timestamp;
+            if ((statistics.count == 0) || (period < statistics.min_period)) {
+                statistics.min_period = period;
+            }
+            if (statistics.max_period < period) {
+                statistics.max_period = period;
+            }
+            if ((statistics.count == 0) || (slack < statistics.min_slack)) {
+                statistics.min_slack = slack;
+            }
+            statistics.count++;
+            statistics.sum_period += period;
+
+            // 取りこぼした周期は格子の周期の整数倍として差し引き、格子とのずれを下位8bitを小数部とする固定小数点数で積算する
+            uint32_t multiple = 1;
+            if ((_nominal_period + _nominal_period / 2) < period) {
+                statistics.overrun_count++;
+                multiple = (period + _nominal_period / 2) / _nominal_period;
+            }
+            else {
+                _regular_count++;
+                _regular_sum += period;
+            }
+            _phase_q8 += static_cast<int32_t>((period << 8) - multiple * _grid_period_q8);
+            if (_phase_q8 < _min_phase_q8) {
+                _min_phase_q8 = _phase_q8;
+            }
+            if (_max_phase_q8 < _phase_q8) {
+                _max_phase_q8 = _phase_q8;
+            }
+            statistics.latency_jitter = static_cast<uint32_t>(_max_phase_q8 - _min_phase_q8) >> 8;
+        }
+        _entry_timestamp = timestamp;
+    }
+
+    /**
+     * @brief 割り込みハンドラの出口で呼ぶ
+     * @param timestamp 現在の時刻 [サイクル]
+     */
+    void exit(uint32_t timestamp) {
+        uint32_t busy = timestamp - _entry_timestamp;
+        if (_statistics.max_busy < busy) {
+            _statistics.max_busy = busy;
+        }
+        _exit_timestamp = timestamp;
+        _running = true;
+    }
+
+    /**
+     * @brief 前回clearStatistics()を呼んでからの統計値を取得する
+     * @return 統計値
+     */
+    const Statistics_t& statistics(void) const {
+        return _statistics;
+    }
+
+    /**
+     * @brief 統計値をクリアする
+     * 格子の周期をこれまでに測った周期の平均値で更新し、格子とのずれは次の入口を基準にして測り直す
+     */
+    void clearStatistics(void) {
+        if (0 < _regular_count) {
+            _grid_period_q8 = static_cast<uint32_t>((static_cast<uint64_t>(_regular_sum) << 8) / _regular_count);
+            _regular_count = 0;
+            _regular_sum = 0;
+        }
+        _statistics.count = 0;
+        _statistics.min_period = 0;
+        _statistics.max_period = 0;
+        _statistics.sum_period = 0;
+        _statistics.latency_jitter = 0;
+        _statistics.min_slack = 0;
+        _statistics.max_busy = 0;
+        _statistics.overrun_count = 0;
+        _phase_q8 = 0;
+        _min_phase_q8 = 0;
+        _max_phase_q8 = 0;
+    }
+
+private:
+    /// 公称周期 [サイクル]
+    uint32_t _nominal_period;
+
+    /// 格子の周期 [1/256サイクル]
+    uint32_t _grid_period_q8;
+
+    /// 取りこぼしの無かった周期を測った回数
+    uint32_t _regular_count;
+
+    /// 取りこぼしの無かった周期の合計 [サイクル]
+    uint32_t _regular_sum;
+
+    /// 前回の入口と出口の時刻が有効ならtrue
+    bool _running;
+
+    /// 前回の入口の時刻 [サイクル]
+    uint32_t _entry_timestamp;
+
+    /// 前回の出口の時刻 [サイクル]
+    uint32_t _exit_timestamp;
+
+    /// 統計値をクリアしてからの入口の時刻と格子とのずれ [1/256サイクル]
+    int32_t _phase_q8;
+
+    /// _phase_q8の最小値と最大値 [1/256サイクル]
+    int32_t _min_phase_q8, _max_phase_q8;
+
+    /// 統計値
+    Statistics_t _statistics;
+};
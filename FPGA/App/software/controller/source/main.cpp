@@ -52,7 +52,9 @@ int main(void) {
         start_peripheral();
     }
 
+    // 割り込みハンドラの外で行う処理を繰り返す
     while (true) {
+        CentralizedMonitor::doBackgroundWork();
     }
 
     return 0;
@@ -0,0 +1,34 @@
+/**
+ * @file performance_counter.hpp
+ * @author Fujii Naomichi
+ * @copyright (c) 2021 Fujii Naomichi
+ * SPDX-License-Identifier: MIT
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <system.h>
+
+class PerformanceCounter {
+private:
+    static constexpr uint32_t BASE = PERFORMANCE_COUNTER_0_BASE;
+
+    struct Register_t {
+        volatile uint32_t GLOBAL_TIME_LO;
+        volatile uint32_t GLOBAL_TIME_HI;
+        volatile uint32_t GLOBAL_EVENTS;
+        volatile uint32_t RESERVED;
+    };
+
+public:
+    /**
+     * グローバルカウンタの下位32bitを読み出す
+     * PERF_START_MEASURING()からの経過サイクル数を測定を止めずに取得できるので、
+     * 2回読んだ値の差からセクションを追加せずに任意の区間のサイクル数を求められる
+     * @return サイクル数
+     */
+    static uint32_t getGlobalCycles(void) {
+        return __builtin_ldwio(&reinterpret_cast<Register_t*>(BASE)->GLOBAL_TIME_LO);
+    }
+};
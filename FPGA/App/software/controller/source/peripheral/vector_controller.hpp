@@ -57,8 +57,8 @@ public:
     }
 
 private:
-    VectorControllerStatus(int status) {
-        status = status;
+    VectorControllerStatus(int status_) {
+        status = status_;
     }
 };
 
@@ -123,6 +123,14 @@ public:
         return __builtin_ldhuio(&reinterpret_cast<Register_t*>(BASE)->FAULT) & 0x1;
     }
 
+    static uint16_t getStatusRegister(void) {
+        return __builtin_ldhuio(&reinterpret_cast<Register_t*>(BASE)->STATUS);
+    }
+
+    static uint16_t getFaultRegister(void) {
+        return __builtin_ldhuio(&reinterpret_cast<Register_t*>(BASE)->FAULT);
+    }
+
     static void setBrakeEnabled(int number) {
         __builtin_sthio(&reinterpret_cast<Register_t*>(BASE)->FAULT, 0x1 << (2 * number));
     }
@@ -66,6 +66,22 @@ public:
      */
     static void clearParameters(void);
 
+    /**
+     * 共有メモリーのフライトレコーダーの領域を取得する
+     * @return フライトレコーダーの領域への参照 (非キャッシュ領域)
+     */
+    static SharedMemory::FlightRecorder& getFlightRecorder(void) {
+        return getNonCachedSharedMemory()->flight_recorder;
+    }
+
+    /**
+     * 共有メモリーのイベントログの領域を取得する
+     * @return イベントログの領域への参照 (非キャッシュ領域)
+     */
+    static SharedMemory::EventLog& getEventLog(void) {
+        return getNonCachedSharedMemory()->event_log;
+    }
+
 private:
     /**
      * 共有メモリーへのポインタを取得する
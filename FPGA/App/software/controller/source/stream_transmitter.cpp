@@ -10,6 +10,18 @@
 #include <fpu.hpp>
 #include <stream_data.hpp>
 #include <peripheral/msgdma.hpp>
+#include <string.h>
+
+/**
+ * @brief 単精度浮動小数点数のビット列を__builtin_stwio()に渡せる整数として取り出す
+ * @param a 単精度浮動小数点数
+ * @return aのビット列
+ */
+static inline int floatToBits(float a) {
+    int bits;
+    memcpy(&bits, &a, sizeof(bits));
+    return bits;
+}
 
 static StreamDataStatus StreamDataStatus;
 static constexpr MsgdmaTransmitDescriptor StreamDataDesciptorStatus(StreamDataStatus, StreamIdStatus);
@@ -20,6 +32,23 @@ static constexpr MsgdmaTransmitDescriptor StreamDataDesciptorAdc2(StreamDataAdc2
 static StreamDataMotion StreamDataMotion;
 static constexpr MsgdmaTransmitDescriptor StreamDataDesciptorMotion(StreamDataMotion, StreamIdMotion);
 
+static StreamDataEstimator StreamDataEstimator;
+static constexpr MsgdmaTransmitDescriptor StreamDataDesciptorEstimator(StreamDataEstimator, StreamIdEstimator);
+
+static StreamDataTraction StreamDataTraction;
+static constexpr MsgdmaTransmitDescriptor StreamDataDesciptorTraction(StreamDataTraction, StreamIdTraction);
+
+static StreamDataPose StreamDataPose;
+static constexpr MsgdmaTransmitDescriptor StreamDataDesciptorPose(StreamDataPose, StreamIdPose);
+
+static StreamDataProfile StreamDataProfile;
+static constexpr MsgdmaTransmitDescriptor StreamDataDesciptorProfile(StreamDataProfile, StreamIdProfile);
+static StreamDataLoopTiming StreamDataLoopTiming;
+static constexpr MsgdmaTransmitDescriptor StreamDataDesciptorLoopTiming(StreamDataLoopTiming, StreamIdLoopTiming);
+
+static_assert(CycleProfiler::SECTIONS == 7, "StreamDataProfile must have one entry per CycleProfiler section");
+static_assert(CycleProfiler::HISTOGRAM_SIZE == 12, "StreamDataProfile must have one entry per histogram bucket");
+
 void StreamTransmitter::transmitStatus(void) {
     // データキャッシュが有効になっている場合に備えてデータの格納には__builtin_st〇io()という系列のビルトイン関数を使用する
     __builtin_stwio(&StreamDataStatus.error_flags, CentralizedMonitor::getErrorFlags());
@@ -34,7 +63,8 @@ void StreamTransmitter::transmitAdc2(const Adc2Data_t &adc2_data) {
     StreamDataDesciptorAdc2.transmitAsync(_device);
 }
 
-void StreamTransmitter::transmitMotion(const MotionData_t &motion_data, const ControlData_t &control_data, int performance_counter) {
+void StreamTransmitter::transmitMotion(const MotionData_t &motion_data, const ControlData_t &control_data, int performance_counter, int performance_counter_velocity_filter,
+                                       int performance_counter_velocity_filter_covariance, int velocity_filter_decimation) {
     __builtin_sthio(&StreamDataMotion.accelerometer[0], fpu::to_fp16(motion_data.accelerometer(0)));
     __builtin_sthio(&StreamDataMotion.accelerometer[1], fpu::to_fp16(motion_data.accelerometer(1)));
     __builtin_sthio(&StreamDataMotion.accelerometer[2], fpu::to_fp16(motion_data.accelerometer(2)));
@@ -71,7 +101,70 @@ void StreamTransmitter::transmitMotion(const MotionData_t &motion_data, const Co
     __builtin_sthio(&StreamDataMotion.body_ref_accel[2], fpu::to_fp16(control_data.body_ref_accel(2)));
     __builtin_sthio(&StreamDataMotion.body_ref_accel[3], fpu::to_fp16(control_data.body_ref_accel(3)));
     __builtin_sthio(&StreamDataMotion.performance_counter, static_cast<uint16_t>(performance_counter));
+    __builtin_sthio(&StreamDataMotion.performance_counter_velocity_filter, static_cast<uint16_t>(performance_counter_velocity_filter));
+    __builtin_sthio(&StreamDataMotion.performance_counter_velocity_filter_covariance, static_cast<uint16_t>(performance_counter_velocity_filter_covariance));
+    __builtin_sthio(&StreamDataMotion.velocity_filter_decimation, static_cast<uint16_t>(velocity_filter_decimation));
     StreamDataDesciptorMotion.transmitAsync(_device);
 }
 
+void StreamTransmitter::transmitEstimator(const VelocityFilter::Statistics_t &statistics, float covariance_trace) {
+    float inv_count = (0 < statistics.nis_count) ? (1.0f / static_cast<float>(statistics.nis_count)) : 0.0f;
+    for (int i = 0; i < 7; i++) {
+        __builtin_sthio(&StreamDataEstimator.nis_mean[i], fpu::to_fp16(statistics.nis_sum[i] * inv_count));
+    }
+    __builtin_sthio(&StreamDataEstimator.covariance_trace, fpu::to_fp16(covariance_trace));
+    __builtin_sthio(&StreamDataEstimator.min_pivot, fpu::to_fp16(fpu::sqrt(statistics.min_pivot_squared)));
+    __builtin_sthio(&StreamDataEstimator.update_count, static_cast<uint16_t>(statistics.nis_count));
+    __builtin_sthio(&StreamDataEstimator.kf_clamp_min_count, static_cast<uint16_t>(statistics.kf_clamp_min_count));
+    __builtin_sthio(&StreamDataEstimator.kf_clamp_max_count, static_cast<uint16_t>(statistics.kf_clamp_max_count));
+    StreamDataDesciptorEstimator.transmitAsync(_device);
+}
+
+void StreamTransmitter::transmitTraction(const TractionLimitter::Statistics_t &statistics, const Eigen::Vector4f &friction_coefficients) {
+    for (int i = 0; i < TractionLimitter::WHEELS; i++) {
+        __builtin_sthio(&StreamDataTraction.friction_coefficient[i], fpu::to_fp16(friction_coefficients[i]));
+        __builtin_sthio(&StreamDataTraction.max_slip_velocity[i], fpu::to_fp16(statistics.max_slip_velocity[i]));
+        __builtin_sthio(&StreamDataTraction.min_current_limit[i], fpu::to_fp16(statistics.min_current_limit[i]));
+    }
+    __builtin_sthio(&StreamDataTraction.slip_state, static_cast<uint16_t>(statistics.slip_state));
+    StreamDataDesciptorTraction.transmitAsync(_device);
+}
+
+void StreamTransmitter::transmitPose(const Eigen::Vector3f &pose, uint32_t reset_number) {
+    // 位置は半精度では分解能が足りないので単精度のまま送る
+    __builtin_stwio(&StreamDataPose.pose[0], floatToBits(pose[0]));
+    __builtin_stwio(&StreamDataPose.pose[1], floatToBits(pose[1]));
+    __builtin_stwio(&StreamDataPose.pose[2], floatToBits(pose[2]));
+    __builtin_stwio(&StreamDataPose.reset_number, reset_number);
+    StreamDataDesciptorPose.transmitAsync(_device);
+}
+
+void StreamTransmitter::transmitProfile(const CycleProfiler::Statistics_t (&statistics)[CycleProfiler::SECTIONS]) {
+    for (int section = 0; section < CycleProfiler::SECTIONS; section++) {
+        auto &section_statistics = statistics[section];
+        uint32_t mean_cycles = (0 < section_statistics.count) ? static_cast<uint32_t>(section_statistics.sum_cycles / section_statistics.count) : 0;
+        __builtin_stwio(&StreamDataProfile.count[section], section_statistics.count);
+        __builtin_stwio(&StreamDataProfile.min_cycles[section], section_statistics.min_cycles);
+        __builtin_stwio(&StreamDataProfile.mean_cycles[section], mean_cycles);
+        __builtin_stwio(&StreamDataProfile.max_cycles[section], section_statistics.max_cycles);
+        for (int index = 0; index < CycleProfiler::HISTOGRAM_SIZE; index++) {
+            __builtin_sthio(&StreamDataProfile.histogram[section][index], section_statistics.histogram[index]);
+        }
+    }
+    StreamDataDesciptorProfile.transmitAsync(_device);
+}
+
+void StreamTransmitter::transmitLoopTiming(const LoopTimingMonitor::Statistics_t &statistics) {
+    uint32_t mean_period = (0 < statistics.count) ? (statistics.sum_period / statistics.count) : 0;
+    __builtin_stwio(&StreamDataLoopTiming.count, statistics.count);
+    __builtin_stwio(&StreamDataLoopTiming.min_period, statistics.min_period);
+    __builtin_stwio(&StreamDataLoopTiming.mean_period, mean_period);
+    __builtin_stwio(&StreamDataLoopTiming.max_period, statistics.max_period);
+    __builtin_stwio(&StreamDataLoopTiming.latency_jitter, statistics.latency_jitter);
+    __builtin_stwio(&StreamDataLoopTiming.min_slack, statistics.min_slack);
+    __builtin_stwio(&StreamDataLoopTiming.max_busy, statistics.max_busy);
+    __builtin_stwio(&StreamDataLoopTiming.overrun_count, statistics.overrun_count);
+    StreamDataDesciptorLoopTiming.transmitAsync(_device);
+}
+
 alt_msgdma_dev *StreamTransmitter::_device;
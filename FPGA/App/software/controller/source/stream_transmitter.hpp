@@ -11,6 +11,10 @@
 #include <system.h>
 #include <altera_msgdma.h>
 #include "data_holder.hpp"
+#include "filter/velocity_filter.hpp"
+#include "filter/traction_limitter.hpp"
+#include "cycle_profiler.hpp"
+#include "loop_timing_monitor.hpp"
 
 /**
  * UARTでJetsonへ定期的にデータを送信する
@@ -41,8 +45,49 @@ public:
      * @param motion_data モーションデータ
      * @param control_data 制御データ
      * @param performance_counter パフォーマンスカウンタの値
+     * @param performance_counter_velocity_filter 速度フィルタの更新に要したサイクル数
+     * @param performance_counter_velocity_filter_covariance 速度フィルタが最後に共分散を更新したときの更新に要したサイクル数
+     * @param velocity_filter_decimation 速度フィルタの共分散を更新する間隔 [回]
      */
-    static void transmitMotion(const MotionData_t &motion_data, const ControlData_t &control_data, int performance_counter);
+    static void transmitMotion(const MotionData_t &motion_data, const ControlData_t &control_data, int performance_counter, int performance_counter_velocity_filter,
+                               int performance_counter_velocity_filter_covariance, int velocity_filter_decimation);
+
+    /**
+     * 速度フィルタの統計値を送信する
+     * NISは前回統計値をクリアしてからの平均値を送る
+     * @param statistics 速度フィルタの統計値
+     * @param covariance_trace 速度フィルタの共分散のトレース
+     */
+    static void transmitEstimator(const VelocityFilter::Statistics_t &statistics, float covariance_trace);
+
+    /**
+     * トラクションリミッタの統計値を送信する
+     * 滑り速度と電流制限値は前回統計値をクリアしてからの最悪値を送る
+     * @param statistics トラクションリミッタの統計値
+     * @param friction_coefficients 速度フィルタが推定した摩擦係数
+     */
+    static void transmitTraction(const TractionLimitter::Statistics_t &statistics, const Eigen::Vector4f &friction_coefficients);
+
+    /**
+     * 自己位置を送信する
+     * @param pose 自己位置 X [m], Y [m], θ [rad]
+     * @param reset_number 最後に適用した自己位置のリセットの番号
+     */
+    static void transmitPose(const Eigen::Vector3f &pose, uint32_t reset_number);
+
+    /**
+     * 区間ごとのサイクル数の統計値を送信する
+     * 平均値は前回統計値をクリアしてからの値を送る
+     * @param statistics CycleProfiler::snapshotAndClear()でコピーした統計値
+     */
+    static void transmitProfile(const CycleProfiler::Statistics_t (&statistics)[CycleProfiler::SECTIONS]);
+
+    /**
+     * 制御ループの周期の揺らぎの統計値を送信する
+     * 単位は全てサイクル数で、平均値は前回統計値をクリアしてからの値を送る
+     * @param statistics 統計値
+     */
+    static void transmitLoopTiming(const LoopTimingMonitor::Statistics_t &statistics);
 
 private:
     /// mSGDMAのハンドル
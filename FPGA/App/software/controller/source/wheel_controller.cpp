@@ -10,7 +10,9 @@
 #include "shared_memory_manager.hpp"
 #include "data_holder.hpp"
 #include "board.hpp"
+#include "cycle_profiler.hpp"
 #include <peripheral/vector_controller.hpp>
+#include <peripheral/performance_counter.hpp>
 #include <status_flags.hpp>
 #include <fpu.hpp>
 #include <system.h>
@@ -29,9 +31,6 @@ static constexpr float MAX_OMEGA_REFERENCE = 20.0f;
 /// 電流制限値の最小値 [A]
 static constexpr float MIN_CURRENT_LIMIT_PER_MOTOR = 0.25f;
 
-/// 電流制限値の最大値 [A]
-static constexpr float MAX_CURRENT_LIMIT_PER_MOTOR = 3.0f;
-
 /// スリップ抑制ゲイン [A/(m/s)]
 static constexpr float ANTI_SLIP_GAIN = 0.25f;
 
@@ -50,14 +49,43 @@ static constexpr float REF_ACCEL_DECAY = 1.0f / 128;
 /// モータードライバのベース消費電力 [W]
 static constexpr float BASE_POWER_CONSUMPTION_PER_MOTOR = 0.25f;
 
+/// 車輪速度あたりの逆起電力 [V/(m/s)]
+static constexpr float KV = MOTOR_TORQUE_CONSTANT / WHEEL_RADIUS;
+
+/// 全モーターの駆動電力の最大値 [W]
+/// DC48Vの電源の制限なので巻線の温度には依らない (BURST_CURRENTまでの電流の上乗せは各車輪の電流制限だけで行う)
+static constexpr float MAX_DRIVE_POWER = 4 * MOTOR_RATING_POWER;
+
+/// 全モーターの回生電力の最大値 [W]
+static constexpr float MAX_REGENERATION_POWER = 10.0f;
+
+/// 駆動電力を絞り始めるDC48Vの電圧 [V]
+static constexpr float DRIVE_POWER_DERATING_START_VOLTAGE = 44.0f;
+
+/// 駆動電力を0にするDC48Vの電圧 [V] (centralized_monitor.cppの低電圧閾値より少し高くする)
+static constexpr float DRIVE_POWER_DERATING_END_VOLTAGE = 41.0f;
+
+/// 回生電力を絞り始めるDC48Vの電圧 [V]
+static constexpr float REGENERATION_POWER_DERATING_START_VOLTAGE = 50.5f;
+
+/// 回生電力を0にするDC48Vの電圧 [V] (centralized_monitor.cppの過電圧閾値より少し低くする)
+static constexpr float REGENERATION_POWER_DERATING_END_VOLTAGE = 52.0f;
+
 /// ブレーキを有効にする回生エネルギーの閾値
 static constexpr float BRAKE_ENABLE_THRESHOLD = -0.01f;
 
 /// ブレーキを無効にする回生エネルギーの閾値
 static constexpr float BRAKE_DISABLE_THRESHOLD = -0.005f;
 
-/// 過電流閾値[A]
-static constexpr float OVER_CURRENT_THRESHOLD = 5.0f;
+/// 過電流閾値[A] (MotorThermalModel::BURST_CURRENTより余裕を持たせる)
+static constexpr float OVER_CURRENT_THRESHOLD = 6.0f;
+
+/// 速度フィルタの観測値による更新の方法
+/// UpdateModeSequentialとのサイクル数の比較は実機で未測定なので、StreamDataMotion::performance_counter_velocity_filterで測定するまで従来の方法を使う
+static constexpr VelocityFilter::UpdateMode_t VELOCITY_FILTER_UPDATE_MODE = VelocityFilter::UpdateModeBatch;
+
+/// 速度フィルタの共分散とカルマンゲインを更新する間隔 [回] (1のときは毎回更新する)
+static constexpr int VELOCITY_FILTER_COVARIANCE_DECIMATION = 1;
 
 /**
  * @brief 車輪速度ベクトルを車体速度ベクトルに変換する
@@ -122,7 +150,11 @@ void WheelController::stopControl(void) {
 
 void WheelController::initializeState(void) {
     _gravity_filter.reset();
+    _velocity_filter.setUpdateMode(VELOCITY_FILTER_UPDATE_MODE);
+    _velocity_filter.setCovarianceDecimation(VELOCITY_FILTER_COVARIANCE_DECIMATION);
     _velocity_filter.reset();
+    _acceleration_limitter.reset();
+    _traction_limitter.reset();
     _error_hpf[0].reset();
     _error_hpf[1].reset();
     _error_hpf[2].reset();
@@ -130,6 +162,15 @@ void WheelController::initializeState(void) {
     _ref_body_accel.setZero();
     _ref_wheel_current.setZero();
     _regeneration_energy.setZero();
+    clearFilterInputSum();
+}
+
+void WheelController::clearFilterInputSum(void) {
+    _filter_input_sum.body_acceleration.setZero();
+    _filter_input_sum.gyroscope.setZero();
+    _filter_input_sum.wheel_velocity.setZero();
+    _filter_input_sum.wheel_current_q.setZero();
+    _filter_input_sum.count = 0;
 }
 
 void WheelController::initializeRegisters(void) {
@@ -147,27 +188,75 @@ void WheelController::initializeRegisters(void) {
 void WheelController::update(bool new_parameters, bool sensor_only) {
     // センサーデータを取得する
     auto &motion = DataHolder::motionData();
+    float period = CentralizedMonitor::controlPeriod();
 
     // 車輪速度を取得し車体速度に換算する
     Vector4f wheel_velocity = motion.wheel_velocity;
     Vector4f body_velocity_by_wheels = velocityVectorComposition(wheel_velocity);
 
-    // 速度指令値が異常でないことを確認する
-    // 速度が速すぎるかNaNならspeed_ok==falseとなる
+    // 測定した電流から巻線の温度上昇を推定する
+    // 制御を止めている間も冷却を反映するために毎回更新する
+    _thermal_model.update(motion.wheel_current_d, motion.wheel_current_q, period);
+
+    // 軌道の経由点を補間して速度指令値を求める
+    // 新しいParametersを受け取ったときは経由点の時刻を0から数え直す
     auto &parameters = SharedMemoryManager::getParameters();
-    bool speed_ok = true;
-    speed_ok &= fabsf(parameters.speed_x) <= MAX_TRANSLATION_REFERENCE;
-    speed_ok &= fabsf(parameters.speed_y) <= MAX_TRANSLATION_REFERENCE;
-    speed_ok &= fabsf(parameters.speed_omega) <= MAX_OMEGA_REFERENCE;
+    if (new_parameters) {
+        _trajectory_interpolator.restart(parameters);
+    }
+
+    // 加速度リミッタの目的関数の重みは制御を開始するフレームを含めて受け取るたびに適用する
+    // 重みが変わったときだけ加速度リミッタの内部で分解し直す
+    if (new_parameters) {
+        _acceleration_limitter.setWeights(parameters.acceleration_weight);
+    }
+
+    // 自己位置のリセットの番号が変わったときは自己位置を指定された値にする
+    // 値が不正なときは番号を更新しないので、Jetsonはストリームの番号で適用されたかを確認できる
+    if (new_parameters && (parameters.pose_reset_number != _pose_reset_number)) {
+        if (_pose_integrator.reset(parameters.pose_offset[0], parameters.pose_offset[1], parameters.pose_offset[2])) {
+            _pose_reset_number = parameters.pose_reset_number;
+        }
+    }
+    Vector3f ref_velocity = Vector3f::Zero();
+    bool speed_ok = _trajectory_interpolator.update(parameters, period, ref_velocity);
+
+    // 速度指令値が異常でないことを確認する
+    // 経由点が不正か、速度が速すぎるかNaNならspeed_ok==falseとなる
+    speed_ok &= fabsf(ref_velocity[0]) <= MAX_TRANSLATION_REFERENCE;
+    speed_ok &= fabsf(ref_velocity[1]) <= MAX_TRANSLATION_REFERENCE;
+    speed_ok &= fabsf(ref_velocity[2]) <= MAX_OMEGA_REFERENCE;
 
     // 車体速度を推定する
-    _gravity_filter.update(motion.accelerometer, motion.gyroscope);
-    _velocity_filter.update(bodyAcceleration(), motion.gyroscope, wheel_velocity, motion.wheel_current_q);
+    // 速度フィルタのモデルはIMU_OUTPUT_RATEの周期で設計しているので、制御周波数が高いときは入力を平均して間引いて更新する
+    uint32_t gravity_filter_start = PerformanceCounter::getGlobalCycles();
+    _gravity_filter.update(motion.accelerometer, motion.gyroscope, period);
+    CycleProfiler::record(CycleProfiler::SectionGravityFilter, PerformanceCounter::getGlobalCycles() - gravity_filter_start);
+    _filter_input_sum.body_acceleration += bodyAcceleration();
+    _filter_input_sum.gyroscope += motion.gyroscope;
+    _filter_input_sum.wheel_velocity += wheel_velocity;
+    _filter_input_sum.wheel_current_q += motion.wheel_current_q;
+    if (CentralizedMonitor::controlRateMultiplier() <= ++_filter_input_sum.count) {
+        float scale = 1.0f / static_cast<float>(_filter_input_sum.count);
+        uint32_t velocity_filter_start = PerformanceCounter::getGlobalCycles();
+        _velocity_filter.update(_filter_input_sum.body_acceleration * scale, _filter_input_sum.gyroscope * scale, _filter_input_sum.wheel_velocity * scale,
+                                _filter_input_sum.wheel_current_q * scale);
+        _velocity_filter_cycles = PerformanceCounter::getGlobalCycles() - velocity_filter_start;
+        CycleProfiler::record(CycleProfiler::SectionVelocityFilter, _velocity_filter_cycles);
+        if (_velocity_filter.isCovarianceUpdated()) {
+            _velocity_filter_covariance_cycles = _velocity_filter_cycles;
+        }
+        clearFilterInputSum();
+    }
     if (!isfinite(bodyVelocity()[0]) || !isfinite(bodyVelocity()[1]) || !isfinite(bodyVelocity()[2])) {
         CentralizedMonitor::setErrorFlags(ErrorCauseArithmetic);
         return;
     }
 
+    // 車体速度と角速度を積分して自己位置を求める
+    // 速度フィルタを間引いて更新するときも、角速度は毎回のジャイロの値を使う
+    _pose_integrator.update(bodyVelocity().head<2>(), _gravity_filter.angularVelocity().z(), period);
+
     // 以下で制御を行う
     if (speed_ok && !sensor_only && !VectorController::isFault()) {
         bool brake_enabled[4];
@@ -199,7 +288,7 @@ void WheelController::update(bool new_parameters, bool sensor_only) {
         }
 
         // 車体速度制御を行う
-        Vector4f ref_body_velocity = {parameters.speed_x, parameters.speed_y, parameters.speed_omega, 0.0f};
+        Vector4f ref_body_velocity = {ref_velocity[0], ref_velocity[1], ref_velocity[2], 0.0f};
 #if USE_SIMPLE_CONTROL
         Vector4f ref_wheel_velocity = velocityVectorDecomposition(ref_body_velocity);
         for (int index = 0; index < 4; index++) {
@@ -207,7 +296,8 @@ void WheelController::update(bool new_parameters, bool sensor_only) {
             static const float p_gain = 5.0f;
             static const float i_gain = 0.05f;
             float current = _ref_wheel_current(index) + p_gain * _error_hpf[index](error) + i_gain * error;
-            _ref_wheel_current(index) = fpu::clamp(current, -MAX_CURRENT_LIMIT_PER_MOTOR, MAX_CURRENT_LIMIT_PER_MOTOR);
+            float current_ceiling = _thermal_model.currentCeiling(index);
+            _ref_wheel_current(index) = fpu::clamp(current, -current_ceiling, current_ceiling);
         }
 #else
         // 車体加速度の指令値を求める
@@ -216,11 +306,13 @@ void WheelController::update(bool new_parameters, bool sensor_only) {
         body_velocity[1] = bodyVelocity()[1];
         body_velocity[2] = bodyVelocity()[2];
         body_velocity[3] = body_velocity_by_wheels[3];
+        // 速度制御のゲインと加速度指令値の減衰はIMU_OUTPUT_RATEの周期あたりの値なので制御周期との比を掛けて使う
+        float gain_ratio = period * IMU_OUTPUT_RATE;
         Vector4f ref_body_accel_unlimit;
         for (int index = 0; index < 4; index++) {
             float error = ref_body_velocity[index] - body_velocity[index];
             float p_gain = parameters.speed_gain_p[index];
-            float i_gain = parameters.speed_gain_i[index];
+            float i_gain = parameters.speed_gain_i[index] * gain_ratio;
             float accel = _ref_body_accel[index] + p_gain * _error_hpf[index](PIP_RATIO * error - (1.0f - PIP_RATIO) * body_velocity[index]) + i_gain * error;
             if (index != 2) {
                 ref_body_accel_unlimit[index] = fpu::clamp(accel, -MAX_TRANSLATION_ACCELERATION, MAX_TRANSLATION_ACCELERATION);
@@ -233,12 +325,46 @@ void WheelController::update(bool new_parameters, bool sensor_only) {
         // 各モーターへの電流の割り当てと制限を行う
         Vector4f current_limit, ref_current;
         Vector4f velocity_error = velocityVectorDecomposition(bodyVelocity()) - wheel_velocity;
-        current_limit[0] = fpu::max(limitPower(wheel_velocity[0]) - fabsf(velocity_error[0]), MIN_CURRENT_LIMIT_PER_MOTOR);
-        current_limit[1] = fpu::max(limitPower(wheel_velocity[1]) - fabsf(velocity_error[1]), MIN_CURRENT_LIMIT_PER_MOTOR);
-        current_limit[2] = fpu::max(limitPower(wheel_velocity[2]) - fabsf(velocity_error[2]), MIN_CURRENT_LIMIT_PER_MOTOR);
-        current_limit[3] = fpu::max(limitPower(wheel_velocity[3]) - fabsf(velocity_error[3]), MIN_CURRENT_LIMIT_PER_MOTOR);
-        AccelerationLimitter limitter;
-        if (!limitter.compute(ref_body_accel_unlimit, current_limit, _ref_body_accel, ref_current)) {
+        current_limit[0] = limitPower(wheel_velocity[0], _thermal_model.currentCeiling(0));
+        current_limit[1] = limitPower(wheel_velocity[1], _thermal_model.currentCeiling(1));
+        current_limit[2] = limitPower(wheel_velocity[2], _thermal_model.currentCeiling(2));
+        current_limit[3] = limitPower(wheel_velocity[3], _thermal_model.currentCeiling(3));
+
+        // 推定した摩擦係数で路面に伝えられる力を超えないように、滑り始めた車輪の電流制限値を下げる
+        _traction_limitter.update(_velocity_filter.frictionCoefficients(), velocity_error, period, current_limit);
+        current_limit[0] = fpu::max(current_limit[0] - fabsf(velocity_error[0]), MIN_CURRENT_LIMIT_PER_MOTOR);
+        current_limit[1] = fpu::max(current_limit[1] - fabsf(velocity_error[1]), MIN_CURRENT_LIMIT_PER_MOTOR);
+        current_limit[2] = fpu::max(current_limit[2] - fabsf(velocity_error[2]), MIN_CURRENT_LIMIT_PER_MOTOR);
+        current_limit[3] = fpu::max(current_limit[3] - fabsf(velocity_error[3]), MIN_CURRENT_LIMIT_PER_MOTOR);
+
+        // 全モーターの電力の制約を求める
+        // 電力 (KV v + R I) I は前回の電流指令値I0の周りで線形化し、g I - R I0^2 + ベース消費電力 で近似する
+        // 電流指令値には後でスリップ抑制の項を加えるので、その分の電力を上限・下限から差し引いておく
+        // 使える電力はDC48Vの電圧が低電圧・過電圧の閾値に近づくにつれて0まで絞る
+        Vector4f power_gradient;
+        float power_offset = 4 * BASE_POWER_CONSUMPTION_PER_MOTOR;
+        for (int index = 0; index < 4; index++) {
+            float current = _ref_wheel_current(index);
+            power_gradient[index] = KV * wheel_velocity[index] + 2 * MOTOR_RESISTANCE * current;
+            power_offset += power_gradient[index] * ANTI_SLIP_GAIN * velocity_error[index] - MOTOR_RESISTANCE * current * current;
+        }
+        float dc48v_voltage = DataHolder::adc2Data().dc48v_voltage;
+        float drive_ratio = (dc48v_voltage - DRIVE_POWER_DERATING_END_VOLTAGE) * (1.0f / (DRIVE_POWER_DERATING_START_VOLTAGE - DRIVE_POWER_DERATING_END_VOLTAGE));
+        float regeneration_ratio = (REGENERATION_POWER_DERATING_END_VOLTAGE - dc48v_voltage) *
+                                   (1.0f / (REGENERATION_POWER_DERATING_END_VOLTAGE - REGENERATION_POWER_DERATING_START_VOLTAGE));
+        float power_upper = MAX_DRIVE_POWER * fpu::clamp(drive_ratio, 0.0f, 1.0f) - power_offset;
+        float power_lower = -MAX_REGENERATION_POWER * fpu::clamp(regeneration_ratio, 0.0f, 1.0f) - power_offset;
+        uint32_t acceleration_limitter_start = PerformanceCounter::getGlobalCycles();
+        _acceleration_limitter.compute(ref_body_accel_unlimit, current_limit, power_gradient, power_lower, power_upper, _ref_body_accel, ref_current);
+        CycleProfiler::record(CycleProfiler::SectionAccelerationLimitter, PerformanceCounter::getGlobalCycles() - acceleration_limitter_start);
+
+        // 収束しなかったときも加速度リミッタは制約を満たす途中の解を出力するのでそのまま使う (収束しなかった回数は反復回数のヒストグラムに残る)
+        // 入力にNaNが含まれていたときなど、出力が有限でないときだけ停止する
+        bool limitter_ok = true;
+        for (int index = 0; index < 4; index++) {
+            limitter_ok &= fpu::isFinite(_ref_body_accel[index]) && fpu::isFinite(ref_current[index]);
+        }
+        if (!limitter_ok) {
             CentralizedMonitor::setErrorFlags(ErrorCauseArithmetic);
             return;
         }
@@ -246,27 +372,31 @@ void WheelController::update(bool new_parameters, bool sensor_only) {
         // 電流割り当ての結果、加速度が元の指令値より大きくなったときは次の制御ループに伝搬する加速度の値を制限する
         for (int index = 0; index < 4; index++) {
             float accel = fabsf(ref_body_accel_unlimit[index]);
-            float decay = fpu::clamp(_ref_body_accel[index], -REF_ACCEL_DECAY, REF_ACCEL_DECAY);
+            float decay = fpu::clamp(_ref_body_accel[index], -REF_ACCEL_DECAY * gain_ratio, REF_ACCEL_DECAY * gain_ratio);
             _ref_body_accel[index] = fpu::clamp(_ref_body_accel[index] - decay, -accel, accel);
         }
 
         // 速度推定値から求めた車輪速度と実際の車輪速度の誤差に係数を掛けて電流指示値に加える
-        _ref_wheel_current[0] = fpu::clamp(ref_current[0] + ANTI_SLIP_GAIN * velocity_error[0], -MAX_CURRENT_LIMIT_PER_MOTOR, MAX_CURRENT_LIMIT_PER_MOTOR);
-        _ref_wheel_current[1] = fpu::clamp(ref_current[1] + ANTI_SLIP_GAIN * velocity_error[1], -MAX_CURRENT_LIMIT_PER_MOTOR, MAX_CURRENT_LIMIT_PER_MOTOR);
-        _ref_wheel_current[2] = fpu::clamp(ref_current[2] + ANTI_SLIP_GAIN * velocity_error[2], -MAX_CURRENT_LIMIT_PER_MOTOR, MAX_CURRENT_LIMIT_PER_MOTOR);
-        _ref_wheel_current[3] = fpu::clamp(ref_current[3] + ANTI_SLIP_GAIN * velocity_error[3], -MAX_CURRENT_LIMIT_PER_MOTOR, MAX_CURRENT_LIMIT_PER_MOTOR);
+        float current_ceiling[4];
+        current_ceiling[0] = _thermal_model.currentCeiling(0);
+        current_ceiling[1] = _thermal_model.currentCeiling(1);
+        current_ceiling[2] = _thermal_model.currentCeiling(2);
+        current_ceiling[3] = _thermal_model.currentCeiling(3);
+        _ref_wheel_current[0] = fpu::clamp(ref_current[0] + ANTI_SLIP_GAIN * velocity_error[0], -current_ceiling[0], current_ceiling[0]);
+        _ref_wheel_current[1] = fpu::clamp(ref_current[1] + ANTI_SLIP_GAIN * velocity_error[1], -current_ceiling[1], current_ceiling[1]);
+        _ref_wheel_current[2] = fpu::clamp(ref_current[2] + ANTI_SLIP_GAIN * velocity_error[2], -current_ceiling[2], current_ceiling[2]);
+        _ref_wheel_current[3] = fpu::clamp(ref_current[3] + ANTI_SLIP_GAIN * velocity_error[3], -current_ceiling[3], current_ceiling[3]);
 #endif
 
         // 回生エネルギーを計算し電気ブレーキを掛ける
         for (int index = 0; index < 4; index++) {
-            static constexpr float KV = MOTOR_TORQUE_CONSTANT / WHEEL_RADIUS;
             float current = _ref_wheel_current(index);
             float power = (KV * motion.wheel_velocity(index) + MOTOR_RESISTANCE * current) * current;
             float energy = _regeneration_energy[index];
             float energy_with_brake, energy_without_brake;
-            energy_without_brake = energy + (power + BASE_POWER_CONSUMPTION_PER_MOTOR) * (1.0f / IMU_OUTPUT_RATE);
+            energy_without_brake = energy + (power + BASE_POWER_CONSUMPTION_PER_MOTOR) * period;
             energy_without_brake = fpu::min(energy_without_brake, 0.0f);
-            energy_with_brake = energy + BASE_POWER_CONSUMPTION_PER_MOTOR * (1.0f / IMU_OUTPUT_RATE);
+            energy_with_brake = energy + BASE_POWER_CONSUMPTION_PER_MOTOR * period;
             energy_with_brake = fpu::min(energy_with_brake, 0.0f);
             if (BRAKE_DISABLE_THRESHOLD < energy_without_brake) {
                 brake_enabled[index] = false;
@@ -279,6 +409,7 @@ void WheelController::update(bool new_parameters, bool sensor_only) {
 
         // 電流指令値を設定する
         static constexpr float RECIPROCAL_CURRENT_SCALE = 1.0f / ADC1_CURRENT_SCALE;
+        uint32_t register_write_start = PerformanceCounter::getGlobalCycles();
         if (brake_enabled[0])
             VectorController::setBrakeEnabled(1);
         if (brake_enabled[1])
@@ -299,6 +430,7 @@ void WheelController::update(bool new_parameters, bool sensor_only) {
             VectorController::clearBrakeEnabled(3);
         if (!brake_enabled[3])
             VectorController::clearBrakeEnabled(4);
+        CycleProfiler::record(CycleProfiler::SectionRegisterWrite, PerformanceCounter::getGlobalCycles() - register_write_start);
     }
     else if (new_parameters && !sensor_only) {
         // 新しい指令値を受信したので次のループから制御を開始する
@@ -311,15 +443,28 @@ void WheelController::update(bool new_parameters, bool sensor_only) {
     }
 }
 
-float WheelController::limitPower(float velocity) {
+float WheelController::limitPower(float velocity, float current_ceiling) {
+    // 定格出力は連続電流に対するものなので、電流の上限値が上がった分だけ銅損と同じ比率で出力の上限も上げる
+    static constexpr float RECIPROCAL_CONTINUOUS_CURRENT = 1.0f / MotorThermalModel::CONTINUOUS_CURRENT;
+    float ratio = current_ceiling * RECIPROCAL_CONTINUOUS_CURRENT;
+    float power = MOTOR_RATING_POWER * ratio * ratio;
     float bemf = velocity * (MOTOR_TORQUE_CONSTANT / WHEEL_RADIUS);
-    float current = (fpu::sqrt(bemf * bemf + 4 * MOTOR_RESISTANCE * MOTOR_RATING_POWER) - fabs(bemf)) * (1.0f / (2 * MOTOR_RESISTANCE));
-    return fpu::min(current, MAX_CURRENT_LIMIT_PER_MOTOR);
+    float current = (fpu::sqrt(bemf * bemf + 4 * MOTOR_RESISTANCE * power) - fabs(bemf)) * (1.0f / (2 * MOTOR_RESISTANCE));
+    return fpu::min(current, current_ceiling);
 }
 
 GravityFilter WheelController::_gravity_filter;
 VelocityFilter WheelController::_velocity_filter;
+AccelerationLimitter WheelController::_acceleration_limitter;
+TractionLimitter WheelController::_traction_limitter;
+MotorThermalModel WheelController::_thermal_model;
+PoseIntegrator WheelController::_pose_integrator;
+uint32_t WheelController::_pose_reset_number = 0;
+TrajectoryInterpolator WheelController::_trajectory_interpolator;
+WheelController::FilterInputSum_t WheelController::_filter_input_sum;
 Hpf1stOrder5 WheelController::_error_hpf[4];
 Eigen::Vector4f WheelController::_ref_body_accel;
 Eigen::Vector4f WheelController::_ref_wheel_current;
 Eigen::Vector4f WheelController::_regeneration_energy;
+uint32_t WheelController::_velocity_filter_cycles = 0;
+uint32_t WheelController::_velocity_filter_covariance_cycles = 0;
@@ -7,10 +7,15 @@
 
 #pragma once
 
+#include <stdint.h>
 #include <Eigen/Core>
 #include "filter/gravity_filter.hpp"
 #include "filter/velocity_filter.hpp"
 #include "filter/acceleration_limitter.hpp"
+#include "filter/traction_limitter.hpp"
+#include "filter/motor_thermal_model.hpp"
+#include "filter/pose_integrator.hpp"
+#include "filter/trajectory_interpolator.hpp"
 #include "filter/hpf.hpp"
 
 /**
@@ -22,6 +27,10 @@ public:
      * @brief 初期化を行う
      */
     static void initialize(void) {
+        _trajectory_interpolator.reset();
+        _thermal_model.reset();
+        _pose_integrator.reset(0.0f, 0.0f, 0.0f);
+        _pose_reset_number = 0;
         stopControl();
     }
 
@@ -58,6 +67,60 @@ public:
         return _velocity_filter;
     }
 
+    /**
+     * @brief 速度フィルタの統計値をクリアする
+     */
+    static void clearVelocityFilterStatistics(void) {
+        _velocity_filter.clearStatistics();
+    }
+
+    /**
+     * @brief トラクションリミッタへアクセスする
+     * @return トラクションリミッタ
+     */
+    static const TractionLimitter& tractionLimitter(void) {
+        return _traction_limitter;
+    }
+
+    /**
+     * @brief トラクションリミッタの統計値をクリアする
+     */
+    static void clearTractionStatistics(void) {
+        _traction_limitter.clearStatistics();
+    }
+
+    /**
+     * @brief 巻線の温度上昇のモデルへアクセスする
+     * @return 巻線の温度上昇のモデル
+     */
+    static const MotorThermalModel& thermalModel(void) {
+        return _thermal_model;
+    }
+
+    /**
+     * @brief 自己位置を取得する
+     * @return X [m], Y [m], θ [rad]
+     */
+    static const Eigen::Vector3f& pose(void) {
+        return _pose_integrator.pose();
+    }
+
+    /**
+     * @brief 最後に適用した自己位置のリセットの番号を取得する
+     * @return SharedMemory::Parameters::pose_reset_number
+     */
+    static uint32_t poseResetNumber(void) {
+        return _pose_reset_number;
+    }
+
+    /**
+     * @brief 加速度リミッタへアクセスする
+     * @return 加速度リミッタ
+     */
+    static const AccelerationLimitter& accelerationLimitter(void) {
+        return _acceleration_limitter;
+    }
+
     /**
      * @brief 車体加速度の推定値を取得する
      * @return 車体加速度 X, Y, Z [m/s^2]
@@ -82,6 +145,22 @@ public:
         return _ref_body_accel;
     }
 
+    /**
+     * @brief 最後に速度フィルタを更新したupdate()で速度フィルタの更新に要したサイクル数を取得する
+     * @return サイクル数
+     */
+    static uint32_t velocityFilterCycles(void) {
+        return _velocity_filter_cycles;
+    }
+
+    /**
+     * @brief 速度フィルタが最後に共分散を更新したupdate()で速度フィルタの更新に要したサイクル数を取得する
+     * @return サイクル数
+     */
+    static uint32_t velocityFilterCovarianceCycles(void) {
+        return _velocity_filter_covariance_cycles;
+    }
+
 private:
     /**
      * 制御情報をクリアする
@@ -93,12 +172,18 @@ private:
      */
     static void initializeRegisters(void);
 
+    /**
+     * 速度フィルタの入力の積算値をクリアする
+     */
+    static void clearFilterInputSum(void);
+
     /**
      * @brief モーターの出力[W]を制限する電流制限値を計算する
      * @param velocity 車輪速度 [m/s]
+     * @param current_ceiling 巻線の温度上昇から求めた電流の上限値 [A]
      * @return 電流制限値 [A]
      */
-    static float limitPower(float velocity);
+    static float limitPower(float velocity, float current_ceiling);
 
     /// IMUの加速度から重力を分離するフィルタ
     static GravityFilter _gravity_filter;
@@ -106,6 +191,26 @@ private:
     /// IMUとエンコーダから車体速度を求めるカルマンフィルタ
     static VelocityFilter _velocity_filter;
 
+    /// 電流制限値の下で加速度を割り当てるリミッタ
+    static AccelerationLimitter _acceleration_limitter;
+
+    /// 推定した摩擦係数から電流制限値を下げるリミッタ
+    static TractionLimitter _traction_limitter;
+
+    /// 巻線の温度上昇を推定するモデル
+    /// 制御を止めても巻線はすぐには冷えないので、initializeState()ではリセットしない
+    static MotorThermalModel _thermal_model;
+
+    /// 車体速度を積分して自己位置を求める
+    /// 制御を止めても自己位置は失わないように、initializeState()ではリセットしない
+    static PoseIntegrator _pose_integrator;
+
+    /// 最後に適用した自己位置のリセットの番号
+    static uint32_t _pose_reset_number;
+
+    /// 共有メモリーの軌道の経由点を補間する
+    static TrajectoryInterpolator _trajectory_interpolator;
+
     /// 誤差の不完全微分を行うHPF
     static Hpf1stOrder5 _error_hpf[4];
 
@@ -117,4 +222,22 @@ private:
 
     /// モーターの発生させた回生エネルギー (負の値をとる)
     static Eigen::Vector4f _regeneration_energy;
+
+    /// 速度フィルタの入力の積算値
+    struct FilterInputSum_t {
+        Eigen::Vector3f body_acceleration;
+        Eigen::Vector3f gyroscope;
+        Eigen::Vector4f wheel_velocity;
+        Eigen::Vector4f wheel_current_q;
+        int count;
+    };
+
+    /// 制御周波数がIMU_OUTPUT_RATEより高いときに平均して速度フィルタに与える入力の積算値
+    static FilterInputSum_t _filter_input_sum;
+
+    /// 速度フィルタの更新に要したサイクル数
+    static uint32_t _velocity_filter_cycles;
+
+    /// 速度フィルタが最後に共分散を更新したときの更新に要したサイクル数
+    static uint32_t _velocity_filter_covariance_cycles;
 };
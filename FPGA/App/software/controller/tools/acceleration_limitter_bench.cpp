@@ -0,0 +1,751 @@
+/**
+ * @file acceleration_limitter_bench.cpp
+ * @author Fujii Naomichi
+ * @copyright (c) 2021 Fujii Naomichi
+ * SPDX-License-Identifier: MIT
+ */
+
+/*
+ * AccelerationLimitterにランダムな入力と意地の悪い入力を与えて、総当たりで求めた二次計画問題の最適解と比較するホスト用のツール
+ *
+ * ビルド (tools/ で実行する):
+ *   g++ -std=gnu++14 -O2 -ffast-math -DEIGEN_NO_DEBUG -I../source -I../source/filter -I../include -I../eigen acceleration_limitter_bench.cpp ../source/filter/acceleration_limitter.cpp -o acceleration_limitter_bench
+ * 3輪と5輪の機体の加速度制限を試すときは -DBENCH_WHEELS=3 か -DBENCH_WHEELS=5 を加える (既定は4輪)
+ * 5輪では参照解の総当たりに時間がかかるので試行回数を減らすとよい
+ *
+ * 使い方:
+ *   acceleration_limitter_bench [シナリオごとの試行回数] [乱数のシード] [時間の上限の倍率]
+ *
+ * 参照解は各車輪と電力の制約を「無効・上限・下限」の3通りずつ総当たりし、等式制約付きの問題をdoubleのKKT行列で解いて
+ * 実行可能なものの中で目的関数が最小のものとする。最適性のギャップは制限しないときの目的関数の値で正規化する。
+ * 1回あたりの時間はファームウェアのコードだけを測ったホストでの値で、Nios IIでの時間の相対的な目安として使う。
+ * 収束した呼び出しでギャップがGAP_TOLERANCEを超えるか、電流制限をVIOLATION_TOLERANCEより、電力の制約を
+ * POWER_VIOLATION_TOLERANCEより超えたときと、車輪の配置から求めた係数が手で求めた値 (4輪のとき) や
+ * 車輪の力と機体の加速度の関係と合わないとき、
+ * NaNや無限大などの不正な重みが既定の重みに置き換えられなかったときは終了コード1を返す。
+ * 電流制限と電力の制約、出力した電流と加速度の整合は収束しなかった呼び出しも含めて調べる。
+ * 収束しなかった割合か1回あたりの時間がシナリオごとの基準値 (BASELINE_*) を超えたときも終了コード1を返す。
+ * 時間の基準値はホストによって変わるので、[時間の上限の倍率]で基準値を何倍まで許すか指定する (既定は1、0のときは時間を調べない)。
+ * 時間は試行回数がMIN_TIMED_CALLS以上のときだけ調べる。
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+#include <random>
+#include <Eigen/Core>
+#include <Eigen/LU>
+#include "board.hpp"
+#include "acceleration_limitter.hpp"
+
+#ifndef BENCH_WHEELS
+#define BENCH_WHEELS 4
+#endif
+
+/// 試す加速度制限
+using Limitter = BasicAccelerationLimitter<BENCH_WHEELS>;
+
+static constexpr int WHEELS = Limitter::WHEELS;
+static constexpr int VARIABLES = Limitter::VARIABLES;
+static constexpr int CONSTRAINTS = Limitter::CONSTRAINTS;
+static constexpr int POWER_INDEX = Limitter::POWER_INDEX;
+
+using VectorVf = Limitter::VariableVector;
+using VectorWf = Limitter::WheelVector;
+using VectorVd = Eigen::Matrix<double, VARIABLES, 1>;
+using VectorWd = Eigen::Matrix<double, WHEELS, 1>;
+
+#if BENCH_WHEELS == 4
+/// 各車輪の電流を表す制約の係数 (Limitter::currentCoefficients()が車輪の配置から求める値と同じ)
+static constexpr double D[WHEELS][VARIABLES] = {
+    {-1, 1, 1, 1},
+    {1, 1, 1, -1},
+    {1, -1, 1, 1},
+    {-1, -1, 1, -1},
+};
+#else
+/// 各車輪の電流を表す制約の係数 (手で求めた値がないので、checkModel()で車輪の配置との関係だけを調べる)
+static const float (&D)[WHEELS][VARIABLES] = Limitter::currentCoefficients();
+#endif
+
+/**
+ * @brief 目的関数の既定の重みを取得する (acceleration_limitter.cppのDEFAULT_WEIGHTSと同じ値)
+ * @param j 変数の番号
+ */
+static float defaultWeight(int j) {
+    return (j < 3) ? 1.0f : 4.0f;
+}
+
+/// 逆起電力定数 [V/(m/s)]
+static constexpr double KV = MOTOR_TORQUE_CONSTANT / WHEEL_RADIUS;
+
+/// 電流制限の最小値と最大値 [A] (wheel_controller.cppとmotor_thermal_model.hppのBURST_CURRENTと同じ値)
+static constexpr float MIN_CURRENT_LIMIT_PER_MOTOR = 0.25f;
+static constexpr float MAX_CURRENT_LIMIT_PER_MOTOR = 4.5f;
+
+/// 加速度指令値の最大値 [m/s^2], [rad/s^2] (wheel_controller.cppと同じ値)
+static constexpr float MAX_TRANSLATION_ACCELERATION = 10.0f;
+static constexpr float MAX_ANGULAR_ACCELERATION = 100.0f;
+
+/// 収束した呼び出しで許容する最適性のギャップ
+static constexpr double GAP_TOLERANCE = 1e-3;
+
+/// 許容する電流制限の超過量 [A]
+/// acceleration_limitter.cppはOC_EPSまでの超過と、ノルムの2乗がEPS未満の移動を実行可能と見なすので、その分を見込む
+static constexpr double VIOLATION_TOLERANCE = 1e-2;
+
+/// 許容する電力の制約の超過量 [W] (acceleration_limitter.cppのPOWER_EPSに同じ理由の分を見込む)
+static constexpr double POWER_VIOLATION_TOLERANCE = 1e-1;
+
+/// 出力した電流と、出力した加速度から求めた電流の差の許容量 [A] (加速度をfloatでスケーリングし直す分の誤差を見込む)
+static constexpr double CURRENT_MISMATCH_TOLERANCE = 1e-4;
+
+/// 時間を測るときにまとめて処理する呼び出しの数
+static constexpr int BATCH_SIZE = 4096;
+
+/// 時間を基準値と比べる最小の試行回数 (少ないとキャッシュが温まる前の時間が目立つ)
+static constexpr long MIN_TIMED_CALLS = 10000;
+
+/// シナリオごとの基準値
+struct Baseline_t {
+    /// 収束しなかった呼び出しの割合の上限
+    double not_converged_rate;
+
+    /// 1回あたりの時間の上限 [ns]
+    double nanoseconds;
+};
+
+/// 基準値 (x86-64のホストで100000回ずつ (5輪は20000回ずつ) 試したときの収束しなかった割合の約1.5倍、-O2での時間の約2倍)
+/// 試行回数が少ないときにも誤って失敗しないように、walkの割合には余裕を多めに取ってある
+#if BENCH_WHEELS == 3
+static constexpr Baseline_t BASELINE_RANDOM = {0.045, 500.0};
+static constexpr Baseline_t BASELINE_WALK = {0.005, 200.0};
+static constexpr Baseline_t BASELINE_ADVERSARIAL = {0.05, 600.0};
+static constexpr Baseline_t BASELINE_WEIGHTED = {0.017, 900.0};
+static constexpr Baseline_t BASELINE_POWER = {0.023, 700.0};
+#elif BENCH_WHEELS == 5
+static constexpr Baseline_t BASELINE_RANDOM = {0.008, 1000.0};
+static constexpr Baseline_t BASELINE_WALK = {0.005, 300.0};
+static constexpr Baseline_t BASELINE_ADVERSARIAL = {0.17, 1400.0};
+static constexpr Baseline_t BASELINE_WEIGHTED = {0.005, 7000.0};
+static constexpr Baseline_t BASELINE_POWER = {0.006, 1200.0};
+#else
+static constexpr Baseline_t BASELINE_RANDOM = {0.02, 700.0};
+static constexpr Baseline_t BASELINE_WALK = {0.005, 200.0};
+static constexpr Baseline_t BASELINE_ADVERSARIAL = {0.15, 800.0};
+static constexpr Baseline_t BASELINE_WEIGHTED = {0.01, 2000.0};
+static constexpr Baseline_t BASELINE_POWER = {0.015, 900.0};
+#endif
+
+/// 1回分の入力
+struct Case_t {
+    VectorVf accel;
+    VectorWf current_limit;
+    float weights[VARIABLES];
+    VectorWf power_gradient;
+    float power_lower;
+    float power_upper;
+};
+
+/// 制約の係数と下限・上限
+struct Constraints_t {
+    Eigen::Matrix<double, CONSTRAINTS, VARIABLES> A;
+    Eigen::Matrix<double, CONSTRAINTS, 1> lower;
+    Eigen::Matrix<double, CONSTRAINTS, 1> upper;
+    bool has_power;
+};
+
+/// シナリオごとの集計
+struct Summary_t {
+    const char* name;
+    Baseline_t baseline;
+    long calls = 0;
+    long not_converged = 0;
+    long gap_exceeded = 0;
+    double max_gap = 0.0;
+    double sum_gap = 0.0;
+    double max_violation = 0.0;
+    double max_power_violation = 0.0;
+    double max_current_mismatch = 0.0;
+    double nanoseconds = 0.0;
+    long iterations = 0;
+    Case_t worst_case;
+    uint32_t histogram[Limitter::HISTOGRAM_SIZE] = {};
+};
+
+/// 車輪の力あたりの電流 [A/N]
+static constexpr double CURRENT_PER_FORCE = static_cast<double>(WHEEL_RADIUS) / MOTOR_TORQUE_CONSTANT;
+
+/**
+ * @brief 加速度を制約の変数 (車輪電流と同じ単位) に換算する係数を求める
+ * 4輪のときは手で求めた値で、Limitter::scaleFactors()が車輪の配置から求める値と同じになる
+ * それ以外のときはLimitter::scaleFactors()の値 (checkModel()で車輪の配置との関係を調べる)
+ */
+static VectorVd scaleFactors(void) {
+#if BENCH_WHEELS == 4
+    const double WHEEL_POS_R = std::sqrt(static_cast<double>(WHEEL_POS_R_2));
+    const double K = CURRENT_PER_FORCE;
+    return VectorVd(K * MACHINE_WEIGHT * WHEEL_POS_R / WHEEL_POS_Y / 4, K * MACHINE_WEIGHT * WHEEL_POS_R / WHEEL_POS_X / 4,
+                    K * MACHINE_INERTIA / 4 / WHEEL_POS_R, K * MACHINE_WEIGHT / 4);
+#else
+    return Eigen::Map<const VectorVf>(Limitter::scaleFactors()).cast<double>();
+#endif
+}
+
+/**
+ * @brief 車輪の位置を求める (acceleration_limitter.cppのWheelLayoutと同じ配置)
+ * 4輪は長方形の頂点、それ以外は4輪と同じ半径の円周上に等間隔に置き、第1象限から時計回りに並べる
+ * @return i行目は車輪iの位置 (x, y) [m]
+ */
+static Eigen::Matrix<double, WHEELS, 2> wheelPositions(void) {
+    Eigen::Matrix<double, WHEELS, 2> result;
+#if BENCH_WHEELS == 4
+    result << WHEEL_POS_X, WHEEL_POS_Y, WHEEL_POS_X, -WHEEL_POS_Y, -WHEEL_POS_X, -WHEEL_POS_Y, -WHEEL_POS_X, WHEEL_POS_Y;
+#else
+    const double r = std::sqrt(static_cast<double>(WHEEL_POS_R_2));
+    const double pi = std::acos(-1.0);
+    const double first = (WHEELS == 3) ? (pi / 3) : (pi * 3 / 10);
+    for (int i = 0; i < WHEELS; i++) {
+        double angle = first - 2 * pi * i / WHEELS;
+        result(i, 0) = r * std::cos(angle);
+        result(i, 1) = r * std::sin(angle);
+    }
+#endif
+    return result;
+}
+
+/**
+ * @brief Limitterが車輪の配置から求めた係数を調べる
+ * 4輪のときは手で求めた値と比べる。
+ * どの車輪の数でも、X, Y, ωの係数が機体に単位加速度を生じる車輪の力の2乗和が最小の配分になっていることと、
+ * C1, ...の係数が機体に加速度を生じない互いに直交する組み合わせで、絶対値の最大値が1になっていることを調べる
+ * @return 合わないときはfalse
+ */
+static bool checkModel(void) {
+    bool ok = true;
+    const float(&coefficients)[WHEELS][VARIABLES] = Limitter::currentCoefficients();
+    const float(&scales)[VARIABLES] = Limitter::scaleFactors();
+    const VectorVd k = scaleFactors();
+    for (int j = 0; j < VARIABLES; j++) {
+        for (int i = 0; i < WHEELS; i++) {
+            if (coefficients[i][j] != static_cast<float>(D[i][j])) {
+                fprintf(stderr, "coefficient[%d][%d] = %.9g, expected %g\n", i, j, coefficients[i][j], static_cast<double>(D[i][j]));
+                ok = false;
+            }
+        }
+        if (1e-6 < std::fabs(scales[j] / k(j) - 1.0)) {
+            fprintf(stderr, "scale[%d] = %.9g, expected %.9g\n", j, scales[j], k(j));
+            ok = false;
+        }
+    }
+
+    // 車輪の力から機体の力とトルクへの行列Tと、機体に加速度を生じない成分への射影N
+    const Eigen::Matrix<double, WHEELS, 2> position = wheelPositions();
+    Eigen::Matrix<double, 3, WHEELS> T;
+    for (int i = 0; i < WHEELS; i++) {
+        double r = position.row(i).norm();
+        T.col(i) << -position(i, 1) / r, position(i, 0) / r, r;
+    }
+    const Eigen::Matrix<double, WHEELS, WHEELS> N =
+        Eigen::Matrix<double, WHEELS, WHEELS>::Identity() - T.transpose() * (T * T.transpose()).inverse() * T;
+    const double generalized_mass[3] = {MACHINE_WEIGHT, MACHINE_WEIGHT, MACHINE_INERTIA};
+    Eigen::Matrix<double, WHEELS, VARIABLES> C;
+    for (int i = 0; i < WHEELS; i++) {
+        for (int j = 0; j < VARIABLES; j++) {
+            C(i, j) = coefficients[i][j];
+        }
+    }
+    for (int j = 0; j < VARIABLES; j++) {
+        // 加速度1あたりの車輪の力 [N] と機体の力とトルク
+        VectorWd force = C.col(j) * scales[j] / CURRENT_PER_FORCE;
+        Eigen::Vector3d body = T * force;
+        Eigen::Vector3d expected = Eigen::Vector3d::Zero();
+        if (j < 3) {
+            expected(j) = generalized_mass[j];
+        }
+        double error = (body - expected).norm() / ((j < 3) ? generalized_mass[j] : 1.0);
+        double null_space = (j < 3) ? (N * force).norm() / force.norm() : std::fabs(C.col(j).cwiseAbs().maxCoeff() - 1.0);
+        for (int l = 3; l < j; l++) {
+            null_space = std::max(null_space, std::fabs(C.col(j).dot(C.col(l))));
+        }
+        if ((1e-5 < error) || (1e-5 < null_space)) {
+            fprintf(stderr, "variable %d does not match the wheel layout (error %.3g, %.3g)\n", j, error, null_space);
+            ok = false;
+        }
+    }
+    if ((VARIABLES > 3) && (1e-5 < std::fabs(scales[VARIABLES - 1] / (CURRENT_PER_FORCE * MACHINE_WEIGHT / WHEELS) - 1.0))) {
+        fprintf(stderr, "scale[%d] = %.9g does not match mass / WHEELS\n", VARIABLES - 1, scales[VARIABLES - 1]);
+        ok = false;
+    }
+    return ok;
+}
+
+/**
+ * @brief 不正な重みを与えたときに既定の重みに戻ることを調べる
+ * ファームウェアと同じく-ffast-mathでビルドしたときにNaNと無限大を見逃さないかを確かめる
+ * @return 既定の重みに戻らなかったときはfalse
+ */
+static bool checkWeightValidation(void) {
+    const float invalid_values[] = {std::numeric_limits<float>::quiet_NaN(), -std::numeric_limits<float>::quiet_NaN(),
+                                    std::numeric_limits<float>::infinity(), -std::numeric_limits<float>::infinity(), 0.0f, -1.0f, 1e-30f, 1e30f};
+    bool ok = true;
+    Limitter limitter;
+    for (float value : invalid_values) {
+        float weights[VARIABLES];
+        std::fill(weights, weights + VARIABLES, 2.0f);
+        limitter.setWeights(weights);
+        weights[1] = value;
+        limitter.setWeights(weights);
+        for (int j = 0; j < VARIABLES; j++) {
+            if (limitter.weights()[j] != defaultWeight(j)) {
+                fprintf(stderr, "weight %g was accepted\n", value);
+                ok = false;
+                break;
+            }
+        }
+    }
+    return ok;
+}
+
+/**
+ * @brief 目的関数の値を求める
+ * @param y 変数
+ * @param u 制限しないときの変数
+ * @param w 重み
+ */
+static double objective(const VectorVd& y, const VectorVd& u, const VectorVd& w) {
+    return 0.5 * (w.array() * (y - u).array().square()).sum();
+}
+
+/**
+ * @brief 入力から制約を作る
+ * 電力の制約はacceleration_limitter.cppと同じく原点が実行可能になるように丸める
+ */
+static Constraints_t makeConstraints(const Case_t& c) {
+    Constraints_t result;
+    for (int i = 0; i < WHEELS; i++) {
+        for (int j = 0; j < VARIABLES; j++) {
+            result.A(i, j) = D[i][j];
+        }
+        result.lower(i) = -c.current_limit(i);
+        result.upper(i) = c.current_limit(i);
+    }
+    for (int j = 0; j < VARIABLES; j++) {
+        double sum = 0.0;
+        for (int i = 0; i < WHEELS; i++) {
+            sum += c.power_gradient(i) * D[i][j];
+        }
+        result.A(POWER_INDEX, j) = sum;
+    }
+    result.lower(POWER_INDEX) = std::min<double>(c.power_lower, 0.0);
+    result.upper(POWER_INDEX) = std::max<double>(c.power_upper, 0.0);
+    result.has_power = !c.power_gradient.isZero() && (std::isfinite(c.power_lower) || std::isfinite(c.power_upper));
+    return result;
+}
+
+/**
+ * @brief 制約の超過量の最大値を求める
+ * @param first 最初の制約の番号
+ * @param last 最後の制約の番号の次
+ */
+static double violation(const VectorVd& y, const Constraints_t& constraints, int first, int last) {
+    double result = -INFINITY;
+    for (int i = first; i < last; i++) {
+        double value = constraints.A.row(i).dot(y);
+        result = std::max(result, std::max(value - constraints.upper(i), constraints.lower(i) - value));
+    }
+    return result;
+}
+
+/**
+ * @brief 制約を総当たりして二次計画問題の最適解を求める
+ * @param u 制限しないときの変数
+ * @param w 重み
+ * @param constraints 制約
+ * @return 最適解
+ */
+static VectorVd solveReference(const VectorVd& u, const VectorVd& w, const Constraints_t& constraints) {
+    using KktMatrix = Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, 0, VARIABLES + VARIABLES, VARIABLES + VARIABLES>;
+    using KktVector = Eigen::Matrix<double, Eigen::Dynamic, 1, 0, VARIABLES + VARIABLES, 1>;
+    const int count = constraints.has_power ? CONSTRAINTS : WHEELS;
+    VectorVd best = VectorVd::Zero();
+    double best_objective = objective(best, u, w);
+    int patterns = 1;
+    for (int i = 0; i < count; i++) {
+        patterns *= 3;
+    }
+    for (int pattern = 0; pattern < patterns; pattern++) {
+        // 各制約を 0:無効, 1:上限, 2:下限 とする (変数の数より多い制約は同時に有効にしない)
+        int state[CONSTRAINTS], active = 0;
+        for (int i = 0, p = pattern; i < count; i++, p /= 3) {
+            state[i] = p % 3;
+            active += (state[i] != 0) ? 1 : 0;
+        }
+        if (VARIABLES < active) {
+            continue;
+        }
+        int size = VARIABLES + active;
+        KktMatrix K = KktMatrix::Zero(size, size);
+        KktVector rhs(size);
+        for (int j = 0; j < VARIABLES; j++) {
+            K(j, j) = w(j);
+            rhs(j) = w(j) * u(j);
+        }
+        for (int i = 0, row = VARIABLES; i < count; i++) {
+            if (state[i] == 0) {
+                continue;
+            }
+            for (int j = 0; j < VARIABLES; j++) {
+                K(row, j) = constraints.A(i, j);
+                K(j, row) = constraints.A(i, j);
+            }
+            rhs(row) = (state[i] == 1) ? constraints.upper(i) : constraints.lower(i);
+            row++;
+        }
+        KktVector solution = Eigen::FullPivLU<KktMatrix>(K).solve(rhs);
+        VectorVd y = solution.head<VARIABLES>();
+        if (violation(y, constraints, 0, count) <= 1e-9) {
+            double value = objective(y, u, w);
+            if (value < best_objective) {
+                best_objective = value;
+                best = y;
+            }
+        }
+    }
+    return best;
+}
+
+/**
+ * @brief 入力を作る
+ */
+class CaseGenerator {
+public:
+    explicit CaseGenerator(uint32_t seed) : _random(seed) {}
+
+    /// 独立な一様乱数の入力
+    Case_t random(void) {
+        Case_t c = base();
+        c.accel = randomAccel();
+        c.current_limit = randomLimit();
+        return c;
+    }
+
+    /// ランダムウォークする入力 (前回のアクティブセットからの開始を試す)
+    Case_t walk(void) {
+        std::normal_distribution<float> normal(0.0f, 1.0f);
+        if ((_walk_count++ % 2000) == 0) {
+            _walk_limit = randomLimit();
+        }
+        for (int j = 0; j < VARIABLES; j++) {
+            float scale = (j == 2) ? MAX_ANGULAR_ACCELERATION : MAX_TRANSLATION_ACCELERATION;
+            _walk_accel(j) = (_walk_accel(j) + normal(_random) * 0.03f * scale) * 0.999f;
+        }
+        Case_t c = base();
+        c.accel = _walk_accel;
+        c.current_limit = _walk_limit;
+        return c;
+    }
+
+    /// 意地の悪い入力
+    Case_t adversarial(void) {
+        Case_t c = random();
+        std::uniform_int_distribution<int> kind(0, 6);
+        std::uniform_int_distribution<int> wheel(0, WHEELS - 1);
+        switch (kind(_random)) {
+        case 0:
+            // 制限を大きく超える加速度
+            c.accel *= 100.0f;
+            break;
+
+        case 1:
+            // すべての車輪の電流制限が最小値
+            c.current_limit.setConstant(MIN_CURRENT_LIMIT_PER_MOTOR);
+            break;
+
+        case 2:
+            // 1個の車輪だけ電流制限が最小値
+            c.current_limit.setConstant(MAX_CURRENT_LIMIT_PER_MOTOR);
+            c.current_limit(wheel(_random)) = MIN_CURRENT_LIMIT_PER_MOTOR;
+            break;
+
+        case 3:
+            // 1個の車輪の電流の方向の加速度 (他の制約と同時に当たる)
+            {
+                VectorVd k = scaleFactors();
+                int index = wheel(_random);
+                float gain = std::uniform_real_distribution<float>(-20.0f, 20.0f)(_random);
+                for (int j = 0; j < VARIABLES; j++) {
+                    c.accel(j) = static_cast<float>(gain * D[index][j] / k(j));
+                }
+                c.current_limit.setConstant(c.current_limit(0));
+                break;
+            }
+
+        case 4:
+            // ちょうど電流制限に当たる加速度
+            {
+                VectorVd k = scaleFactors();
+                VectorWd current;
+                VectorVd y;
+                for (int i = 0; i < WHEELS; i++) {
+                    current(i) = (std::uniform_int_distribution<int>(0, 1)(_random) ? 1.0 : -1.0) * c.current_limit(i);
+                }
+                Eigen::Matrix<double, WHEELS, VARIABLES> d;
+                for (int i = 0; i < WHEELS; i++) {
+                    for (int j = 0; j < VARIABLES; j++) {
+                        d(i, j) = D[i][j];
+                    }
+                }
+                y = d.inverse() * current;
+                c.accel = (y.array() / k.array()).cast<float>();
+                break;
+            }
+
+        case 5:
+            // 加速度が0
+            c.accel.setZero();
+            break;
+
+        default:
+            // 軸に沿った加速度 (複数の制約に同時に当たる)
+            {
+                int axis = std::uniform_int_distribution<int>(0, VARIABLES - 1)(_random);
+                float value = c.accel(axis) * 10.0f;
+                c.accel.setZero();
+                c.accel(axis) = value;
+                c.current_limit.setConstant(c.current_limit(0));
+                break;
+            }
+        }
+        return c;
+    }
+
+    /// 電力の制約を加えた入力
+    /// 勾配は車輪速度vと前回の電流I0から g = KV v + 2 R I0 とし、上限・下限は電力の予算から定数項 -R I0^2 を引いたものにする
+    Case_t power(void) {
+        Case_t c = random();
+        std::uniform_real_distribution<float> velocity(-4.0f, 4.0f);
+        std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+        std::uniform_real_distribution<float> drive(0.0f, 200.0f);
+        std::uniform_real_distribution<float> regeneration(0.0f, 50.0f);
+        float constant = 0.0f;
+        for (int i = 0; i < WHEELS; i++) {
+            float current = unit(_random) * c.current_limit(i);
+            c.power_gradient(i) = static_cast<float>(KV * velocity(_random) + 2 * MOTOR_RESISTANCE * current);
+            constant -= MOTOR_RESISTANCE * current * current;
+        }
+        c.power_lower = -regeneration(_random) - constant;
+        c.power_upper = drive(_random) - constant;
+        return c;
+    }
+
+    /// 重みもランダムにした入力
+    Case_t weighted(void) {
+        Case_t c = random();
+        std::uniform_real_distribution<float> log_weight(std::log(0.1f), std::log(10.0f));
+        for (int j = 0; j < VARIABLES; j++) {
+            c.weights[j] = std::exp(log_weight(_random));
+        }
+        return c;
+    }
+
+private:
+    Case_t base(void) {
+        Case_t c;
+        for (int j = 0; j < VARIABLES; j++) {
+            c.weights[j] = defaultWeight(j);
+        }
+        c.power_gradient.setZero();
+        c.power_lower = -INFINITY;
+        c.power_upper = INFINITY;
+        return c;
+    }
+
+    VectorVf randomAccel(void) {
+        std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+        VectorVf result;
+        for (int j = 0; j < VARIABLES; j++) {
+            result(j) = unit(_random) * ((j == 2) ? MAX_ANGULAR_ACCELERATION : MAX_TRANSLATION_ACCELERATION);
+        }
+        return result;
+    }
+
+    VectorWf randomLimit(void) {
+        std::uniform_real_distribution<float> limit(MIN_CURRENT_LIMIT_PER_MOTOR, MAX_CURRENT_LIMIT_PER_MOTOR);
+        VectorWf result;
+        for (int i = 0; i < WHEELS; i++) {
+            result(i) = limit(_random);
+        }
+        return result;
+    }
+
+    std::mt19937 _random;
+    VectorVf _walk_accel = VectorVf::Zero();
+    VectorWf _walk_limit = VectorWf::Constant(MAX_CURRENT_LIMIT_PER_MOTOR);
+    long _walk_count = 0;
+};
+
+/**
+ * @brief 1個のシナリオを実行する
+ * @param name シナリオの名前
+ * @param baseline 基準値
+ * @param count 試行回数
+ * @param generate 入力を作る関数
+ */
+template<class GENERATOR>
+static Summary_t runScenario(const char* name, const Baseline_t& baseline, long count, GENERATOR generate) {
+    Summary_t summary;
+    summary.name = name;
+    summary.baseline = baseline;
+    const VectorVd k = scaleFactors();
+    static Case_t cases[BATCH_SIZE];
+    static VectorVf accel_out[BATCH_SIZE];
+    static VectorWf current_out[BATCH_SIZE];
+    static bool converged[BATCH_SIZE];
+    static int iterations[BATCH_SIZE];
+    Limitter limitter;
+    limitter.reset();
+    for (long done = 0; done < count;) {
+        int batch = static_cast<int>(std::min<long>(BATCH_SIZE, count - done));
+        for (int n = 0; n < batch; n++) {
+            cases[n] = generate();
+        }
+
+        // ファームウェアのコードだけの時間を測る (重みは変わったときだけ分解し直すので一緒に測る)
+        auto start = std::chrono::steady_clock::now();
+        for (int n = 0; n < batch; n++) {
+            limitter.setWeights(cases[n].weights);
+            converged[n] = limitter.compute(cases[n].accel, cases[n].current_limit, cases[n].power_gradient, cases[n].power_lower, cases[n].power_upper,
+                                            accel_out[n], current_out[n]);
+            iterations[n] = limitter.lastIterations();
+        }
+        auto end = std::chrono::steady_clock::now();
+        summary.nanoseconds += std::chrono::duration<double, std::nano>(end - start).count();
+
+        // 参照解と比べる
+        for (int n = 0; n < batch; n++) {
+            const Case_t& c = cases[n];
+            VectorVd w;
+            for (int j = 0; j < VARIABLES; j++) {
+                w(j) = c.weights[j];
+            }
+            Constraints_t constraints = makeConstraints(c);
+            VectorVd u = k.cwiseProduct(c.accel.cast<double>());
+            VectorVd y = k.cwiseProduct(accel_out[n].cast<double>());
+            VectorVd reference = solveReference(u, w, constraints);
+            double scale = std::max(objective(VectorVd::Zero(), u, w), 1e-12);
+            double gap = (objective(y, u, w) - objective(reference, u, w)) / scale;
+            summary.max_violation = std::max(summary.max_violation, violation(y, constraints, 0, WHEELS));
+            if (constraints.has_power) {
+                summary.max_power_violation = std::max(summary.max_power_violation, violation(y, constraints, POWER_INDEX, CONSTRAINTS));
+            }
+            for (int i = 0; i < WHEELS; i++) {
+                double current = std::min(std::max(constraints.A.row(i).dot(y), constraints.lower(i)), constraints.upper(i));
+                summary.max_current_mismatch = std::max(summary.max_current_mismatch, std::fabs(current_out[n](i) - current));
+            }
+            summary.iterations += iterations[n];
+            if (!converged[n]) {
+                summary.not_converged++;
+                continue;
+            }
+            summary.sum_gap += gap;
+            if (summary.max_gap < gap) {
+                summary.max_gap = gap;
+                summary.worst_case = c;
+            }
+            if (GAP_TOLERANCE < gap) {
+                summary.gap_exceeded++;
+            }
+        }
+        done += batch;
+        summary.calls = done;
+    }
+    std::copy(limitter.iterationHistogram(), limitter.iterationHistogram() + Limitter::HISTOGRAM_SIZE, summary.histogram);
+    return summary;
+}
+
+static void printSummary(const Summary_t& s) {
+    long converged = s.calls - s.not_converged;
+    printf("%-12s %9ld %8ld %10.3e %10.3e %8ld %10.3e %10.3e %10.3e %8.1f %6.3f  ", s.name, s.calls, s.not_converged, s.max_gap,
+           (0 < converged) ? (s.sum_gap / converged) : 0.0, s.gap_exceeded, s.max_violation, s.max_power_violation, s.max_current_mismatch, s.nanoseconds / s.calls,
+           static_cast<double>(s.iterations) / s.calls);
+    for (int i = 0; i < Limitter::HISTOGRAM_SIZE; i++) {
+        printf(" %u", s.histogram[i]);
+    }
+    printf("\n");
+}
+
+/**
+ * @brief 名前を付けてベクトルを表示する
+ */
+static void printVector(const char* name, const float* data, int size) {
+    printf(" %s=[", name);
+    for (int i = 0; i < size; i++) {
+        printf((0 < i) ? ", %.9g" : "%.9g", data[i]);
+    }
+    printf("]");
+}
+
+static void printWorstCase(const Summary_t& s) {
+    const Case_t& c = s.worst_case;
+    printf("%-12s", s.name);
+    printVector("accel", c.accel.data(), VARIABLES);
+    printVector("limit", c.current_limit.data(), WHEELS);
+    printVector("weights", c.weights, VARIABLES);
+    if (!c.power_gradient.isZero()) {
+        printVector("power_gradient", c.power_gradient.data(), WHEELS);
+        printf(" power=[%.9g, %.9g]", c.power_lower, c.power_upper);
+    }
+    printf("\n");
+}
+
+int main(int argc, char* argv[]) {
+    long count = (2 <= argc) ? std::atol(argv[1]) : 1000000;
+    uint32_t seed = (3 <= argc) ? static_cast<uint32_t>(std::strtoul(argv[2], nullptr, 0)) : 1;
+    double time_scale = (4 <= argc) ? std::atof(argv[3]) : 1.0;
+    if ((count <= 0) || (time_scale < 0.0)) {
+        fprintf(stderr, "usage: %s [count] [seed] [time_scale]\n", argv[0]);
+        return 2;
+    }
+
+    bool failed = !checkModel() | !checkWeightValidation();
+    CaseGenerator generator(seed);
+    Summary_t summaries[] = {
+        runScenario("random", BASELINE_RANDOM, count, [&] { return generator.random(); }),
+        runScenario("walk", BASELINE_WALK, count, [&] { return generator.walk(); }),
+        runScenario("adversarial", BASELINE_ADVERSARIAL, count, [&] { return generator.adversarial(); }),
+        runScenario("weighted", BASELINE_WEIGHTED, count, [&] { return generator.weighted(); }),
+        runScenario("power", BASELINE_POWER, count, [&] { return generator.power(); }),
+    };
+
+    printf("%-12s %9s %8s %10s %10s %8s %10s %10s %10s %8s %6s   %s\n", "scenario", "calls", "no_conv", "max_gap", "mean_gap", "gap>tol", "viol[A]",
+           "viol[W]", "mismatch", "ns/call", "iter", "histogram");
+    for (const Summary_t& s : summaries) {
+        printSummary(s);
+        failed |= (0 < s.gap_exceeded) || (VIOLATION_TOLERANCE < s.max_violation) || (POWER_VIOLATION_TOLERANCE < s.max_power_violation) ||
+                  (CURRENT_MISMATCH_TOLERANCE < s.max_current_mismatch);
+    }
+    printf("\nworst converged case\n");
+    for (const Summary_t& s : summaries) {
+        printWorstCase(s);
+    }
+
+    // 基準値と比べる
+    for (const Summary_t& s : summaries) {
+        double not_converged_rate = static_cast<double>(s.not_converged) / s.calls;
+        double nanoseconds = s.nanoseconds / s.calls;
+        if (s.baseline.not_converged_rate < not_converged_rate) {
+            fprintf(stderr, "%s: not converged %.3f%% exceeds baseline %.3f%%\n", s.name, not_converged_rate * 100, s.baseline.not_converged_rate * 100);
+            failed = true;
+        }
+        if ((0.0 < time_scale) && (MIN_TIMED_CALLS <= s.calls) && (s.baseline.nanoseconds * time_scale < nanoseconds)) {
+            fprintf(stderr, "%s: %.1f ns/call exceeds baseline %.1f ns/call\n", s.name, nanoseconds, s.baseline.nanoseconds * time_scale);
+            failed = true;
+        }
+    }
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,372 @@
+/**
+ * @file fpu_kernel_test.cpp
+ * @author Fujii Naomichi
+ * @copyright (c) 2021 Fujii Naomichi
+ * SPDX-License-Identifier: MIT
+ */
+
+/*
+ * 行列演算カーネルのホスト用のバックエンドが、演算の順序を書き下した参照実装とビット単位で一致することを確かめるホスト用のツール
+ *
+ * ビルド (tools/ で実行する):
+ *   g++ -std=gnu++14 -O2 -ffp-contract=off -DEIGEN_NO_DEBUG -I../source -I../source/filter -I../include -I../eigen fpu_kernel_test.cpp ../source/filter/velocity_filter.cpp -o fpu_kernel_test
+ *   g++ -std=gnu++14 -O2 -ffp-contract=off -DEIGEN_NO_DEBUG -DFPU_KERNEL_SCALAR -I../source -I../source/filter -I../include -I../eigen fpu_kernel_test.cpp ../source/filter/velocity_filter.cpp -o fpu_kernel_test_scalar
+ *
+ * 使い方:
+ *   fpu_kernel_test [カーネルごとの試行回数] [乱数のシード]
+ *
+ * fpu_kernel.hppの通り、-ffp-contract=off かつ -ffast-math なしでビルドしたときのみビット単位で一致する。
+ * カーネルの結果が参照実装と1ビットでも異なれば終了コード1を返す。
+ * 最後にVelocityFilterを決まった入力で更新した状態のハッシュを表示するので、FPU_KERNEL_SSEとFPU_KERNEL_SCALARで
+ * ビルドした2つの実行ファイルの表示が一致することを確かめる。
+ */
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <Eigen/Core>
+#include "matrix_kernel.hpp"
+#include "sparse_kernel.hpp"
+#include "velocity_filter_model.hpp"
+#include "velocity_filter.hpp"
+
+using Matrix7f = Eigen::Matrix<float, 7, 7>;
+using Vector7f = Eigen::Matrix<float, 7, 1>;
+
+#if defined(FPU_KERNEL_SSE)
+static constexpr const char* BACKEND = "FPU_KERNEL_SSE";
+#else
+static constexpr const char* BACKEND = "FPU_KERNEL_SCALAR";
+#endif
+
+/// Hの構造 (velocity_filter.cppと同じ)
+struct ObservationJacobianPattern {
+    static constexpr size_t ROWS = 7;
+    static constexpr size_t COLS = 7;
+    static constexpr sparse::Element_t element(size_t row, size_t col) {
+        return VELOCITY_FILTER_H_PATTERN[row][col];
+    }
+};
+
+static constexpr sparse::RowIndex<ObservationJacobianPattern> OBSERVATION_JACOBIAN_INDEX = sparse::makeRowIndex<ObservationJacobianPattern>();
+
+static std::mt19937 Random;
+
+static float uniform(void) {
+    return std::uniform_real_distribution<float>(-1.0f, 1.0f)(Random);
+}
+
+template<class MATRIX>
+static void randomize(MATRIX& m) {
+    for (int col = 0; col < m.cols(); col++) {
+        for (int row = 0; row < m.rows(); row++) {
+            m(row, col) = uniform();
+        }
+    }
+}
+
+template<size_t N>
+static void randomize(SymmetricMatrix<N>& m) {
+    for (size_t i = 0; i < SymmetricMatrix<N>::SIZE; i++) {
+        m.data[i] = uniform();
+    }
+}
+
+/// 正定値の対称行列を作る
+template<size_t N>
+static void randomizePositiveDefinite(SymmetricMatrix<N>& m) {
+    Eigen::Matrix<float, N, N> a;
+    randomize(a);
+    for (size_t row = 0; row < N; row++) {
+        for (size_t col = 0; col <= row; col++) {
+            float sum = (row == col) ? 0.5f : 0.0f;
+            for (size_t k = 0; k < N; k++) {
+                sum = sum + a(row, k) * a(col, k);
+            }
+            m(row, col) = sum;
+        }
+    }
+}
+
+/// 参照実装: sum = a(0) * b(0); sum = sum + a(k) * b(k) (kernel::dot()の順序)
+template<class A, class B>
+static float referenceDot(size_t n, A a, B b) {
+    float sum = a(0) * b(0);
+    for (size_t k = 1; k < n; k++) {
+        sum = sum + a(k) * b(k);
+    }
+    return sum;
+}
+
+/// 参照実装: sum = c; sum = sum + a(k) * b(k) (kernel::dotAdd(), sparse::rowDotAdd()の順序)
+template<class A, class B>
+static float referenceDotAdd(float c, size_t begin, size_t end, A a, B b) {
+    float sum = c;
+    for (size_t k = begin; k < end; k++) {
+        sum = sum + a(k) * b(k);
+    }
+    return sum;
+}
+
+/// 参照実装: sum = c; sum = sum - a(k) * b(k) (kernel::dotSub()の順序)
+template<class A, class B>
+static float referenceDotSub(float c, size_t begin, size_t end, A a, B b) {
+    float sum = c;
+    for (size_t k = begin; k < end; k++) {
+        sum = sum - a(k) * b(k);
+    }
+    return sum;
+}
+
+/// ビット単位で一致しなかった要素の数を数える
+class Checker {
+public:
+    explicit Checker(const char* name) : _name(name), _count(0), _mismatch(0) {}
+
+    void compare(float actual, float expected) {
+        _count++;
+        if (memcmp(&actual, &expected, sizeof(float)) != 0) {
+            _mismatch++;
+        }
+    }
+
+    bool report(void) const {
+        printf("%-22s %10lu elements %8lu mismatches\n", _name, _count, _mismatch);
+        return _mismatch == 0;
+    }
+
+private:
+    const char* _name;
+    unsigned long _count;
+    unsigned long _mismatch;
+};
+
+static bool testMatmul(int trials) {
+    Checker checker("matmul");
+    for (int trial = 0; trial < trials; trial++) {
+        Matrix7f A, B, C;
+        randomize(A);
+        randomize(B);
+        kernel::matmul(A, B, C);
+        for (size_t row = 0; row < 7; row++) {
+            for (size_t col = 0; col < 7; col++) {
+                checker.compare(C(row, col), referenceDot(7, [&](size_t k) { return A(row, k); }, [&](size_t k) { return B(k, col); }));
+            }
+        }
+    }
+    return checker.report();
+}
+
+static bool testMatmult(int trials) {
+    Checker checker("matmult");
+    for (int trial = 0; trial < trials; trial++) {
+        SymmetricMatrix<7> S;
+        Matrix7f B, C;
+        randomize(S);
+        randomize(B);
+        kernel::matmult(S, B, C);
+        for (size_t row = 0; row < 7; row++) {
+            for (size_t col = 0; col < 7; col++) {
+                checker.compare(C(row, col), referenceDot(7, [&](size_t k) { return S(row, k); }, [&](size_t k) { return B(col, k); }));
+            }
+        }
+    }
+    return checker.report();
+}
+
+static bool testMatmuls(int trials) {
+    Checker checker("matmuls");
+    for (int trial = 0; trial < trials; trial++) {
+        Matrix7f A, B;
+        SymmetricMatrix<7> C;
+        randomize(A);
+        randomize(B);
+        kernel::matmuls(A, B, C);
+        for (size_t row = 0; row < 7; row++) {
+            for (size_t col = 0; col <= row; col++) {
+                checker.compare(C(row, col), referenceDot(7, [&](size_t k) { return A(row, k); }, [&](size_t k) { return B(k, col); }));
+            }
+        }
+    }
+    return checker.report();
+}
+
+static bool testMatmultadds(int trials) {
+    Checker checker("matmultadds");
+    for (int trial = 0; trial < trials; trial++) {
+        Matrix7f A, B;
+        SymmetricMatrix<7> C, D;
+        randomize(A);
+        randomize(B);
+        randomize(C);
+        kernel::matmultadds(A, B, C, D);
+        for (size_t row = 0; row < 7; row++) {
+            for (size_t col = 0; col <= row; col++) {
+                checker.compare(D(row, col), referenceDotAdd(C(row, col), 0, 7, [&](size_t k) { return A(row, k); }, [&](size_t k) { return B(col, k); }));
+            }
+        }
+    }
+    return checker.report();
+}
+
+static bool testMatvec(int trials) {
+    Checker checker("matmuladdvec/matmulvec");
+    for (int trial = 0; trial < trials; trial++) {
+        Matrix7f A;
+        Eigen::Matrix<float, 3, 7> A3;
+        Vector7f b, c, d, e;
+        Eigen::Vector3f f;
+        randomize(A);
+        randomize(A3);
+        randomize(b);
+        randomize(c);
+        kernel::matmuladdvec(A, b, c, d);
+        kernel::matmulvec(A, b, e);
+        kernel::matmulvec(A3, b, f);
+        for (size_t row = 0; row < 7; row++) {
+            checker.compare(d(row), referenceDotAdd(c(row), 0, 7, [&](size_t k) { return A(row, k); }, [&](size_t k) { return b(k); }));
+            checker.compare(e(row), referenceDot(7, [&](size_t k) { return A(row, k); }, [&](size_t k) { return b(k); }));
+        }
+        for (size_t row = 0; row < 3; row++) {
+            checker.compare(f(row), referenceDot(7, [&](size_t k) { return A3(row, k); }, [&](size_t k) { return b(k); }));
+        }
+    }
+    return checker.report();
+}
+
+static bool testInvmuls(int trials) {
+    Checker checker("invmuls");
+    for (int trial = 0; trial < trials; trial++) {
+        SymmetricMatrix<7> A, L, invL, invA;
+        randomizePositiveDefinite(A);
+        kernel::invmuls(A, L, invL, invA);
+
+        // コレスキー分解、下三角行列の逆行列、-L^-T * L^-1 を同じ順序で計算する
+        SymmetricMatrix<7> refL, refInvL, refInvA;
+        for (size_t row = 0; row < 7; row++) {
+            for (size_t col = 0; col < row; col++) {
+                float sum = referenceDotSub(A(row, col), 0, col, [&](size_t k) { return refL(row, k); }, [&](size_t k) { return refL(col, k); });
+                refL(row, col) = sum * refInvL(col, col);
+            }
+            float sum = referenceDotSub(A(row, row), 0, row, [&](size_t k) { return refL(row, k); }, [&](size_t k) { return refL(row, k); });
+            refL(row, row) = fpu::sqrt(sum);
+            refInvL(row, row) = 1.0f / refL(row, row);
+        }
+        for (size_t col = 0; col < 6; col++) {
+            for (size_t row = col + 1; row < 7; row++) {
+                float sum = referenceDotSub(0.0f, col, row, [&](size_t k) { return refL(row, k); }, [&](size_t k) { return refInvL(k, col); });
+                refInvL(row, col) = sum * refInvL(row, row);
+            }
+        }
+        for (size_t col = 0; col < 7; col++) {
+            for (size_t row = col; row < 7; row++) {
+                refInvA(row, col) = referenceDotSub(0.0f, row, 7, [&](size_t k) { return refInvL(k, row); }, [&](size_t k) { return refInvL(k, col); });
+            }
+        }
+        for (size_t i = 0; i < SymmetricMatrix<7>::SIZE; i++) {
+            checker.compare(L.data[i], refL.data[i]);
+            checker.compare(invL.data[i], refInvL.data[i]);
+            checker.compare(invA.data[i], refInvA.data[i]);
+        }
+    }
+    return checker.report();
+}
+
+template<size_t ROW = 0, bool END = (ROW == 7)>
+struct SparseRows {
+    static void compare(Checker& checker, const float (&x)[7], const Matrix7f& H) {
+        // 1の要素は格納された値ではなくxをそのまま加える
+        size_t first = sparse::nextNonZero<ObservationJacobianPattern>(ROW, 0);
+        auto a = [&](size_t k) { return (ObservationJacobianPattern::element(ROW, k) == sparse::ElementOne) ? 1.0f : H(ROW, k); };
+        auto b = [&](size_t k) { return (ObservationJacobianPattern::element(ROW, k) == sparse::ElementZero) ? 0.0f : x[k]; };
+        float expected = b(first) * a(first);
+        for (size_t k = first + 1; k < 7; k++) {
+            if (ObservationJacobianPattern::element(ROW, k) != sparse::ElementZero) {
+                expected = expected + b(k) * a(k);
+            }
+        }
+        checker.compare(sparse::RowDot<ObservationJacobianPattern, ROW>::apply(x, H), expected);
+        SparseRows<ROW + 1>::compare(checker, x, H);
+    }
+};
+
+template<size_t ROW>
+struct SparseRows<ROW, true> {
+    static void compare(Checker&, const float (&)[7], const Matrix7f&) {}
+};
+
+static bool testSparse(int trials) {
+    Checker checker("RowDot/rowDotAdd");
+    for (int trial = 0; trial < trials; trial++) {
+        Matrix7f G, H;
+        randomize(H);
+        initializeVelocityFilterJacobian(G, H);
+        float x[7];
+        for (float& value : x) {
+            value = uniform();
+        }
+        SparseRows<>::compare(checker, x, H);
+        for (size_t row = 0; row < 7; row++) {
+            float c = uniform();
+            float expected = c;
+            for (size_t k = 0; k < 7; k++) {
+                if (ObservationJacobianPattern::element(row, k) != sparse::ElementZero) {
+                    expected = expected + x[k] * H(row, k);
+                }
+            }
+            checker.compare(sparse::rowDotAdd(OBSERVATION_JACOBIAN_INDEX, row, c, x, H), expected);
+        }
+    }
+    return checker.report();
+}
+
+/// VelocityFilterを決まった入力で更新して、状態変数と共分散のハッシュを求める
+static uint32_t hashVelocityFilter(VelocityFilter::UpdateMode_t update_mode) {
+    static VelocityFilter filter;
+    filter.setUpdateMode(update_mode);
+    filter.setCovarianceDecimation(1);
+    filter.reset();
+    for (int step = 0; step < 3000; step++) {
+        float t = step * 0.001f;
+        Eigen::Vector3f accel(0.5f * sinf(3 * t), 0.3f * cosf(2 * t), 9.8f);
+        Eigen::Vector3f gyro(0.0f, 0.0f, 0.5f * sinf(t));
+        Eigen::Vector4f wheel_velocity(10 * sinf(t) + 0.1f, 8 * cosf(t), -10 * sinf(t), -8 * cosf(t) + 0.05f * sinf(40 * t));
+        Eigen::Vector4f wheel_current(0.5f * sinf(5 * t), 0.4f, -0.3f * cosf(t), 0.2f);
+        filter.update(accel, gyro, wheel_velocity, wheel_current);
+    }
+
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    auto feed = [&hash](const void* data, size_t size) {
+        const uint8_t* p = static_cast<const uint8_t*>(data);
+        for (size_t i = 0; i < size; i++) {
+            hash = (hash ^ p[i]) * 16777619u;
+        }
+    };
+    feed(filter._mu.data(), sizeof(float) * 7);
+    feed(filter._sigma.data, sizeof(filter._sigma.data));
+    return hash;
+}
+
+int main(int argc, char* argv[]) {
+    int trials = (2 <= argc) ? atoi(argv[1]) : 10000;
+    Random.seed((3 <= argc) ? static_cast<unsigned int>(atoi(argv[2])) : 1);
+    printf("backend %s, %d trials per kernel\n", BACKEND, trials);
+
+    bool ok = true;
+    ok &= testMatmul(trials);
+    ok &= testMatmult(trials);
+    ok &= testMatmuls(trials);
+    ok &= testMatmultadds(trials);
+    ok &= testMatvec(trials);
+    ok &= testInvmuls(trials);
+    ok &= testSparse(trials);
+
+    printf("velocity filter hash (batch)      %08X\n", static_cast<unsigned int>(hashVelocityFilter(VelocityFilter::UpdateModeBatch)));
+    printf("velocity filter hash (sequential) %08X\n", static_cast<unsigned int>(hashVelocityFilter(VelocityFilter::UpdateModeSequential)));
+    printf("%s\n", ok ? "PASS" : "FAIL");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,739 @@
+"""
+VelocityFilterのモデル(状態方程式と観測方程式)から、事前状態推定値・ヤコビアン・観測値と予測値との差を
+計算する直線的なC++コードを生成する
+
+    python velocity_filter_model.py
+
+source/board.hpp と source/filter/velocity_filter.cpp の static constexpr float 定数を読み込み、
+定数を畳み込んで共通部分式を除去した source/filter/velocity_filter_model.hpp を出力する。
+モデルを変更したときはこのファイルの model() を編集して再生成する。
+
+Copyright (c) 2021 Fujii Naomichi
+SPDX-License-Identifier: MIT
+"""
+
+import math
+import os
+import re
+import struct
+import sys
+
+SOURCE_DIR = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "source")
+CONSTANT_SOURCES = ["board.hpp", "filter/velocity_filter.cpp"]
+OUTPUT_PATH = os.path.join(SOURCE_DIR, "filter", "velocity_filter_model.hpp")
+
+
+def f32(value):
+    """単精度浮動小数点数に丸める"""
+    return struct.unpack("f", struct.pack("f", value))[0]
+
+
+def load_constants():
+    """static constexpr float で定義された定数を読み込む"""
+    constants = {"sqrt": math.sqrt}
+    pattern = re.compile(r"^static constexpr float (\w+) = (.+);")
+    for path in CONSTANT_SOURCES:
+        with open(os.path.join(SOURCE_DIR, path), encoding="utf-8") as f:
+            for line in f:
+                match = pattern.match(line.strip())
+                if not match:
+                    continue
+                expr = re.sub(r"(\d\.?\d*(?:[eE][-+]?\d+)?)f\b", r"\1", match.group(2))
+                try:
+                    constants[match.group(1)] = f32(eval(expr, {"__builtins__": {}}, constants))
+                except (NameError, SyntaxError, TypeError):
+                    pass
+    del constants["sqrt"]
+    return constants
+
+
+# ----------------------------------------------------------------------------
+# 数式
+# 式は変数・積・線形結合の3種類のノードで表し、同じ式は同じノードになるように登録する
+# ----------------------------------------------------------------------------
+
+class Expr:
+    _table = {}
+
+    def __new__(cls, key):
+        node = Expr._table.get(key)
+        if node is None:
+            node = object.__new__(cls)
+            node.key = key
+            node.id = len(Expr._table)
+            Expr._table[key] = node
+        return node
+
+    @property
+    def kind(self):
+        return self.key[0]
+
+    def constant(self):
+        """定数ならその値、そうでなければNone"""
+        if self.kind == "lin" and not self.key[2]:
+            return self.key[1]
+        return None
+
+    def __add__(self, other):
+        return add(self, other)
+
+    def __radd__(self, other):
+        return add(other, self)
+
+    def __sub__(self, other):
+        return add(self, scale(other, -1.0))
+
+    def __rsub__(self, other):
+        return add(other, scale(self, -1.0))
+
+    def __mul__(self, other):
+        return mul(self, other)
+
+    def __rmul__(self, other):
+        return mul(other, self)
+
+    def __neg__(self):
+        return scale(self, -1.0)
+
+    def __truediv__(self, other):
+        return scale(self, 1.0 / other)
+
+
+def var(name, cexpr, binding=None):
+    """変数。bindingを与えると微分では独立変数として扱い、コードではbindingの値を使う"""
+    node = Expr(("var", name))
+    node.cexpr = cexpr
+    node.binding = binding
+    return node
+
+
+def const(value):
+    return Expr(("lin", float(value), ()))
+
+
+def as_expr(x):
+    return x if isinstance(x, Expr) else const(x)
+
+
+def terms_of(x):
+    x = as_expr(x)
+    if x.kind == "lin":
+        return x.key[1], dict(x.key[2])
+    return 0.0, {x: 1.0}
+
+
+def linear(c0, terms):
+    terms = {node: coef for node, coef in terms.items() if coef != 0.0}
+    if (c0 == 0.0) and (len(terms) == 1):
+        node, coef = next(iter(terms.items()))
+        if coef == 1.0:
+            return node
+    return Expr(("lin", float(c0), tuple(sorted(terms.items(), key=lambda t: t[0].id))))
+
+
+def add(a, b):
+    c0, terms = terms_of(a)
+    d0, others = terms_of(b)
+    for node, coef in others.items():
+        terms[node] = terms.get(node, 0.0) + coef
+    return linear(c0 + d0, terms)
+
+
+def scale(a, k):
+    c0, terms = terms_of(a)
+    return linear(c0 * k, {node: coef * k for node, coef in terms.items()})
+
+
+def factors_of(x):
+    return list(x.key[1]) if x.kind == "mul" else [x]
+
+
+def mul(a, b):
+    a, b = as_expr(a), as_expr(b)
+    for x, y in ((a, b), (b, a)):
+        if x.constant() is not None:
+            return scale(y, x.constant())
+        c0, terms = terms_of(x)
+        if (x.kind == "lin") and (c0 == 0.0) and (len(terms) == 1):
+            node, coef = next(iter(terms.items()))
+            return scale(mul(node, y), coef)
+    factors = sorted(factors_of(a) + factors_of(b), key=lambda node: node.id)
+    return Expr(("mul", tuple(factors)))
+
+
+_diff_memo = {}
+
+
+def diff(e, x):
+    """eをxで偏微分する"""
+    memo_key = (e.id, x.id)
+    if memo_key in _diff_memo:
+        return _diff_memo[memo_key]
+    if e.kind == "var":
+        result = const(1.0 if e is x else 0.0)
+    elif e.kind == "lin":
+        result = const(0.0)
+        for node, coef in e.key[2]:
+            result = add(result, scale(diff(node, x), coef))
+    else:
+        result = const(0.0)
+        factors = e.key[1]
+        for i, factor in enumerate(factors):
+            d = diff(factor, x)
+            if d.constant() == 0.0:
+                continue
+            rest = const(1.0)
+            for j, other in enumerate(factors):
+                if j != i:
+                    rest = mul(rest, other)
+            result = add(result, mul(rest, d))
+    _diff_memo[memo_key] = result
+    return result
+
+
+# ----------------------------------------------------------------------------
+# モデル
+# ----------------------------------------------------------------------------
+
+def model(c):
+    """
+    オムニホイールの車体と車輪のモデルを定義する
+    @param c 定数
+    @return 出力の辞書
+    """
+    DELTA_TIME = 1.0 / c["IMU_OUTPUT_RATE"]
+    WHEEL_POS_R = math.sqrt(c["WHEEL_POS_R_2"])
+    COS_PHI = c["WHEEL_POS_X"] / WHEEL_POS_R
+    SIN_PHI = c["WHEEL_POS_Y"] / WHEEL_POS_R
+
+    # 入力
+    mu = [var(f"mu{i}", f"mu({i})") for i in range(7)]
+    wheel_velocity = [var(f"w{i}", f"wheel_velocity({i})") for i in range(4)]
+    last_wheel_velocity = [var(f"lw{i}", f"last_wheel_velocity({i})") for i in range(4)]
+    wheel_current = [var(f"i{i}", f"wheel_current({i})") for i in range(4)]
+    accel_x = var("ax", "accel.x()")
+    accel_y = var("ay", "accel.y()")
+    gyro_z = var("gz", "gyro.z()")
+
+    def wheel_velocity_error(vx, vy, omega):
+        # 車輪の周速度と車体速度から求めた車輪の接地点の速度との差
+        vx = vx * SIN_PHI
+        vy = vy * COS_PHI
+        omega = omega * WHEEL_POS_R
+        return [
+            wheel_velocity[0] - (omega - vx + vy),
+            wheel_velocity[1] - (omega + vx + vy),
+            wheel_velocity[2] - (omega + vx - vy),
+            wheel_velocity[3] - (omega - vx - vy),
+        ]
+
+    # 状態方程式
+    vx, vy, omega = mu[0], mu[1], mu[2]
+    kf = mu[3:7]
+    force = [k * e for k, e in zip(kf, wheel_velocity_error(vx, vy, omega))]
+    f = [
+        vx + (SIN_PHI / c["MACHINE_WEIGHT"] * DELTA_TIME) * (force[1] - force[0] + force[2] - force[3]) + omega * vy * DELTA_TIME,
+        vy + (COS_PHI / c["MACHINE_WEIGHT"] * DELTA_TIME) * (force[0] + force[1] - force[2] - force[3]) - omega * vx * DELTA_TIME,
+        omega + (WHEEL_POS_R / c["MACHINE_INERTIA"] * DELTA_TIME) * (force[0] + force[1] + force[2] + force[3]),
+        kf[0],
+        kf[1],
+        kf[2],
+        kf[3],
+    ]
+
+    # 観測方程式 (事前状態推定値のまわりで線形化する)
+    mu_hat = [var(f"mu_hat{i}", f"mu_hat({i})", f[i]) for i in range(7)]
+    vx_hat, vy_hat, omega_hat = mu_hat[0], mu_hat[1], mu_hat[2]
+    kf_hat = mu_hat[3:7]
+    force_hat = [k * e for k, e in zip(kf_hat, wheel_velocity_error(vx_hat, vy_hat, omega_hat))]
+    domega = [(c["IMU_OUTPUT_RATE"] / c["WHEEL_RADIUS"]) * (wheel_velocity[i] - last_wheel_velocity[i]) for i in range(4)]
+    h_minus_z = [(c["MOTOR_TORQUE_CONSTANT"] / c["WHEEL_INERTIA"]) * wheel_current[i] - (c["WHEEL_RADIUS"] / c["WHEEL_INERTIA"]) * force_hat[i] - domega[i] for i in range(4)]
+    h_minus_z.append((SIN_PHI / c["MACHINE_WEIGHT"]) * (force_hat[1] - force_hat[0] + force_hat[2] - force_hat[3]) - accel_x)
+    h_minus_z.append((COS_PHI / c["MACHINE_WEIGHT"]) * (force_hat[0] + force_hat[1] - force_hat[2] - force_hat[3]) - accel_y)
+    h_minus_z.append(omega_hat - gyro_z)
+
+    # 観測ノイズの分散
+    r_wheel = (c["MOTOR_TORQUE_CONSTANT"] / c["WHEEL_INERTIA"] * c["SIGMA_CURRENT"]) ** 2 + (c["SIGMA_VELOCITY"] / DELTA_TIME) ** 2
+    R = [r_wheel] * 4 + [c["SIGMA_ACCELEROMETER"] ** 2] * 2 + [c["SIGMA_GYROSCOPE"] ** 2]
+
+    # プロセスノイズの分散 (対角成分)
+    kf_sum = kf[0] + kf[1] + kf[2] + kf[3]
+    kf_sum_2 = kf_sum * kf_sum
+    Q = [
+        (DELTA_TIME * SIN_PHI / c["MACHINE_WEIGHT"] * c["WHEEL_RADIUS"] * c["SIGMA_VELOCITY"]) ** 2 * kf_sum_2,
+        (DELTA_TIME * COS_PHI / c["MACHINE_WEIGHT"] * c["WHEEL_RADIUS"] * c["SIGMA_VELOCITY"]) ** 2 * kf_sum_2,
+        (DELTA_TIME * WHEEL_POS_R / c["MACHINE_INERTIA"] * c["WHEEL_RADIUS"] * c["SIGMA_VELOCITY"]) ** 2 * kf_sum_2,
+    ] + [(DELTA_TIME * c["SIGMA_KF"]) ** 2] * 4
+
+    return {
+        "mu_hat": f,
+        "G": [[diff(f[row], mu[col]) for col in range(7)] for row in range(7)],
+        "H": [[diff(h_minus_z[row], mu_hat[col]) for col in range(7)] for row in range(7)],
+        "h_minus_z": h_minus_z,
+        "R": [as_expr(r) for r in R],
+        "Q": [as_expr(q) for q in Q],
+        "kf_hat_mean": 0.25 * (kf_hat[0] + kf_hat[1] + kf_hat[2] + kf_hat[3]),
+    }
+
+
+# ----------------------------------------------------------------------------
+# コード生成
+# 式を単精度の二項演算に分解する。同じ演算は同じノードになるので共通部分式は1回だけ計算される
+# ----------------------------------------------------------------------------
+
+class Op:
+    _table = {}
+    nodes = []
+
+    def __new__(cls, key):
+        node = Op._table.get(key)
+        if node is None:
+            node = object.__new__(cls)
+            node.key = key
+            node.index = len(Op.nodes)
+            node.sig = signature(key)
+            node.uses = 0
+            node.name = None
+            Op._table[key] = node
+            Op.nodes.append(node)
+        return node
+
+    @property
+    def kind(self):
+        return self.key[0]
+
+    def children(self):
+        return [x for x in self.key[1:] if isinstance(x, Op)]
+
+    def is_leaf(self):
+        return self.kind in ("lit", "in")
+
+    @staticmethod
+    def reset():
+        Op._table = {}
+        Op.nodes = []
+
+
+def signature(key):
+    """演算の構造を表す文字列。2回目のコード生成でも同じになる"""
+    if key[0] in ("lit", "in"):
+        return key[1]
+    return "(" + " ".join([key[0]] + [x.sig for x in key[1:]]) + ")"
+
+
+def literal(value):
+    # 単精度で同じ値になる最も短い表記を使う
+    value = f32(value)
+    for digits in range(6, 10):
+        text = "%.*g" % (digits, value)
+        if f32(float(text)) == value:
+            break
+    if not re.search(r"[.e]", text):
+        text += ".0"
+    return Op(("lit", text + "f"))
+
+
+def binary(kind, a, b):
+    if (kind in ("add", "mul")) and (b.sig < a.sig):
+        a, b = b, a
+    return Op((kind, a, b))
+
+
+def same_magnitude(a, b):
+    return abs(a - b) <= 1e-6 * max(abs(a), abs(b))
+
+
+_lower_memo = {}
+_representatives = {}
+_sum_lists = None
+_preferred_pairs = []
+
+
+def proportional_key(e):
+    """定数倍を除いて等しい線形結合が同じ値になるキー"""
+    c0, terms = e.key[1], e.key[2]
+    base = terms[0][1]
+    return (float("%.7g" % (c0 / base)),) + tuple((node.id, float("%.7g" % (coef / base))) for node, coef in terms)
+
+
+def find_representatives(roots):
+    """
+    定数倍を除いて等しい線形結合ごとに代表を決める。積の因子になっている式を優先する
+    代表以外は代表の定数倍として計算する
+    """
+    order = []
+    factors = set()
+    visited = set()
+
+    def visit(e):
+        if e.id in visited:
+            return
+        visited.add(e.id)
+        if e.kind == "var":
+            if e.binding is not None:
+                visit(e.binding)
+            return
+        if e.kind == "mul":
+            for factor in e.key[1]:
+                factors.add(factor.id)
+                visit(factor)
+            return
+        for node, _ in e.key[2]:
+            visit(node)
+        if 2 <= len(e.key[2]):
+            order.append(e)
+
+    for root in roots:
+        visit(root)
+    for preferred in (True, False):
+        for e in order:
+            if (e.id in factors) == preferred:
+                _representatives.setdefault(proportional_key(e), unit_form(e))
+
+
+def unit_form(e):
+    """係数の絶対値がすべて等しい線形結合は、lower_linear()と同じく最初の項が+1になるように正規化する"""
+    c0, terms = e.key[1], e.key[2]
+    if (c0 != 0.0) or not all(same_magnitude(abs(coef), abs(terms[0][1])) for _, coef in terms):
+        return e
+    return linear(0.0, {node: math.copysign(1.0, coef * terms[0][1]) for node, coef in terms})
+
+
+def lower(e):
+    """式を演算ノードに変換する"""
+    if e.id in _lower_memo:
+        return _lower_memo[e.id]
+    if e.kind == "var":
+        result = lower(e.binding) if e.binding is not None else Op(("in", e.cexpr))
+    elif e.kind == "mul":
+        factors = [lower(factor) for factor in e.key[1]]
+        result = factors[0]
+        for factor in factors[1:]:
+            result = binary("mul", result, factor)
+    else:
+        result = lower_linear(e)
+    _lower_memo[e.id] = result
+    return result
+
+
+def lower_linear(e):
+    c0, terms = e.key[1], e.key[2]
+    if not terms:
+        return literal(c0)
+    if 2 <= len(terms):
+        representative = _representatives.get(proportional_key(e), e)
+        ratio = terms[0][1] / representative.key[2][0][1]
+        if (representative is not e) and not same_magnitude(abs(ratio), 1.0):
+            return binary("mul", literal(ratio), lower(representative))
+
+    # 係数の絶対値が等しい項をまとめて、符号付きの和に1回だけ係数を掛ける
+    groups = []
+    for node, coef in terms:
+        for group in groups:
+            if same_magnitude(group[0], abs(coef)):
+                group[1].append((node, coef))
+                break
+        else:
+            groups.append((abs(coef), [(node, coef)]))
+
+    # 項は (符号, 演算, 項を識別する文字列) で表す
+    parts = []
+    for magnitude, members in groups:
+        if same_magnitude(magnitude, 1.0):
+            for node, coef in members:
+                parts.append((coef > 0.0, lower(node), f"e{node.id}"))
+        elif len(members) == 1:
+            node, coef = members[0]
+            parts.append((coef > 0.0, binary("mul", literal(magnitude), lower(node)), f"{f32(magnitude)!r}*e{node.id}"))
+        else:
+            # 内側の和は最初の項が正になるように符号を揃えて、他の式と共有できるようにする
+            sign = 1.0 if members[0][1] > 0.0 else -1.0
+            inner = linear(0.0, {node: math.copysign(1.0, coef) * sign for node, coef in members})
+            parts.append((sign > 0.0, binary("mul", literal(magnitude), lower(inner)), f"{f32(magnitude)!r}*e{inner.id}"))
+    if c0 != 0.0:
+        parts.append((c0 > 0.0, literal(abs(c0)), f"{f32(abs(c0))!r}"))
+    parts = [(positive, value) for positive, value, _ in combine_pairs(parts)]
+
+    # 正の項から始める。すべて負の項なら定数を掛けている項の定数の符号を反転して最初の項にする
+    parts.sort(key=lambda part: not part[0])
+    if not parts[0][0]:
+        for i, (_, value) in enumerate(parts):
+            if (value.kind == "mul") and (value.key[1].kind == "lit" or value.key[2].kind == "lit"):
+                lit, other = (value.key[1], value.key[2]) if value.key[1].kind == "lit" else (value.key[2], value.key[1])
+                parts[i] = (True, binary("mul", literal(-float(lit.key[1][:-1])), other))
+                parts.insert(0, parts.pop(i))
+                break
+        else:
+            parts[0] = (True, Op(("neg", parts[0][1])))
+    result = parts[0][1]
+    for positive, value in parts[1:]:
+        result = binary("add" if positive else "sub", result, value)
+    return result
+
+
+def combine_pairs(parts):
+    """複数の和に現れる2項の組を先に計算する"""
+    if _sum_lists is not None:
+        _sum_lists.append([(positive, name) for positive, _, name in parts])
+    for name_a, name_b, same_sign in _preferred_pairs:
+        found = {name: i for i, (_, _, name) in enumerate(parts)}
+        if (name_a not in found) or (name_b not in found):
+            continue
+        positive_a, a, _ = parts[found[name_a]]
+        positive_b, b, _ = parts[found[name_b]]
+        if (positive_a == positive_b) != same_sign:
+            continue
+        node = binary("add" if same_sign else "sub", a, b)
+        parts = [part for part in parts if part[2] not in (name_a, name_b)]
+        parts.append((positive_a, node, pair_name(name_a, name_b, same_sign)))
+    return parts
+
+
+def pair_name(name_a, name_b, same_sign):
+    return "(" + name_a + ("+" if same_sign else "-") + name_b + ")"
+
+
+def find_preferred_pairs(lists):
+    """
+    和の項の組のうち、最も多くの和に現れる組から順に共通部分式として取り出す
+    @param lists 和の項 (符号, 項を識別する文字列) のリストのリスト
+    """
+    lists = [list(parts) for parts in lists]
+    pairs = []
+    while True:
+        counts = {}
+        for parts in lists:
+            for i in range(len(parts)):
+                for j in range(i + 1, len(parts)):
+                    (positive_a, name_a), (positive_b, name_b) = sorted((parts[i], parts[j]), key=lambda part: part[1])
+                    key = (name_a, name_b, positive_a == positive_b)
+                    counts[key] = counts.get(key, 0) + 1
+        candidates = [(-count, key) for key, count in counts.items() if 2 <= count]
+        if not candidates:
+            return pairs
+        _, best = min(candidates)
+        pairs.append(best)
+        name_a, name_b, same_sign = best
+        combined = pair_name(name_a, name_b, same_sign)
+        for index, parts in enumerate(lists):
+            found = {name: positive for positive, name in parts}
+            if (name_a in found) and (name_b in found) and ((found[name_a] == found[name_b]) == same_sign):
+                lists[index] = [part for part in parts if part[1] not in (name_a, name_b)] + [(found[name_a], combined)]
+
+
+def count_operations(roots):
+    visited = set()
+    count = {"add": 0, "sub": 0, "mul": 0, "neg": 0}
+
+    def visit(node):
+        if id(node) in visited:
+            return
+        visited.add(id(node))
+        for child in node.children():
+            visit(child)
+        if node.kind in count:
+            count[node.kind] += 1
+
+    for root in roots:
+        visit(root)
+    return count
+
+
+def format_op(node, top=True):
+    """演算ノードを式として書き出す。複数回使われるノードは一時変数を参照する"""
+    if node.name is not None and not top:
+        return node.name
+    kind = node.kind
+    if kind in ("lit", "in"):
+        return node.key[1]
+    if kind == "neg":
+        return "-" + format_op(node.key[1], False)
+    left, right = node.key[1], node.key[2]
+    if (kind == "mul") and (right.kind == "lit"):
+        left, right = right, left
+    a = format_op(left, False)
+    b = format_op(right, False)
+    # 記述した順に演算されるように右辺の演算を括弧で囲む
+    if kind == "mul":
+        if left.kind in ("add", "sub") and left.name is None:
+            a = "(" + a + ")"
+        if right.kind in ("add", "sub", "mul", "neg") and right.name is None:
+            b = "(" + b + ")"
+        return a + " * " + b
+    if right.kind in ("add", "sub", "neg") and right.name is None:
+        b = "(" + b + ")"
+    return a + (" + " if kind == "add" else " - ") + b
+
+
+def generate(outputs):
+    global _sum_lists, _preferred_pairs
+    expressions = outputs["mu_hat"] + outputs["h_minus_z"] + [e for row in outputs["G"] + outputs["H"] for e in row] + outputs["Q"] + [outputs["kf_hat_mean"]]
+    find_representatives(expressions)
+
+    # 1回目は和に現れる項の組を数える
+    _sum_lists = []
+    for e in expressions:
+        lower(e)
+    _preferred_pairs = find_preferred_pairs(_sum_lists)
+    _sum_lists = None
+    _lower_memo.clear()
+    Op.reset()
+
+    assignments = []
+    roots = []
+
+    def assign(target, e):
+        node = lower(e)
+        roots.append(node)
+        assignments.append((target, node))
+
+    for i, e in enumerate(outputs["mu_hat"]):
+        assign(f"mu_hat({i})", e)
+
+    # ヤコビアンの定数の要素はreset()で1回だけ設定する
+    patterns = {}
+    constant_elements = []
+    for name in ("G", "H"):
+        pattern = []
+        for row in range(7):
+            pattern_row = []
+            for col in range(7):
+                e = outputs[name][row][col]
+                value = e.constant()
+                if value is None:
+                    pattern_row.append("sparse::ElementVariable")
+                    assign(f"{name}({row}, {col})", e)
+                elif value == 0.0:
+                    pattern_row.append("sparse::ElementZero")
+                elif value == 1.0:
+                    pattern_row.append("sparse::ElementOne")
+                    constant_elements.append(f"{name}({row}, {col})")
+                else:
+                    sys.exit(f"{name}({row}, {col}) = {value} must be 0, 1 or variable")
+            pattern.append(pattern_row)
+        patterns[name] = pattern
+
+    for i, e in enumerate(outputs["h_minus_z"]):
+        assign(f"h_minus_z({i})", e)
+    for i, e in enumerate(outputs["R"]):
+        assign(f"R({i})", e)
+    for i, e in enumerate(outputs["Q"]):
+        assign(f"Q({i})", e)
+    assign("kf_hat_mean", outputs["kf_hat_mean"])
+
+    # 出力から参照される演算のみ数える
+    visited = set()
+
+    def count_uses(node):
+        node.uses += 1
+        if id(node) in visited:
+            return
+        visited.add(id(node))
+        for child in node.children():
+            count_uses(child)
+
+    for node in roots:
+        count_uses(node)
+
+    # 複数回使われる演算は一時変数に格納する
+    # 事前状態推定値は出力そのものを一時変数として使う
+    lines = []
+    for target, node in assignments:
+        if target.startswith("mu_hat(") and node.name is None and not node.is_leaf():
+            node.name = target
+    temporaries = set(id(node) for node in Op.nodes if (id(node) in visited) and not node.is_leaf() and (2 <= node.uses) and (node.name is None))
+    emitted = set()
+    for target, node in assignments:
+        def emit(n):
+            if id(n) in emitted or n.is_leaf():
+                return
+            for child in n.children():
+                emit(child)
+            if id(n) in temporaries:
+                emitted.add(id(n))
+                lines.append(f"    const float t{len(emitted) - 1} = {format_op(n)};")
+                n.name = f"t{len(emitted) - 1}"
+
+        emit(node)
+        if node.name == target:
+            emitted.add(id(node))
+            lines.append(f"    {target} = {format_op(node)};")
+        else:
+            lines.append(f"    {target} = {format_op(node, node.name is None)};")
+    count = count_operations(roots)
+    return lines, patterns, constant_elements, count
+
+
+def write_header(lines, patterns, constant_elements, count):
+    total = sum(count.values())
+    out = []
+    out.append("/**")
+    out.append(" * @file velocity_filter_model.hpp")
+    out.append(" * @author Fujii Naomichi")
+    out.append(" * @copyright (c) 2021 Fujii Naomichi")
+    out.append(" * SPDX-License-Identifier: MIT")
+    out.append(" */")
+    out.append("")
+    out.append("// このファイルは tools/velocity_filter_model.py で生成される。直接編集しないこと")
+    out.append(f"// 浮動小数点演算: 加算 {count['add']}, 減算 {count['sub']}, 乗算 {count['mul']}, 符号反転 {count['neg']}, 合計 {total}")
+    out.append("")
+    out.append("#pragma once")
+    out.append("")
+    out.append("#include <Eigen/Core>")
+    out.append('#include "sparse_kernel.hpp"')
+    out.append("")
+    for name, description in (("G", "線形化された状態方程式Gの構造"), ("H", "線形化された観測方程式Hの構造")):
+        out.append(f"/// {description}")
+        out.append(f"static constexpr sparse::Element_t VELOCITY_FILTER_{name}_PATTERN[7][7] = {{")
+        for row in patterns[name]:
+            out.append("    {" + ", ".join(row) + "},")
+        out.append("};")
+        out.append("")
+    out.append("/**")
+    out.append(" * @brief G, Hの定数の要素を設定する")
+    out.append(" * 0の要素は設定しないので、事前に0で初期化しておくこと")
+    out.append(" */")
+    out.append("static inline void initializeVelocityFilterJacobian(Eigen::Matrix<float, 7, 7>& G, Eigen::Matrix<float, 7, 7>& H) {")
+    for element in constant_elements:
+        out.append(f"    {element} = 1.0f;")
+    out.append("}")
+    out.append("")
+    out.append("/**")
+    out.append(" * @brief 事前状態推定値と線形化した状態方程式・観測方程式、観測値と予測値との差を計算する")
+    out.append(" * G, Hは値が変化する要素のみ更新する")
+    out.append(" * @param mu 状態変数")
+    out.append(" * @param accel 加速度センサーの測定値")
+    out.append(" * @param gyro ジャイロスコープの測定値")
+    out.append(" * @param wheel_velocity 車輪速度")
+    out.append(" * @param last_wheel_velocity 前回の更新時の車輪速度")
+    out.append(" * @param wheel_current モーター電流")
+    out.append(" * @param mu_hat 事前状態推定値")
+    out.append(" * @param G 線形化された状態方程式")
+    out.append(" * @param H 線形化された観測方程式")
+    out.append(" * @param h_minus_z 観測値と予測値との差")
+    out.append(" * @param R 観測ノイズの分散")
+    out.append(" * @param Q プロセスノイズの分散 (対角成分)")
+    out.append(" * @param kf_hat_mean 摩擦係数の事前推定値の平均値")
+    out.append(" */")
+    out.append("static inline void computeVelocityFilterModel(const Eigen::Matrix<float, 7, 1>& mu, const Eigen::Vector3f& accel, const Eigen::Vector3f& gyro,")
+    out.append("                                              const Eigen::Vector4f& wheel_velocity, const Eigen::Vector4f& last_wheel_velocity, const Eigen::Vector4f& wheel_current,")
+    out.append("                                              Eigen::Matrix<float, 7, 1>& mu_hat, Eigen::Matrix<float, 7, 7>& G, Eigen::Matrix<float, 7, 7>& H,")
+    out.append("                                              Eigen::Matrix<float, 7, 1>& h_minus_z, Eigen::Matrix<float, 7, 1>& R, Eigen::Matrix<float, 7, 1>& Q, float& kf_hat_mean) {")
+    out.extend(lines)
+    out.append("}")
+    out.append("")
+    with open(OUTPUT_PATH, "w", encoding="utf-8", newline="\n") as f:
+        f.write("\n".join(out))
+    return total
+
+
+def main():
+    constants = load_constants()
+    outputs = model(constants)
+    lines, patterns, constant_elements, count = generate(outputs)
+    total = write_header(lines, patterns, constant_elements, count)
+    print(f"{os.path.relpath(OUTPUT_PATH)}: {total} floating point operations ({count})")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,332 @@
+/**
+ * @file velocity_smoother.cpp
+ * @author Fujii Naomichi
+ * @copyright (c) 2021 Fujii Naomichi
+ * SPDX-License-Identifier: MIT
+ */
+
+/*
+ * 記録したモーションデータのログから、VelocityFilterと同じモデルで前向きのEKFと後ろ向きのRTS平滑化を行い、
+ * 車体速度の参照値を求めるホスト用のツール
+ *
+ * ビルド (tools/ で実行する):
+ *   g++ -std=gnu++14 -O2 -DEIGEN_NO_DEBUG -I../source -I../source/filter -I../include -I../eigen velocity_smoother.cpp -o velocity_smoother
+ *
+ * 使い方:
+ *   velocity_smoother <ログファイル> [出力するCSVファイル]
+ *
+ * ログファイルはStreamDataMotionをファームウェアが送信したバイト列のまま連結したものとし、1個のパケットを速度フィルタの1回の更新として扱う。
+ * モデルはsource/filter/velocity_filter_model.hppをそのまま使うので、SIGMA_*を変えて評価するときは
+ * velocity_filter.cppを編集してtools/velocity_filter_model.pyで再生成してからビルドし直す。
+ * 全区間の事後誤差を保持しないように、前向きの処理でBLOCK_SIZE回ごとに状態を保存しておき、
+ * 後ろ向きの処理ではブロックごとに前向きの処理をやり直す。
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <Eigen/Core>
+#include <Eigen/Cholesky>
+#include <Eigen/StdVector>
+#include "fpu.hpp"
+#include "velocity_filter_model.hpp"
+#include <stream_data.hpp>
+
+using Vector7d = Eigen::Matrix<double, 7, 1>;
+using Matrix7d = Eigen::Matrix<double, 7, 7>;
+
+/// 摩擦係数の最小値 (velocity_filter.cppのMIN_KFと同じ値)
+static constexpr double MIN_KF = 1.0;
+
+/// 摩擦係数の最大値 (velocity_filter.cppのMAX_KFと同じ値)
+static constexpr double MAX_KF = 1000.0;
+
+/// 摩擦係数の初期値 [Ns]
+static constexpr double INITIAL_KF = 10.0;
+
+/// 車体速度の初期値の標準偏差 [m/s], [rad/s]
+static constexpr double INITIAL_SIGMA_VELOCITY = 1.0;
+
+/// 摩擦係数の初期値の標準偏差 [Ns]
+static constexpr double INITIAL_SIGMA_KF = 100.0;
+
+/// 前向きの処理で状態を保存する間隔 [回]
+static constexpr size_t BLOCK_SIZE = 4096;
+
+/// 速度フィルタの1回分の入力
+struct Input_t {
+    Eigen::Vector3f accel;
+    Eigen::Vector3f gyro;
+    Eigen::Vector4f wheel_velocity;
+    Eigen::Vector4f wheel_current;
+};
+
+/// 前向きの処理の状態
+struct ForwardState_t {
+    /// 事後状態推定値
+    Vector7d mu;
+
+    /// 事後誤差
+    Matrix7d sigma;
+
+    /// 前回の更新時の車輪速度
+    Eigen::Vector4f last_wheel_velocity;
+};
+
+/// 1回分の予測
+struct Prediction_t {
+    /// 事前状態推定値
+    Vector7d mu_hat;
+
+    /// 事前誤差
+    Matrix7d S_hat;
+
+    /// 線形化された状態方程式
+    Matrix7d G;
+};
+
+/// 1回分の出力
+struct Output_t {
+    /// ファームウェアの推定値
+    float firmware[3];
+
+    /// 前向きのEKFの推定値
+    float forward[7];
+
+    /// 平滑化した推定値
+    float smoothed[7];
+
+    /// 平滑化した車体速度の標準偏差
+    float smoothed_sigma[3];
+};
+
+/**
+ * @brief 半精度浮動小数点数を単精度浮動小数点数に変換する
+ */
+static float fromFp16(std::uint16_t value) {
+    int exponent = (value >> 10) & 0x1F;
+    int mantissa = value & 0x3FF;
+    float result;
+    if (exponent == 0) {
+        result = std::ldexp(static_cast<float>(mantissa), -24);
+    }
+    else if (exponent == 0x1F) {
+        result = mantissa ? NAN : INFINITY;
+    }
+    else {
+        result = std::ldexp(static_cast<float>(mantissa | 0x400), exponent - 25);
+    }
+    return (value & 0x8000) ? -result : result;
+}
+
+/**
+ * @brief パケットから速度フィルタの入力を取り出す
+ */
+static Input_t decodeInput(const StreamDataMotion& packet) {
+    Input_t input;
+    for (int i = 0; i < 3; i++) {
+        input.accel(i) = fromFp16(packet.body_acceleration[i]);
+        input.gyro(i) = fromFp16(packet.gyroscope[i]);
+    }
+    for (int i = 0; i < 4; i++) {
+        input.wheel_velocity(i) = fromFp16(packet.wheel_velocity_meas[i]);
+        input.wheel_current(i) = fromFp16(packet.wheel_current_meas_q[i]);
+    }
+    return input;
+}
+
+/**
+ * @brief 前向きのEKFで1回更新する
+ * 線形化と観測値の予測はファームウェアと同じ単精度のモデルで行い、共分散の計算は倍精度で行う
+ * @param input 入力
+ * @param state 状態
+ * @param prediction 予測
+ */
+static void forwardStep(const Input_t& input, ForwardState_t& state, Prediction_t& prediction) {
+    // Gの変化しない要素はモデルで設定されないので最初に一度だけ初期化する
+    static Eigen::Matrix<float, 7, 7> G = Eigen::Matrix<float, 7, 7>::Zero(), H = Eigen::Matrix<float, 7, 7>::Zero();
+    static bool initialized = false;
+    if (!initialized) {
+        initializeVelocityFilterJacobian(G, H);
+        initialized = true;
+    }
+
+    // 事前状態推定値と線形化した状態方程式・観測方程式を求める
+    Eigen::Matrix<float, 7, 1> mu = state.mu.cast<float>(), mu_hat, h_minus_z, R, Q;
+    float kf_hat_mean;
+    computeVelocityFilterModel(mu, input.accel, input.gyro, input.wheel_velocity, state.last_wheel_velocity, input.wheel_current, mu_hat, G, H, h_minus_z, R, Q,
+                               kf_hat_mean);
+    state.last_wheel_velocity = input.wheel_velocity;
+
+    // 事前誤差を求める
+    prediction.mu_hat = mu_hat.cast<double>();
+    prediction.G = G.cast<double>();
+    prediction.S_hat = prediction.G * state.sigma * prediction.G.transpose();
+    prediction.S_hat.diagonal() += Q.cast<double>();
+
+    // 観測値で更新する (共分散はJosephの形で更新して対称性と正定値性を保つ)
+    Matrix7d Hd = H.cast<double>();
+    Matrix7d S = Hd * prediction.S_hat * Hd.transpose();
+    S.diagonal() += R.cast<double>();
+    Matrix7d K = S.ldlt().solve(Hd * prediction.S_hat).transpose();
+    Matrix7d I_KH = Matrix7d::Identity() - K * Hd;
+    state.mu = prediction.mu_hat - K * h_minus_z.cast<double>();
+    state.sigma = I_KH * prediction.S_hat * I_KH.transpose() + K * R.cast<double>().asDiagonal() * K.transpose();
+    for (int i = 3; i < 7; i++) {
+        state.mu(i) = std::min(std::max(state.mu(i), MIN_KF), MAX_KF);
+    }
+}
+
+/**
+ * @brief 値を小数点以下6桁の固定小数点表記で書き込む
+ * printf()の%gは長いログでは出力に時間がかかるので、整数の変換のみで書式化する
+ * @param buffer 書き込む位置
+ * @param value 値
+ * @return 書き込んだ後の位置
+ */
+static char* formatValue(char* buffer, float value) {
+    *buffer++ = ',';
+    if (!std::isfinite(value) || (1e12f < std::fabs(value))) {
+        return buffer + std::sprintf(buffer, "%g", value);
+    }
+    if (value < 0.0f) {
+        *buffer++ = '-';
+        value = -value;
+    }
+    auto scaled = static_cast<unsigned long long>(std::llround(static_cast<double>(value) * 1e6));
+    char digits[24];
+    int length = 0;
+    do {
+        digits[length++] = static_cast<char>('0' + (scaled % 10));
+        scaled /= 10;
+    } while ((scaled != 0) || (length <= 6));
+    while (0 < length) {
+        *buffer++ = digits[--length];
+        if (length == 6) {
+            *buffer++ = '.';
+        }
+    }
+    return buffer;
+}
+
+int main(int argc, char* argv[]) {
+    if ((argc < 2) || (3 < argc)) {
+        std::fprintf(stderr, "usage: %s <log file> [output csv]\n", argv[0]);
+        return 1;
+    }
+
+    // ログを読み込む
+    std::FILE* input_file = std::fopen(argv[1], "rb");
+    if (!input_file) {
+        std::fprintf(stderr, "cannot open %s\n", argv[1]);
+        return 1;
+    }
+    std::vector<StreamDataMotion> packets;
+    StreamDataMotion packet;
+    while (std::fread(&packet, sizeof(packet), 1, input_file) == 1) {
+        packets.push_back(packet);
+    }
+    std::fclose(input_file);
+    size_t count = packets.size();
+    if (count == 0) {
+        std::fprintf(stderr, "%s contains no packets\n", argv[1]);
+        return 1;
+    }
+
+    // 前向きの処理を行い、ブロックの先頭の状態を保存する
+    ForwardState_t initial_state;
+    initial_state.mu.setZero();
+    initial_state.mu.tail<4>().setConstant(INITIAL_KF);
+    initial_state.sigma.setZero();
+    initial_state.sigma.diagonal().head<3>().setConstant(INITIAL_SIGMA_VELOCITY * INITIAL_SIGMA_VELOCITY);
+    initial_state.sigma.diagonal().tail<4>().setConstant(INITIAL_SIGMA_KF * INITIAL_SIGMA_KF);
+    initial_state.last_wheel_velocity = decodeInput(packets[0]).wheel_velocity;
+    std::vector<ForwardState_t, Eigen::aligned_allocator<ForwardState_t>> checkpoints;
+    std::vector<Output_t> outputs(count);
+    ForwardState_t state = initial_state;
+    for (size_t k = 0; k < count; k++) {
+        if ((k % BLOCK_SIZE) == 0) {
+            checkpoints.push_back(state);
+        }
+        Prediction_t prediction;
+        forwardStep(decodeInput(packets[k]), state, prediction);
+        for (int i = 0; i < 3; i++) {
+            outputs[k].firmware[i] = fromFp16(packets[k].body_velocity[i]);
+        }
+        for (int i = 0; i < 7; i++) {
+            outputs[k].forward[i] = static_cast<float>(state.mu(i));
+        }
+    }
+
+    // ブロックごとに前向きの処理をやり直して後ろ向きに平滑化する
+    // 平滑化した値: mu_s(k) = mu(k) + C * (mu_s(k+1) - mu_hat(k+1)), C = sigma(k) * G(k+1)^T * S_hat(k+1)^-1
+    std::vector<ForwardState_t, Eigen::aligned_allocator<ForwardState_t>> states(BLOCK_SIZE);
+    std::vector<Prediction_t> predictions(BLOCK_SIZE);
+    Prediction_t next_prediction;
+    Vector7d next_mu = Vector7d::Zero();
+    Matrix7d next_sigma = Matrix7d::Zero();
+    for (size_t block = checkpoints.size(); 0 < block--;) {
+        size_t begin = block * BLOCK_SIZE;
+        size_t length = std::min(BLOCK_SIZE, count - begin);
+        state = checkpoints[block];
+        for (size_t i = 0; i < length; i++) {
+            forwardStep(decodeInput(packets[begin + i]), state, predictions[i]);
+            states[i] = state;
+        }
+        for (size_t i = length; 0 < i--;) {
+            Vector7d mu = states[i].mu;
+            Matrix7d sigma = states[i].sigma;
+            if ((begin + i + 1) < count) {
+                Matrix7d C = next_prediction.S_hat.ldlt().solve(next_prediction.G * sigma).transpose();
+                mu += C * (next_mu - next_prediction.mu_hat);
+                sigma += C * (next_sigma - next_prediction.S_hat) * C.transpose();
+            }
+            Output_t& output = outputs[begin + i];
+            for (int j = 0; j < 7; j++) {
+                output.smoothed[j] = static_cast<float>(mu(j));
+            }
+            for (int j = 0; j < 3; j++) {
+                output.smoothed_sigma[j] = static_cast<float>(std::sqrt(std::max(sigma(j, j), 0.0)));
+            }
+            next_prediction = predictions[i];
+            next_mu = mu;
+            next_sigma = sigma;
+        }
+    }
+
+    // 結果を出力する
+    std::FILE* output_file = (argc == 3) ? std::fopen(argv[2], "w") : stdout;
+    if (!output_file) {
+        std::fprintf(stderr, "cannot open %s\n", argv[2]);
+        return 1;
+    }
+    std::fprintf(output_file, "index,firmware_vx,firmware_vy,firmware_omega,forward_vx,forward_vy,forward_omega,forward_kf1,forward_kf2,forward_kf3,forward_kf4,"
+                              "smoothed_vx,smoothed_vy,smoothed_omega,smoothed_kf1,smoothed_kf2,smoothed_kf3,smoothed_kf4,"
+                              "smoothed_sigma_vx,smoothed_sigma_vy,smoothed_sigma_omega\n");
+    for (size_t k = 0; k < count; k++) {
+        const Output_t& output = outputs[k];
+        char line[1024];
+        char* p = line + std::sprintf(line, "%zu", k);
+        for (float value : output.firmware) {
+            p = formatValue(p, value);
+        }
+        for (float value : output.forward) {
+            p = formatValue(p, value);
+        }
+        for (float value : output.smoothed) {
+            p = formatValue(p, value);
+        }
+        for (float value : output.smoothed_sigma) {
+            p = formatValue(p, value);
+        }
+        *p++ = '\n';
+        std::fwrite(line, 1, p - line, output_file);
+    }
+    if (output_file != stdout) {
+        std::fclose(output_file);
+    }
+    return 0;
+}